@@ -0,0 +1,319 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Local multi-process stand-in for a distributed block sweep: the blocks of
+// LemonSolver::sweepBlocks are solved in forked child processes that send
+// their flows back through pipes, the parent then runs the exact residual
+// pass of LemonSolver::solveFromPrimal on the swept solution.
+//
+// Usage: MultiProcessBlockSweepExample [nPoints] [nProcesses] [nSweeps]
+
+#include "LemonSolver.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace
+{
+
+bool WriteAll( int fd, const void *data, size_t size )
+{
+  const char *p = static_cast<const char *>( data );
+  while( size > 0 )
+    {
+    ssize_t n = write( fd, p, size );
+    if( n <= 0 )
+      {
+      return false;
+      }
+    p += n;
+    size -= n;
+    }
+  return true;
+}
+
+
+bool ReadAll( int fd, void *data, size_t size )
+{
+  char *p = static_cast<char *>( data );
+  while( size > 0 )
+    {
+    ssize_t n = read( fd, p, size );
+    if( n <= 0 )
+      {
+      return false;
+      }
+    p += n;
+    size -= n;
+    }
+  return true;
+}
+
+
+// Solves the blocks of a sweep round robin in nProcesses child processes,
+// each child writes the index, the number of columns and the flows of each of
+// its blocks to its pipe, a block without optimal flow is sent without
+// columns and left as is
+class ForkedLemonSolver : public LemonSolver
+{
+public:
+  ForkedLemonSolver( int n ) : nProcesses( n ) {}
+
+protected:
+  void solveSweepBlocks( std::vector<SweepBlock> & blocks,
+    std::vector< std::vector<long long> > & flows ) override
+    {
+    std::vector<pid_t> children;
+    std::vector<int> pipes;
+    for( int p = 0; p < nProcesses; p++ )
+      {
+      int fd[2];
+      if( pipe( fd ) != 0 )
+        {
+        break;
+        }
+      pid_t pid = fork();
+      if( pid < 0 )
+        {
+        close( fd[0] );
+        close( fd[1] );
+        break;
+        }
+      if( pid == 0 )
+        {
+        close( fd[0] );
+        for( long b = p; b < (long) blocks.size(); b += nProcesses )
+          {
+          std::vector<long long> flow;
+          if( !solveSweepBlock( blocks[b], flow ) )
+            {
+            flow.clear();
+            }
+          long n = flow.size();
+          if( !WriteAll( fd[1], &b, sizeof( long ) ) ||
+              !WriteAll( fd[1], &n, sizeof( long ) ) ||
+              !WriteAll( fd[1], flow.data(), n * sizeof( long long ) ) )
+            {
+            _exit( EXIT_FAILURE );
+            }
+          }
+        close( fd[1] );
+        _exit( EXIT_SUCCESS );
+        }
+      close( fd[1] );
+      children.push_back( pid );
+      pipes.push_back( fd[0] );
+      }
+
+    // the children block on a full pipe until it is read, reading the pipes
+    // in turn cannot deadlock
+    for( unsigned int p = 0; p < pipes.size(); p++ )
+      {
+      long b;
+      long n;
+      while( ReadAll( pipes[p], &b, sizeof( long ) ) )
+        {
+        if( !ReadAll( pipes[p], &n, sizeof( long ) ) || b < 0 || b >= (long) blocks.size() )
+          {
+          break;
+          }
+        flows[b].resize( n );
+        if( !ReadAll( pipes[p], flows[b].data(), n * sizeof( long long ) ) )
+          {
+          flows[b].clear();
+          break;
+          }
+        }
+      close( pipes[p] );
+      waitpid( children[p], nullptr, 0 );
+      }
+
+    // blocks of processes that could not be started are solved here
+    for( long b = 0; b < (long) blocks.size(); b++ )
+      {
+      if( b % nProcesses >= (long) children.size() && !solveSweepBlock( blocks[b], flows[b] ) )
+        {
+        flows[b].clear();
+        }
+      }
+    }
+
+private:
+  int nProcesses;
+};
+
+
+// Columns from each source to its nearest targets in a bipartite transport
+// problem with uniform masses, the sources and targets are sorted along x
+// so that a block of rows is a slab of the plane. The column from source i
+// to target i keeps every restriction feasible.
+class TransportProblem
+{
+public:
+  Eigen::MatrixXd X;
+  Eigen::MatrixXd Y;
+  std::vector< std::vector<long> > nearest;
+
+  TransportProblem( long n, long k )
+    {
+    X = SortedPoints( n );
+    Y = SortedPoints( n );
+    nearest.resize( n );
+    std::vector< std::pair<double, long> > d( n );
+    for( long i = 0; i < n; i++ )
+      {
+      for( long j = 0; j < n; j++ )
+        {
+        d[j] = std::make_pair( ( X.col( i ) - Y.col( j ) ).squaredNorm(), j );
+        }
+      std::partial_sort( d.begin(), d.begin() + k, d.end() );
+      nearest[i].push_back( i );
+      for( long j = 0; j < k; j++ )
+        {
+        if( d[j].second != i )
+          {
+          nearest[i].push_back( d[j].second );
+          }
+        }
+      }
+    }
+
+  // LP with the first k nearest targets of each source
+  void Setup( LemonSolver & lp, long k ) const
+    {
+    long n = X.cols();
+    lp.createLP( n, n );
+    lp.addRows( 2 * n );
+    for( long i = 0; i < n; i++ )
+      {
+      lp.setRowBounds( i, 1.0 / n );
+      lp.setRowBounds( n + i, -1.0 / n );
+      }
+    AddColumns( lp, 0, k );
+    }
+
+  // Adds the columns to the nearest targets from k0 to k1 to an LP that is
+  // set up with k0, the previous solution of lp is kept
+  void AddColumns( LemonSolver & lp, long k0, long k1 ) const
+    {
+    long n = X.cols();
+    long col = lp.getNumberOfColumns();
+    long m = 0;
+    for( long i = 0; i < n; i++ )
+      {
+      m += std::max( 0L, std::min( k1, (long) nearest[i].size() ) - k0 );
+      }
+    lp.addColumns( m );
+    for( long i = 0; i < n; i++ )
+      {
+      for( long j = k0; j < std::min( k1, (long) nearest[i].size() ); j++ )
+        {
+        long t = nearest[i][j];
+        lp.setColumnBounds( col, 0, 1 );
+        lp.setColumnObjective( col, ( X.col( i ) - Y.col( t ) ).squaredNorm() );
+        lp.setColumnCoefficients( col++, i, n + t );
+        }
+      }
+    }
+
+private:
+  static Eigen::MatrixXd SortedPoints( long n )
+    {
+    Eigen::MatrixXd P = ( Eigen::MatrixXd::Random( 2, n ).array() + 1 ) / 2;
+    std::vector<long> order( n );
+    for( long i = 0; i < n; i++ )
+      {
+      order[i] = i;
+      }
+    std::sort( order.begin(), order.end(),
+      [&P]( long a, long b ){ return P( 0, a ) < P( 0, b ); } );
+    Eigen::MatrixXd S( 2, n );
+    for( long i = 0; i < n; i++ )
+      {
+      S.col( i ) = P.col( order[i] );
+      }
+    return S;
+    }
+};
+
+
+// Solves the LP restricted to the nearest targets, adds the next nearest and
+// solves again from the previous solution. Returns the final objective.
+double WarmSolve( LemonSolver & lp, const TransportProblem & problem, int nSweeps,
+  double & seconds )
+{
+  problem.Setup( lp, 4 );
+  lp.setBlockSweeps( nSweeps );
+  lp.solveLP();
+  problem.AddColumns( lp, 4, 16 );
+  auto start = std::chrono::steady_clock::now();
+  lp.solveLP();
+  seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  return lp.getObjectiveValue();
+}
+
+} // namespace
+
+
+int main( int argc, char *argv[] )
+{
+  long nPoints = argc > 1 ? std::atol( argv[1] ) : 5000;
+  int nProcesses = argc > 2 ? std::atoi( argv[2] ) : 4;
+  int nSweeps = argc > 3 ? std::atoi( argv[3] ) : 2;
+
+  std::srand( 2019 );
+  TransportProblem problem( nPoints, 16 );
+
+  double forkedSeconds = 0;
+  ForkedLemonSolver forked( nProcesses );
+  double forkedObjective = WarmSolve( forked, problem, nSweeps, forkedSeconds );
+
+  double threadedSeconds = 0;
+  LemonSolver threaded;
+  double threadedObjective = WarmSolve( threaded, problem, nSweeps, threadedSeconds );
+
+  LemonSolver cold;
+  problem.Setup( cold, 16 );
+  auto start = std::chrono::steady_clock::now();
+  cold.solveLP();
+  double coldSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  double coldObjective = cold.getObjectiveValue();
+
+  std::cout << "forked sweeps:   " << forkedObjective << " in " << forkedSeconds << "s" << std::endl;
+  std::cout << "threaded sweeps: " << threadedObjective << " in " << threadedSeconds << "s" << std::endl;
+  std::cout << "cold solve:      " << coldObjective << " in " << coldSeconds << "s" << std::endl;
+
+  if( !forked.isOptimal() || !cold.isOptimal() ||
+      std::abs( forkedObjective - coldObjective ) > 1e-6 * std::abs( coldObjective ) ||
+      std::abs( threadedObjective - coldObjective ) > 1e-6 * std::abs( coldObjective ) )
+    {
+    std::cerr << "The block sweeps do not reach the optimum of the cold solve" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+#ifndef BALLTREE_H
+#define BALLTREE_H
+
+#include "GMRATree.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+
+
+//GMRANode subclass for the ball tree
+template <typename TPrecision>
+class BallNode : public GMRANodeBase<TPrecision>{
+  public:
+    typedef typename GMRANode<TPrecision>::NodeVector NodeVector;
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+
+  private:
+    std::vector<int> indices;
+    VectorXp center;
+    NodeVector children;
+
+
+  public:
+
+    BallNode(const VectorXp &mean, std::vector<int>::const_iterator begin,
+        std::vector<int>::const_iterator end) : indices(begin, end), center(mean){
+    };
+
+    virtual ~BallNode(){
+    };
+
+
+    void addChild(GMRANode<TPrecision> *node){
+      children.push_back(node);
+    };
+
+
+    virtual NodeVector &getChildren(){
+      return children;
+    };
+
+
+    virtual GMRANode<TPrecision> *findDescendant(const VectorXp &x ){
+      TPrecision dist = std::numeric_limits<TPrecision>::max();
+      GMRANode<TPrecision> *closest = NULL;
+      for(int i=0; i<children.size(); i++){
+        TPrecision tmp = (children[i]->getCenter() - x).squaredNorm();
+        if(tmp < dist){
+          dist = tmp;
+          closest = children[i];
+        }
+      }
+      return closest;
+    };
+
+
+    std::vector<int> &getPoints(){
+      return indices;
+    };
+
+
+    int getIntrinsicDimension(){
+      return center.size();
+    };
+
+
+    VectorXp &getCenter(){
+      return center;
+    };
+
+
+    virtual void translate(VectorXp &x){
+      center += x;
+    };
+
+
+    virtual void affine(MatrixXp &A){
+      center = A*center;
+    };
+
+};
+
+
+
+
+//Ball tree with deterministic O(n log n) construction. Each scale splits the
+//points of a node at the median of the widest coordinate, repeated
+//log2(nKids) times, so a node has at most nKids kids and the number of
+//points at least halves per median split. Nodes stop splitting with at most
+//minPoints points or a radius below epsilon times the root radius.
+//
+//Fewer kids give more scales, for the multiscale transport solver 4 kids in
+//low dimensions are a good tradeoff between the number of scales and the size
+//of the finer scales.
+//
+//The tree sets scale, radius, local radius and mass (number of points) of all
+//nodes while building, no computeStatistics pass is needed for Euclidean
+//center distances. The radius is the maximal distance of the node center to
+//its points, which bounds the distance to the leaf centers.
+template <typename TPrecision>
+class BallTree : public GMRATree<TPrecision>{
+
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+    int nKids;
+    int minPoints;
+    TPrecision epsilon;
+
+
+  private:
+
+    MatrixXp X;
+    std::vector<int> perm;
+    TPrecision rootRadius;
+
+
+    struct Range{
+      long begin;
+      long end;
+      Range(long b, long e) : begin(b), end(e){};
+    };
+
+
+    BallNode<TPrecision> *createNode(Range r, int scale){
+      VectorXp mean = VectorXp::Zero( X.rows() );
+      for(long i=r.begin; i<r.end; i++){
+        mean += X.col( perm[i] );
+      }
+      mean /= r.end - r.begin;
+
+      TPrecision radius = 0;
+      for(long i=r.begin; i<r.end; i++){
+        radius = std::max( radius, (X.col( perm[i] ) - mean).squaredNorm() );
+      }
+
+      BallNode<TPrecision> *node = new BallNode<TPrecision>(mean,
+          perm.begin() + r.begin, perm.begin() + r.end);
+      node->setScale(scale);
+      node->setRadius( sqrt(radius) );
+      node->setLocalRadius(0);
+      node->setMass( r.end - r.begin );
+      return node;
+    };
+
+
+
+    //Median split along the coordinate with the largest range, returns false
+    //if all points are equal
+    bool split(Range r, std::vector<Range> &parts){
+      if(r.end - r.begin < 2){
+        parts.push_back(r);
+        return false;
+      }
+
+      VectorXp lo = X.col( perm[r.begin] );
+      VectorXp hi = lo;
+      for(long i=r.begin+1; i<r.end; i++){
+        lo = lo.cwiseMin( X.col( perm[i] ) );
+        hi = hi.cwiseMax( X.col( perm[i] ) );
+      }
+      int dim;
+      if( (hi - lo).maxCoeff(&dim) <= 0 ){
+        parts.push_back(r);
+        return false;
+      }
+
+      long mid = r.begin + (r.end - r.begin) / 2;
+      const MatrixXp &data = X;
+      std::nth_element( perm.begin() + r.begin, perm.begin() + mid,
+          perm.begin() + r.end, [&data, dim](int a, int b){
+            return data(dim, a) < data(dim, b);
+          } );
+      parts.push_back( Range(r.begin, mid) );
+      parts.push_back( Range(mid, r.end) );
+      return true;
+    };
+
+
+
+    void buildKids(BallNode<TPrecision> *node, Range r,
+        std::vector<BallNode<TPrecision> *> &kids, std::vector<Range> &kidRanges){
+
+      if( r.end - r.begin <= std::max(1, minPoints) ||
+          node->getRadius() <= epsilon * rootRadius ){
+        return;
+      }
+
+      std::vector<Range> parts(1, r);
+      for(int n = 2; n <= std::max(2, nKids); n *= 2){
+        std::vector<Range> next;
+        bool splitAny = false;
+        for(int i=0; i<parts.size(); i++){
+          splitAny |= split(parts[i], next);
+        }
+        parts.swap(next);
+        if(!splitAny){
+          break;
+        }
+      }
+      if(parts.size() < 2){
+        return;
+      }
+
+      for(int i=0; i<parts.size(); i++){
+        BallNode<TPrecision> *kid = createNode( parts[i], node->getScale()+1 );
+        kid->setParent(node);
+        node->addChild(kid);
+        node->setLocalRadius( std::max( node->getLocalRadius(),
+              (kid->getCenter() - node->getCenter()).norm() ) );
+        kids.push_back(kid);
+        kidRanges.push_back( parts[i] );
+      }
+    };
+
+
+
+  public:
+
+    BallTree(GMRADataObject<TPrecision> *D) : GMRATree<TPrecision>(D){
+      nKids = 4;
+      minPoints = 1;
+      epsilon = 0;
+    };
+
+
+    virtual ~BallTree(){
+    };
+
+
+
+    //Builds the tree on the points, an existing tree is rebuilt on all points
+    void addPoints(std::vector<int> &pts){
+
+      GMRANode<TPrecision> *root = this->getRoot();
+      if(root != NULL){
+        std::vector<int> &ppts = root->getPoints();
+        pts.insert(pts.end(), ppts.begin(), ppts.end() );
+        DeleteVisitor<TPrecision> del;
+        this->depthFirstVisitor(&del);
+        this->setRoot(NULL);
+      }
+      if( pts.empty() ){
+        return;
+      }
+
+      GMRADataObject<TPrecision> *data = this->getDataObject();
+      X.resize( data->dimension(), pts.size() );
+      perm.resize( pts.size() );
+      for(int i=0; i<pts.size(); i++){
+        X.col(i) = data->getPoint( pts[i] );
+        perm[i] = i;
+      }
+
+      //build by scale, nodes of a scale cover disjoint ranges of perm
+      BallNode<TPrecision> *node = createNode( Range(0, pts.size()), 0 );
+      rootRadius = node->getRadius();
+      std::vector<BallNode<TPrecision> *> nodes(1, node);
+      std::vector<Range> ranges(1, Range(0, pts.size()) );
+      int scale = 0;
+      while( !nodes.empty() ){
+        std::vector< std::vector<BallNode<TPrecision> *> > kids( nodes.size() );
+        std::vector< std::vector<Range> > kidRanges( nodes.size() );
+        Parallel::forBlocks(nodes.size(), 1, [&](int t, long begin, long end){
+            for(long i=begin; i<end; i++){
+              buildKids(nodes[i], ranges[i], kids[i], kidRanges[i]);
+            }
+        } );
+
+        std::vector<BallNode<TPrecision> *> next;
+        std::vector<Range> nextRanges;
+        for(int i=0; i<nodes.size(); i++){
+          next.insert( next.end(), kids[i].begin(), kids[i].end() );
+          nextRanges.insert( nextRanges.end(), kidRanges[i].begin(), kidRanges[i].end() );
+        }
+        if( !next.empty() ){
+          scale++;
+        }
+        nodes.swap(next);
+        ranges.swap(nextRanges);
+      }
+
+      //node point lists refer to the local copy
+      class Reindex : public Visitor<TPrecision>{
+        public:
+          std::vector<int> &pts;
+          Reindex(std::vector<int> &p) : pts(p){};
+          void visit(GMRANode<TPrecision> *node){
+            std::vector<int> &np = node->getPoints();
+            for(int i=0; i<np.size(); i++){
+              np[i] = pts[ np[i] ];
+            }
+          };
+      };
+      Reindex reindex(pts);
+      GMRATree<TPrecision>::depthFirst(&reindex, node);
+
+      X.resize(0, 0);
+      perm.clear();
+
+      this->setRoot(node);
+      this->setMaxScale(scale);
+    };
+
+
+
+    std::vector<GMRANode<TPrecision> *> getLeafPath(const VectorXp &x ) {
+      GMRANode<TPrecision> *node = this->getRoot();
+      std::vector<GMRANode<TPrecision> *> path;
+      while(node != NULL ){
+        path.push_back( node );
+        node = node->findDescendant( x );
+      }
+      return path;
+    };
+
+};
+
+
+#endif
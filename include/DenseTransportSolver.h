@@ -0,0 +1,412 @@
+#ifndef DENSETRANSPORTSOLVER_H
+#define DENSETRANSPORTSOLVER_H
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+
+//Transport between the masses a and b with a dense cost matrix C, for small
+//problems on which building a graph for the network simplex costs more than
+//solving. The masses of b are rescaled to the total of a.
+//
+//The general case is solved with the transportation simplex. The basis is
+//a spanning tree of the rows and columns, it starts from the row minimum
+//rule. Entering cells are found by block search over the rows, each row
+//scanned at once on the contiguous row major cost matrix. For equal numbers
+//of sources and targets with equal uniform masses the problem is an
+//assignment and is solved with the Hungarian method.
+//
+//The potentials u, v satisfy C(i, j) - u(i) - v(j) >= 0 with equality on
+//the cells with flow.
+template <typename TPrecision>
+class DenseTransportSolver{
+
+  public:
+    typedef Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXp;
+    typedef Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
+    typedef Eigen::Matrix<TPrecision, 1, Eigen::Dynamic> RowVectorXp;
+
+
+  private:
+
+    MatrixXp X;
+    VectorXp u;
+    RowVectorXp v;
+    TPrecision cost;
+    long nPivots;
+
+    //basic cells, vertices of the tree are the rows 0..ns-1 and the columns
+    //ns..ns+nt-1
+    std::vector<int> cellRow;
+    std::vector<int> cellCol;
+    std::vector<TPrecision> cellFlow;
+    std::vector< std::vector<int> > adjacent;
+
+    //the tree rooted at row 0
+    std::vector<int> parentVertex;
+    std::vector<int> parentCell;
+    std::vector<int> depth;
+    std::vector<int> queue;
+    std::vector<int> path;
+    std::vector<int> pathA;
+
+
+
+    static bool isUniform(const VectorXp &a, TPrecision value){
+      TPrecision tol = 1e-9 * value;
+      return std::abs( a.maxCoeff() - value ) <= tol &&
+             std::abs( a.minCoeff() - value ) <= tol;
+    };
+
+
+
+    void addCell(int i, int j, TPrecision flow){
+      int c = cellRow.size();
+      cellRow.push_back(i);
+      cellCol.push_back(j);
+      cellFlow.push_back(flow);
+      adjacent[i].push_back(c);
+      adjacent[u.size() + j].push_back(c);
+    };
+
+
+    void removeAdjacent(int vertex, int c){
+      std::vector<int> &cells = adjacent[vertex];
+      std::vector<int>::iterator it = std::find(cells.begin(), cells.end(), c);
+      *it = cells.back();
+      cells.pop_back();
+    };
+
+
+
+    //Row minimum rule, each allocation crosses out one row or column, the
+    //last both, so the ns+nt-1 cells form a spanning tree
+    void initialBasis(const VectorXp &a, const VectorXp &b, const MatrixXp &C){
+      int ns = a.size();
+      int nt = b.size();
+      std::vector<TPrecision> demand( b.data(), b.data() + nt );
+      RowVectorXp closed = RowVectorXp::Zero(nt);
+      int nOpen = nt;
+      for(int i=0; i<ns; i++){
+        TPrecision supply = a(i);
+        while(nOpen > 0){
+          int j;
+          (C.row(i) + closed).minCoeff(&j);
+          if(i == ns-1){
+            addCell(i, j, std::max( (TPrecision) 0, demand[j] ) );
+            closed(j) = std::numeric_limits<TPrecision>::infinity();
+            nOpen--;
+            continue;
+          }
+          if( supply <= demand[j] || nOpen == 1 ){
+            addCell(i, j, std::max( (TPrecision) 0, supply ) );
+            demand[j] -= supply;
+            break;
+          }
+          addCell(i, j, std::max( (TPrecision) 0, demand[j] ) );
+          supply -= demand[j];
+          closed(j) = std::numeric_limits<TPrecision>::infinity();
+          nOpen--;
+        }
+      }
+    };
+
+
+
+    //Parents, depths and potentials of the vertices in the subtree hanging
+    //from vertex, whose parent has to be set
+    void hang(const MatrixXp &C, int vertex){
+      int ns = u.size();
+      queue.clear();
+      queue.push_back(vertex);
+      for(int k=0; k<queue.size(); k++){
+        int x = queue[k];
+        if( parentCell[x] >= 0 ){
+          int c = parentCell[x];
+          if(x < ns){
+            u(x) = C(x, cellCol[c]) - v( cellCol[c] );
+          }
+          else{
+            v(x-ns) = C(cellRow[c], x-ns) - u( cellRow[c] );
+          }
+        }
+        std::vector<int> &cells = adjacent[x];
+        for(int l=0; l<cells.size(); l++){
+          int c = cells[l];
+          int y = x < ns ? ns + cellCol[c] : cellRow[c];
+          if( y != parentVertex[x] ){
+            parentVertex[y] = x;
+            parentCell[y] = c;
+            depth[y] = depth[x] + 1;
+            queue.push_back(y);
+          }
+        }
+      }
+    };
+
+
+
+    //Block search for a cell with negative reduced cost, returns false if
+    //there is none
+    bool findEntering(const MatrixXp &C, TPrecision tol, int &row, int &iEnter,
+        int &jEnter){
+      int ns = C.rows();
+      int blockRows = std::max(1, (int) std::sqrt( (double) ns ) );
+      TPrecision best = -tol;
+      bool found = false;
+      for(int k=0; k<ns; k++){
+        int i = row;
+        row = (row + 1) % ns;
+        TPrecision rc = (C.row(i) - v).minCoeff() - u(i);
+        if( rc < best ){
+          best = rc;
+          iEnter = i;
+          found = true;
+        }
+        if( found && (k+1) % blockRows == 0 ){
+          break;
+        }
+      }
+      if(found){
+        (C.row(iEnter) - v).minCoeff(&jEnter);
+      }
+      return found;
+    };
+
+
+
+    //Adds the cell (i, j) to the basis and removes the cell on the cycle it
+    //closes whose flow limits the change
+    void pivot(const MatrixXp &C, int i, int j){
+      int ns = u.size();
+
+      //cycle through the lowest common ancestor, walking from column j the
+      //cells alternately lose and gain flow
+      std::vector<int> &pathB = path;
+      pathA.clear();
+      pathB.clear();
+      int a = i;
+      int b = ns + j;
+      while(a != b){
+        if( depth[a] >= depth[b] ){
+          pathA.push_back( parentCell[a] );
+          a = parentVertex[a];
+        }
+        else{
+          pathB.push_back( parentCell[b] );
+          b = parentVertex[b];
+        }
+      }
+      int nB = pathB.size();
+      pathB.insert( pathB.end(), pathA.rbegin(), pathA.rend() );
+
+      int leaving = -1;
+      int leavingIndex = -1;
+      TPrecision theta = std::numeric_limits<TPrecision>::max();
+      for(int k=0; k<path.size(); k+=2){
+        if( cellFlow[ path[k] ] < theta ){
+          theta = cellFlow[ path[k] ];
+          leaving = path[k];
+          leavingIndex = k;
+        }
+      }
+      theta = std::max( (TPrecision) 0, theta );
+      for(int k=0; k<path.size(); k++){
+        if(k % 2 == 0){
+          cellFlow[ path[k] ] = std::max( (TPrecision) 0, cellFlow[ path[k] ] - theta );
+        }
+        else{
+          cellFlow[ path[k] ] += theta;
+        }
+      }
+
+      //the endpoint of the entering cell below the leaving cell roots the
+      //cut off subtree
+      int cut = leavingIndex < nB ? ns + j : i;
+      int anchor = leavingIndex < nB ? i : ns + j;
+
+      removeAdjacent( cellRow[leaving], leaving );
+      removeAdjacent( ns + cellCol[leaving], leaving );
+      cellRow[leaving] = i;
+      cellCol[leaving] = j;
+      cellFlow[leaving] = theta;
+      adjacent[i].push_back(leaving);
+      adjacent[ns+j].push_back(leaving);
+
+      parentVertex[cut] = anchor;
+      parentCell[cut] = leaving;
+      depth[cut] = depth[anchor] + 1;
+      hang(C, cut);
+    };
+
+
+
+    bool simplex(const VectorXp &a, const VectorXp &b, const MatrixXp &C,
+        long maxPivots){
+      int ns = a.size();
+      int nt = b.size();
+      cellRow.clear();
+      cellCol.clear();
+      cellFlow.clear();
+      adjacent.assign( ns + nt, std::vector<int>() );
+
+      initialBasis(a, b, C);
+      parentVertex.assign( ns + nt, -1 );
+      parentCell.assign( ns + nt, -1 );
+      depth.assign( ns + nt, 0 );
+      u(0) = 0;
+      hang(C, 0);
+
+      TPrecision tol = 1e-12 * C.cwiseAbs().maxCoeff();
+      int row = 0;
+      int i = 0;
+      int j = 0;
+      bool optimal = false;
+      while( nPivots < maxPivots ){
+        if( !findEntering(C, tol, row, i, j) ){
+          optimal = true;
+          break;
+        }
+        pivot(C, i, j);
+        nPivots++;
+      }
+
+      for(int c=0; c<cellRow.size(); c++){
+        X( cellRow[c], cellCol[c] ) += cellFlow[c];
+      }
+      return optimal;
+    };
+
+
+
+    //Hungarian method with potentials, see e.g. Burkard, Dell'Amico and
+    //Martello, Assignment Problems, 4.4
+    void assignment(const MatrixXp &C, TPrecision mass){
+      int n = C.rows();
+      TPrecision inf = std::numeric_limits<TPrecision>::infinity();
+      std::vector<TPrecision> U(n+1, 0);
+      std::vector<TPrecision> V(n+1, 0);
+      std::vector<TPrecision> minV(n+1);
+      std::vector<int> P(n+1, 0);
+      std::vector<int> way(n+1, 0);
+      std::vector<char> used(n+1);
+      for(int i=1; i<=n; i++){
+        P[0] = i;
+        int j0 = 0;
+        std::fill( minV.begin(), minV.end(), inf );
+        std::fill( used.begin(), used.end(), 0 );
+        do{
+          used[j0] = 1;
+          int i0 = P[j0];
+          const TPrecision *Crow = C.data() + (long) (i0-1) * n;
+          TPrecision delta = inf;
+          int j1 = 0;
+          for(int j=1; j<=n; j++){
+            if( !used[j] ){
+              TPrecision cur = Crow[j-1] - U[i0] - V[j];
+              if( cur < minV[j] ){
+                minV[j] = cur;
+                way[j] = j0;
+              }
+              if( minV[j] < delta ){
+                delta = minV[j];
+                j1 = j;
+              }
+            }
+          }
+          for(int j=0; j<=n; j++){
+            if( used[j] ){
+              U[ P[j] ] += delta;
+              V[j] -= delta;
+            }
+            else{
+              minV[j] -= delta;
+            }
+          }
+          j0 = j1;
+          nPivots++;
+        } while( P[j0] != 0 );
+        do{
+          int j1 = way[j0];
+          P[j0] = P[j1];
+          j0 = j1;
+        } while( j0 != 0 );
+      }
+
+      for(int j=1; j<=n; j++){
+        X( P[j]-1, j-1 ) = mass;
+      }
+      for(int i=0; i<n; i++){
+        u(i) = U[i+1];
+        v(i) = V[i+1];
+      }
+    };
+
+
+
+  public:
+
+    DenseTransportSolver() : cost(0), nPivots(0){
+    };
+
+
+
+    //Solves for the transport plan, returns false if the simplex stopped
+    //after maxPivots pivots, the plan is then feasible but not optimal
+    bool solve(const VectorXp &a, const VectorXp &bIn, const MatrixXp &C,
+        long maxPivots = std::numeric_limits<long>::max() ){
+      int ns = a.size();
+      int nt = bIn.size();
+      X = MatrixXp::Zero(ns, nt);
+      u = VectorXp::Zero(ns);
+      v = RowVectorXp::Zero(nt);
+      cost = 0;
+      nPivots = 0;
+      if(ns == 0 || nt == 0){
+        return true;
+      }
+
+      VectorXp b = bIn * ( a.sum() / bIn.sum() );
+      bool optimal = true;
+      if( ns == nt && isUniform(a, a(0) ) && isUniform(b, a(0) ) ){
+        assignment(C, a(0) );
+      }
+      else{
+        optimal = simplex(a, b, C, maxPivots);
+      }
+      cost = ( X.array() * C.array() ).sum();
+      return optimal;
+    };
+
+
+
+    //Transport plan, rows are the sources
+    MatrixXp &getPlan(){
+      return X;
+    };
+
+    VectorXp &getSourcePotentials(){
+      return u;
+    };
+
+    RowVectorXp &getTargetPotentials(){
+      return v;
+    };
+
+    TPrecision getCost(){
+      return cost;
+    };
+
+    long getPivotCount(){
+      return nPivots;
+    };
+
+};
+
+
+#endif
@@ -5,6 +5,8 @@
 #include "EigenRandomRange.h"
 #include <Eigen/QR>
 
+#include <random>
+
 namespace EigenLinalg{
   
 template<typename TPrecision>
@@ -71,5 +73,67 @@ class RowStreamingRandomRange : public RandomRange<TPrecision>{
 
 
 
+
+//Range of a matrix X streamed by columns, Y = X N for a Gaussian N that is
+//generated column by column. Memory is independent of the number of columns.
+//Sketches of disjoint sets of columns can be merged, each set needs its own
+//seed.
+template<typename TPrecision>
+class ColumnStreamingRandomRange{
+
+  public:
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
+
+
+  private:
+    MatrixXp Y;
+    VectorXp nSum;
+    VectorXp n;
+    std::mt19937_64 generator;
+    std::normal_distribution<TPrecision> normal;
+
+  public:
+
+    ColumnStreamingRandomRange(int m, int d){
+      Y = MatrixXp::Zero(m, d);
+      nSum = VectorXp::Zero(d);
+      n = VectorXp(d);
+    };
+
+
+    void Seed(unsigned long seed){
+      generator.seed(seed);
+      normal.reset();
+    };
+
+
+    void Add(const VectorXp &x){
+      for(int i=0; i<n.size(); i++){
+        n(i) = normal(generator);
+      }
+      Y.noalias() += x * n.transpose();
+      nSum += n;
+    };
+
+
+    void Merge(const ColumnStreamingRandomRange<TPrecision> &other){
+      Y += other.Y;
+      nSum += other.nSum;
+    };
+
+
+    //Orthonormal basis for the range of X - mean 1^T
+    MatrixXp GetRange(const VectorXp &mean){
+      using namespace Eigen;
+      MatrixXp Yc = Y - mean * nSum.transpose();
+      HouseholderQR<MatrixXp> qr(Yc);
+      return qr.householderQ() * MatrixXp::Identity( Yc.rows(), Yc.cols() );
+    };
+
+};
+
+
+
 }
 #endif 
@@ -5,6 +5,7 @@
 #include "TransportLPSolver.h"
 #include "LPSolver.h"
 
+#include <chrono>
 #include <list>
 #include <map>
 #include <set>
@@ -25,11 +26,31 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
     typedef typename TransportPlan<TPrecision>::Path Path;
 
 
+    //Summary of the last solveNeighborhoodLP
+    struct Statistics{
+      int nIterations;
+      long nAdded;
+      TPrecision initialObjective;
+      TPrecision objective;
+      //relative objective decrease of the last batch of paths
+      TPrecision lastImprovement;
+      //wall clock time
+      double seconds;
+      //stopped since no paths were added or the objective did not decrease
+      bool converged;
+      //stopped by the minimum improvement rate
+      bool slow;
+    };
+
+
   private:
     TPrecision expansionFactor;
     TPrecision expansionTolerance;
     int nRefinementIterations;
     int nExpansionAdd;
+    TPrecision minImprovementRate;
+
+    Statistics stats;
 
   public:
 
@@ -37,12 +58,52 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
     ExpandNeighborhoodStrategy( TPrecision rFactor, TPrecision eTolerance, int
         nIters, int nAdd=1000000) : expansionFactor(rFactor),
     expansionTolerance(eTolerance), nRefinementIterations(nIters),
-    nExpansionAdd(nAdd)  { };
+    nExpansionAdd(nAdd), minImprovementRate(0)  {
+      stats = Statistics();
+    };
 
     virtual ~ExpandNeighborhoodStrategy(){
     };
 
 
+    void setExpansionFactor(TPrecision rFactor){
+      expansionFactor = rFactor;
+    };
+
+    TPrecision getExpansionFactor(){
+      return expansionFactor;
+    };
+
+    void setNumberOfRefinementIterations(int nIters){
+      nRefinementIterations = nIters;
+    };
+
+    int getNumberOfRefinementIterations(){
+      return nRefinementIterations;
+    };
+
+    void setNumberOfExpansionAdd(int nAdd){
+      nExpansionAdd = nAdd;
+    };
+
+    int getNumberOfExpansionAdd(){
+      return nExpansionAdd;
+    };
+
+
+    //Stop the expansion once a batch of paths decreases the objective by
+    //less than rate relative to it per second of wall clock time, 0
+    //(default) to disable
+    void setMinImprovementRate(TPrecision rate){
+      minImprovementRate = rate;
+    };
+
+
+    Statistics &getStatistics(){
+      return stats;
+    };
+
+
 
 
     TransportPlan<TPrecision> *solveNeighborhoodLP(MultiscaleTransportLevel<TPrecision> *source,
@@ -57,8 +118,14 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
 
       TPrecision prevCost = 0;
 
-      while(outerAdded != 0 && nIter != 0){
+      std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+      stats = Statistics();
+      stats.initialObjective = solver->getObjectiveValue();
+      stats.objective = stats.initialObjective;
+
+      while(outerAdded != 0 && nIter != 0 && !stats.slow){
         nIter--;
+        stats.nIterations++;
 #ifdef VERBOSE
         std::cout << std::endl << "--- Expand strategy ---" << std::endl;
 #endif
@@ -70,6 +137,7 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
         getNeighborhodArcs(sol, expandPaths, neighborhoodPaths, p,
             expansionFactor);
         outerAdded = neighborhoodPaths.getNumberOfPaths();
+        stats.nAdded += outerAdded;
         neighborhoodPaths.pathIteratorBegin();
 
         clock_t t2 = clock();
@@ -81,6 +149,7 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
           prevCost = sol->cost;
 
           clock_t t3 = clock();
+          std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
           addColumns(solver, sol, neighborhoodPaths, nExpansionAdd );
           clock_t t4 = clock();
           sol->timeRefine += t4 -t3;
@@ -93,6 +162,17 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
           clock_t t5 = clock();
           sol->timeSolve += t5 - t4;
 
+          TPrecision objective = stats.objective;
+          stats.objective = sol->cost;
+          stats.lastImprovement = objective > 0 ? (objective - sol->cost) / objective : 0;
+          double seconds = std::chrono::duration<double>(
+              std::chrono::steady_clock::now() - batchStart ).count();
+          if( minImprovementRate > 0 &&
+              stats.lastImprovement < minImprovementRate * seconds ){
+            stats.slow = true;
+            break;
+          }
+
           if(prevCost - sol->cost <= expansionTolerance * prevCost ){
             break;
           }
@@ -102,6 +182,11 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
 
       }
 
+      stats.converged = outerAdded == 0 || ( !stats.slow &&
+          stats.lastImprovement <= expansionTolerance );
+      stats.seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - tStart ).count();
+
       return sol;
 
     };
@@ -118,7 +203,10 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
         TransportPlan<TPrecision> *expand, TransportPlan<TPrecision>
         &neighborhoodPaths, double p, TPrecision rFactor){
 
-      typename std::list< std::pair<Path, TPrecision> > toAdd;
+      //neighborhoods of the endpoints of the active paths, one batch per level
+      TransportNodeVector from;
+      TransportNodeVector to;
+      std::vector<TPrecision> radii;
       for(expand->pathIteratorBegin(); !expand->pathIteratorIsAtEnd();
           expand->pathIteratorNext()){
 
@@ -135,27 +223,41 @@ class ExpandNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
           TPrecision r = (rTo + rFrom) * rFactor;
           //r = powf(r, p);
 
-          TransportNodeVector f1N = expand->source->getNeighborhood(f1, r);
-          //TransportNodeVector f1N = sol->source->getNeighborhood(f1, powf(rFrom*rFactor, p));
-          TransportNodeVector t1N = expand->target->getNeighborhood(t1, r);
-          //TransportNodeVector t1N = sol->target->getNeighborhood(t1, powf(rTo *
-          //      rFactor, p) );
-
-          for(TransportNodeVectorCIterator fIt = f1N.begin(); fIt !=
-              f1N.end(); ++fIt){
-
-            for(TransportNodeVectorCIterator tIt = t1N.begin(); tIt !=
-                t1N.end(); ++tIt){
-              TransportNode<TPrecision> *f2 = *fIt;
-              TransportNode<TPrecision> *t2 = *tIt;
-              Path p2(f2, t2);
-
-              if( !sol->hasPath(p2) && !neighborhoodPaths.hasPath(p2) ){
-                p2.cost = p2.from->getTransportCost(p2.to, p);
-                TPrecision rc = p2.cost - p2.from->getPotential() + p2.to->getPotential();
-                if(rc <= 0){
-                  neighborhoodPaths.addPath( p2 );
-                }
+          from.push_back(f1);
+          to.push_back(t1);
+          radii.push_back(r);
+        }
+      }
+
+      std::vector<TransportNodeVector> fN = expand->source->getNeighborhoods(from, radii);
+      std::vector<TransportNodeVector> tN = expand->target->getNeighborhoods(to, radii);
+      TransportCostCache<TPrecision> *cache =
+        expand->source->getTransportCostCache(expand->target, p);
+
+      for(int i=0; i<from.size(); i++){
+        TransportNodeVector &f1N = fN[i];
+        TransportNodeVector &t1N = tN[i];
+
+        for(TransportNodeVectorCIterator fIt = f1N.begin(); fIt !=
+            f1N.end(); ++fIt){
+
+          for(TransportNodeVectorCIterator tIt = t1N.begin(); tIt !=
+              t1N.end(); ++tIt){
+            TransportNode<TPrecision> *f2 = *fIt;
+            TransportNode<TPrecision> *t2 = *tIt;
+            Path p2(f2, t2);
+
+            if( !sol->hasPath(p2) && !neighborhoodPaths.hasPath(p2) ){
+              //exact costs only for arcs the lower bound does not rule out
+              TPrecision delta = p2.from->getPotential() - p2.to->getPotential();
+              if( expand->source->getTransportCostLowerBound(p2.from, expand->target,
+                    p2.to, p, cache) - delta > 0 ){
+                continue;
+              }
+              p2.cost = expand->source->getTransportCost(p2.from, expand->target, p2.to, p, cache);
+              TPrecision rc = p2.cost - delta;
+              if(rc <= 0){
+                neighborhoodPaths.addPath( p2 );
               }
             }
           }
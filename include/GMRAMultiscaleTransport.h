@@ -5,6 +5,12 @@
 #include "GMRATree.h"
 #include "NodeDistance.h"
 #include "GMRANeighborhood.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <stdint.h>
 
 //#include "boost/functional.hpp"
 
@@ -176,6 +182,21 @@ class GMRATransportNode : public GMRATransportNodeBase<TPrecision>{
        return pow( this->dist->distance( n1->getDecoratedNode(), n2->getDecoratedNode() ), p );
     };
 
+
+    virtual bool hasTransportCostLowerBound() const{
+      return this->dist->hasLowerBound();
+    };
+
+
+    virtual TPrecision getTransportCostLowerBound(const TransportNode<TPrecision> *other, double p) const{
+       const GMRATransportNode<TPrecision> *o = dynamic_cast<
+         const GMRATransportNode<TPrecision>* >(other);
+
+       GMRATransportNodeDecorator<TPrecision> *n1 = this->getGMRANode();
+       GMRATransportNodeDecorator<TPrecision> *n2 = o->getGMRANode();
+       return pow( this->dist->lowerBound( n1->getDecoratedNode(), n2->getDecoratedNode() ), p );
+    };
+
 };
 
 
@@ -293,6 +314,8 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
     typedef typename TransportNodeVector::iterator TransportNodeVectorIterator;
     typedef typename GMRANeighborhood<TPrecision>::NeighborList NeighborList;
     typedef typename NeighborList::iterator NeighborListIterator;
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
 
 
 
@@ -303,6 +326,18 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
     NodeDistance<TPrecision> *dist;
     int scale;
 
+    //Cached neighborhoods in CSR form, the row of the node with id i is
+    //adjacency[rowStart[i], rowEnd[i]) sorted by distance and complete up to
+    //rowRadius[i]. Rows for larger radii are appended and replace the old
+    //row, stale entries are dropped when they outnumber the live ones.
+    mutable std::mutex cacheMutex;
+    mutable std::vector< TransportNode<TPrecision> * > adjacency;
+    mutable std::vector<TPrecision> adjacencyDist;
+    mutable std::vector<long> rowStart;
+    mutable std::vector<long> rowEnd;
+    mutable std::vector<TPrecision> rowRadius;
+    mutable long nLive;
+
 
 
 
@@ -315,6 +350,7 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
 
         scale = s;
         dist = nh.getNodeDistance();
+        nLive = 0;
 
       };
 
@@ -322,47 +358,180 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
 
 
 
+    //Nodes within eps of node, sorted by distance. Repeated queries for a
+    //node of this level at the same or a smaller radius are answered from the
+    //cache.
     virtual TransportNodeVector getNeighborhood(TransportNode<TPrecision> *node, TPrecision eps) const{
+      TransportNodeVector neighbors;
+      if( getCached(node, eps, neighbors) ){
+        return neighbors;
+      }
+
       GMRATransportNodeBase<TPrecision> *n =
         dynamic_cast<GMRATransportNodeBase<TPrecision> *>( node );
       GMRATransportNodeDecorator<TPrecision> *tNode = n->getGMRANode();
-      //GMRANode<TPrecision> *gNode = tNode->getDecoratedNode();
     
-       
       NeighborList gnodes;
-      int nn = neighborhood.neighbors( tNode, eps, gnodes, scale );
-     
-      TransportNodeVector neighbors;
-      neighbors.reserve(nn);
-      for(NeighborListIterator it = gnodes.begin(); it != gnodes.end(); ++it){
-        GMRATransportNodeDecorator<TPrecision> *tNode =
-          dynamic_cast< GMRATransportNodeDecorator<TPrecision> *>( it->second );
-        neighbors.push_back( tNode->nodemap[scale] );
+      neighborhood.neighbors( tNode, eps, gnodes, scale );
+      storeRow(node, eps, gnodes, neighbors);
+      return neighbors;
+
+    };
+
+
+
+    //Neighborhoods of several nodes, queries not in the cache are passed to
+    //the neighborhood in a single batch
+    virtual std::vector<TransportNodeVector> getNeighborhoods(const TransportNodeVector &query,
+        const std::vector<TPrecision> &eps) const{
+
+      std::vector<TransportNodeVector> neighbors( query.size() );
+      std::vector<int> missing;
+      std::vector< GMRANode<TPrecision> * > gQuery;
+      std::vector<TPrecision> gEps;
+      for(int i=0; i<query.size(); i++){
+        if( !getCached(query[i], eps[i], neighbors[i]) ){
+          GMRATransportNodeBase<TPrecision> *n =
+            dynamic_cast<GMRATransportNodeBase<TPrecision> *>( query[i] );
+          missing.push_back(i);
+          gQuery.push_back( n->getGMRANode() );
+          gEps.push_back( eps[i] );
+        }
+      }
+
+      std::vector<NeighborList> gnodes;
+      neighborhood.batchNeighbors( gQuery, gEps, gnodes, scale );
+      for(int i=0; i<missing.size(); i++){
+        int index = missing[i];
+        storeRow( query[index], eps[index], gnodes[i], neighbors[index] );
       }
       return neighbors;
+    };
+
+
+
+    //Drops the cached neighborhoods, needed if nodes of the level or the
+    //tree changed
+    void clearNeighborhoodCache(){
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      adjacency.clear();
+      adjacencyDist.clear();
+      rowStart.clear();
+      rowEnd.clear();
+      rowRadius.clear();
+      nLive = 0;
+    };
+
+
+
+    virtual void reorderNodes(const std::vector<int> &order){
+      MultiscaleTransportLevel<TPrecision>::reorderNodes(order);
+      clearNeighborhoodCache();
+    };
+
+
+
+    //Renumbers the nodes along a Hilbert curve through the centers of their
+    //tree nodes, so nearby nodes get nearby ids and the rows and columns of
+    //the transport problems touch fewer cache lines. Returns the old id of
+    //each new id. Above 8 dimensions the curve runs through the 8
+    //coordinates with the largest extent. Plans on the old ids are invalid.
+    std::vector<int> sortNodes(){
+      TransportNodeVector &nodes = this->getNodes();
+      std::vector<int> order( nodes.size() );
+      for(int i=0; i<order.size(); i++){
+        order[i] = i;
+      }
+      if( nodes.size() < 3 ){
+        return order;
+      }
+
+      MatrixXp X( getGMRACenter( nodes[0] ).size(), nodes.size() );
+      for(int i=0; i<nodes.size(); i++){
+        X.col(i) = getGMRACenter( nodes[i] );
+      }
+      VectorXp lo = X.rowwise().minCoeff();
+      VectorXp extent = X.rowwise().maxCoeff() - lo;
+
+      std::vector<int> dims( X.rows() );
+      for(int j=0; j<dims.size(); j++){
+        dims[j] = j;
+      }
+      std::stable_sort( dims.begin(), dims.end(), [&extent](int a, int b){
+          return extent(a) > extent(b);
+      } );
+      dims.resize( std::min( (int) dims.size(), 8 ) );
+      int bits = std::min( 21, 63 / (int) dims.size() );
+      TPrecision width = extent.maxCoeff();
+      if(width <= 0){
+        return order;
+      }
+
+      //quantize to a cube grid on the bounding box
+      std::vector<uint64_t> codes( nodes.size() );
+      TPrecision nCells = (TPrecision) ( (uint64_t) 1 << bits );
+      uint32_t maxCell = ( (uint32_t) 1 << bits ) - 1;
+      Parallel::forBlocks(nodes.size(), 4096, [&](int t, long begin, long end){
+          std::vector<uint32_t> q( dims.size() );
+          for(long i=begin; i<end; i++){
+            for(int j=0; j<dims.size(); j++){
+              int k = dims[j];
+              q[j] = std::min( maxCell,
+                  (uint32_t) ( (X(k, i) - lo(k)) / width * nCells ) );
+            }
+            codes[i] = hilbertIndex(q, bits);
+          }
+      } );
+
+      //ties keep the breadth first order of the tree
+      std::stable_sort( order.begin(), order.end(), [&codes](int a, int b){
+          return codes[a] < codes[b];
+      } );
+      reorderNodes(order);
+      return order;
+    };
+
 
+
+    //Sorts the nodes of all levels with sortNodes, returns the old ids by
+    //level
+    static std::vector< std::vector<int> >
+      sortTransportLevels(std::vector< MultiscaleTransportLevel<TPrecision> *> &levels){
+        std::vector< std::vector<int> > orders( levels.size() );
+        for(int s = 0; s < levels.size(); s++){
+          GMRAMultiscaleTransportLevel<TPrecision> *level =
+            dynamic_cast< GMRAMultiscaleTransportLevel<TPrecision> *>( levels[s] );
+          if(level != NULL){
+            orders[s] = level->sortNodes();
+          }
+        }
+        return orders;
     };
 
 
 
 
+    //Uses the masses and scales from GMRATree::computeStatistics, which needs
+    //to be called before
+    static std::vector< MultiscaleTransportLevel<TPrecision> *>
+      buildTransportLevels(GMRANeighborhood<TPrecision> &nh, bool multiscaleCost ){
+        std::vector<TPrecision> weights;
+        return buildTransportLevels(nh, weights, multiscaleCost, true);
+    };
+
+
+
     static std::vector< MultiscaleTransportLevel<TPrecision> *>
       buildTransportLevels(GMRANeighborhood<TPrecision> &nh,
           std::vector<TPrecision> &weights, bool multiscaleCost ){
+        return buildTransportLevels(nh, weights, multiscaleCost, false);
+    };
 
 
-        class MaxScale : public Visitor<TPrecision>{
-          public:
-            int maxScale;
-            MaxScale(){ maxScale = 0; };
-
-            void visit(GMRANode<TPrecision> *node){
-              if(maxScale < node->getScale() ){
-                maxScale = node->getScale();
-              }
-            };
-        };
 
+    static std::vector< MultiscaleTransportLevel<TPrecision> *>
+      buildTransportLevels(GMRANeighborhood<TPrecision> &nh,
+          std::vector<TPrecision> &weights, bool multiscaleCost, bool nodeMass ){
 
         //Decorate tree with transport node decorator
         GMRATree<TPrecision> *t = nh.getTree();
@@ -370,33 +539,351 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
         t->setRoot( root );
 
         //Compte maximal scale
-        MaxScale ms;
-        t->breadthFirstVisitor(&ms);
-        
-        std::vector< MultiscaleTransportLevel<TPrecision> *>
-          levels(ms.maxScale+1);
+        int maxScale = getMaxScale(t, nodeMass);
 
-        std::vector< int > idCounter(ms.maxScale+1, 0);
+        std::vector< MultiscaleTransportLevel<TPrecision> *>
+          levels(maxScale+1);
 
         GMRAMultiscaleTransportLevel<TPrecision> *prev=NULL;
-        for(int i=0; i <= ms.maxScale; i++){
+        for(int i=0; i <= maxScale; i++){
           GMRAMultiscaleTransportLevel<TPrecision> *tmp = new
             GMRAMultiscaleTransportLevel<TPrecision>(nh, i, prev); 
           levels[i] = tmp;
           prev = tmp;
         }
 
+        addTransportNodes(levels, nh, root, NULL, 0, weights, nodeMass);
+
+        return levels; 
+    };
+
+
+
+
+    //Refreshes levels built from node masses after points were inserted into
+    //the tree, e.g. by IKMTree::insertPoints with statistics. Only subtrees
+    //whose mass changed are visited. Their transport nodes get the new masses
+    //and leaves that were split get transport nodes for the new kids in place
+    //of the copies of the leaf at the finer scales. Levels are added if the
+    //tree got deeper. Node ids within a level change, solutions computed on
+    //the old levels are invalid. The neighborhood is reset.
+    static void updateTransportLevels(std::vector< MultiscaleTransportLevel<TPrecision> *> &levels,
+        GMRANeighborhood<TPrecision> &nh){
+
+      GMRATree<TPrecision> *t = nh.getTree();
+      std::vector<TPrecision> weights;
+
+      //deeper tree, pass the leaves at the deepest scale through to the new
+      //levels
+      int maxScale = getMaxScale(t, true);
+      for(int s = levels.size(); s <= maxScale; s++){
+        GMRAMultiscaleTransportLevel<TPrecision> *level = new
+          GMRAMultiscaleTransportLevel<TPrecision>(nh, s,
+              (GMRAMultiscaleTransportLevel<TPrecision> *) levels[s-1] );
+        levels.push_back(level);
+
+        TransportNodeVector &prev = levels[s-1]->getNodes();
+        for(int i=0; i<prev.size(); i++){
+          TransportNode<TPrecision> *tNode = prev[i];
+          TransportNodeVector kids = tNode->getChildren();
+          if( kids.size() != 1 || kids[0] != tNode ){
+            continue;
+          }
+          tNode->removeChild(tNode);
+
+          GMRATransportNodeDecorator<TPrecision> *dec =
+            dynamic_cast< GMRATransportNodeBase<TPrecision> *>( tNode )->getGMRANode();
+          GMRATransportNode<TPrecision> *copy = new GMRATransportNode<TPrecision>( dec,
+              nh.getNodeDistance(), level->getNodes().size(), s );
+          copy->setMass( tNode->getMass() );
+          level->addNode(copy);
+          dec->nodemap[s] = copy;
+          copy->setParent(tNode);
+          tNode->addChild(copy);
+          copy->addChild(copy);
+        }
+      }
+
+
+      std::list< GMRATransportNodeDecorator<TPrecision> * > queue;
+      queue.push_back( dynamic_cast< GMRATransportNodeDecorator<TPrecision> *>( t->getRoot() ) );
+      while( !queue.empty() ){
+        GMRATransportNodeDecorator<TPrecision> *dec = queue.front();
+        queue.pop_front();
+
+        int scale = dec->getScale();
+        TransportNode<TPrecision> *tNode = dec->nodemap[scale];
+        TPrecision mass = dec->getMass();
+        if( tNode->getMass() == mass ){
+          continue;
+        }
+
+        //node and its copies at finer scales
+        typename std::map<int, TransportNode<TPrecision> *>::iterator it;
+        for(it = dec->nodemap.begin(); it != dec->nodemap.end(); ++it){
+          if(it->first >= scale){
+            it->second->setMass(mass);
+          }
+        }
+
+        std::vector< GMRANode<TPrecision> * > &kids = dec->getChildren();
+        if( !kids.empty() && dynamic_cast< GMRATransportNodeDecorator<TPrecision> *>( kids[0] ) == NULL ){
+
+          //split leaf, replace copies by the new subtrees
+          for(int s = scale+1; s < levels.size(); s++){
+            it = dec->nodemap.find(s);
+            if( it != dec->nodemap.end() ){
+              levels[s]->removeNode(it->second);
+              delete it->second;
+              dec->nodemap.erase(it);
+            }
+          }
+          TransportNodeVector tKids = tNode->getChildren();
+          for(int i=0; i<tKids.size(); i++){
+            tNode->removeChild( tKids[i] );
+          }
+
+          for(int i=0; i<kids.size(); i++){
+            GMRATransportNodeDecorator<TPrecision> *kid = decorate( kids[i], dec );
+            kids[i] = kid;
+            addTransportNodes(levels, nh, kid, tNode, scale+1, weights, true);
+          }
+          continue;
+        }
+
+        for(int i=0; i<kids.size(); i++){
+          GMRATransportNodeDecorator<TPrecision> *kid =
+            dynamic_cast< GMRATransportNodeDecorator<TPrecision> *>( kids[i] );
+          if( kid->nodemap.find(scale+1) == kid->nodemap.end() ){
+            //node without mass when the levels were built
+            addTransportNodes(levels, nh, kid, tNode, scale+1, weights, true);
+          }
+          else{
+            queue.push_back(kid);
+          }
+        }
+      }
+
+      for(int s = 0; s < levels.size(); s++){
+        levels[s]->invalidateTransportCosts();
+        GMRAMultiscaleTransportLevel<TPrecision> *level =
+          dynamic_cast< GMRAMultiscaleTransportLevel<TPrecision> *>( levels[s] );
+        if(level != NULL){
+          level->clearNeighborhoodCache();
+        }
+      }
+      //e.g. the index of an LSHGMRANeighborhood
+      nh.reset();
+
+    };
+
+
+
+    static GMRATransportNodeDecorator<TPrecision> *decorate(GMRANode<TPrecision>
+        *node, GMRATransportNodeDecorator<TPrecision> *parent){
+      
+      GMRATransportNodeDecorator<TPrecision> *tNode = new GMRATransportNodeDecorator<TPrecision>( node );
+      tNode->setParent(parent);
+
+      std::vector< GMRANode<TPrecision>* > &children = node->getChildren();
+      for(int i=0; i<children.size(); i++){ 
+        children[i] =  decorate(children[i], tNode);
+      }
+
+      return tNode;
+
+    };
+
+
+
+
+  private:
+
+    static VectorXp &getGMRACenter(TransportNode<TPrecision> *node){
+      return dynamic_cast< GMRATransportNodeBase<TPrecision> *>( node )->getGMRANode()->getCenter();
+    };
+
+
+
+    //Position of the grid cell q on the Hilbert curve through the 2^bits
+    //cells per side. Skilling's transform to the transposed index, whose
+    //bits interleaved from the most significant give the index.
+    static uint64_t hilbertIndex(std::vector<uint32_t> &q, int bits){
+      int n = q.size();
+      uint32_t M = (uint32_t) 1 << (bits-1);
+      for(uint32_t Q = M; Q > 1; Q >>= 1){
+        uint32_t P = Q - 1;
+        for(int i=0; i<n; i++){
+          if( q[i] & Q ){
+            q[0] ^= P;
+          }
+          else{
+            uint32_t t = (q[0] ^ q[i]) & P;
+            q[0] ^= t;
+            q[i] ^= t;
+          }
+        }
+      }
+      for(int i=1; i<n; i++){
+        q[i] ^= q[i-1];
+      }
+      uint32_t t = 0;
+      for(uint32_t Q = M; Q > 1; Q >>= 1){
+        if( q[n-1] & Q ){
+          t ^= Q - 1;
+        }
+      }
+
+      uint64_t index = 0;
+      for(int b = bits-1; b >= 0; b--){
+        for(int i=0; i<n; i++){
+          index = (index << 1) | ( ( (q[i] ^ t) >> b ) & 1 );
+        }
+      }
+      return index;
+    };
+
+
+
+    bool isCached(TransportNode<TPrecision> *node) const{
+      const TransportNodeVector &nodes = this->getNodes();
+      int id = node->getID();
+      return id >= 0 && id < nodes.size() && nodes[id] == node;
+    };
+
+
+
+    bool getCached(TransportNode<TPrecision> *node, TPrecision eps,
+        TransportNodeVector &neighbors) const{
+      if( !isCached(node) ){
+        return false;
+      }
+      int id = node->getID();
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if( id < rowRadius.size() && rowRadius[id] >= eps ){
+        long end = std::upper_bound( adjacencyDist.begin() + rowStart[id],
+            adjacencyDist.begin() + rowEnd[id], eps ) - adjacencyDist.begin();
+        neighbors.assign( adjacency.begin() + rowStart[id], adjacency.begin() + end );
+        return true;
+      }
+      return false;
+    };
+
+
+
+    //Sorts the neighbors of node by distance into neighbors and caches them
+    void storeRow(TransportNode<TPrecision> *node, TPrecision eps,
+        const NeighborList &gnodes, TransportNodeVector &neighbors) const{
+
+      std::vector< std::pair<TPrecision, TransportNode<TPrecision> *> > row;
+      row.reserve( gnodes.size() );
+      for(typename NeighborList::const_iterator it = gnodes.begin(); it != gnodes.end(); ++it){
+        GMRATransportNodeDecorator<TPrecision> *tNode =
+          dynamic_cast< GMRATransportNodeDecorator<TPrecision> *>( it->second );
+        row.push_back( std::make_pair( it->first, tNode->nodemap[scale] ) );
+      }
+      std::stable_sort( row.begin(), row.end(), [](
+            const std::pair<TPrecision, TransportNode<TPrecision> *> &a,
+            const std::pair<TPrecision, TransportNode<TPrecision> *> &b){
+          return a.first < b.first;
+      } );
+
+      neighbors.resize( row.size() );
+      for(int i=0; i<row.size(); i++){
+        neighbors[i] = row[i].second;
+      }
+
+      if( !isCached(node) ){
+        return;
+      }
+      int id = node->getID();
+      int nNodes = this->getNodes().size();
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if( rowRadius.size() < nNodes ){
+        rowStart.resize( nNodes, 0 );
+        rowEnd.resize( nNodes, 0 );
+        rowRadius.resize( nNodes, -1 );
+      }
+      if( rowRadius[id] < eps ){
+        nLive += row.size() - (rowEnd[id] - rowStart[id]);
+        rowStart[id] = adjacency.size();
+        for(int i=0; i<row.size(); i++){
+          adjacencyDist.push_back( row[i].first );
+          adjacency.push_back( row[i].second );
+        }
+        rowEnd[id] = adjacency.size();
+        rowRadius[id] = eps;
+        if( adjacency.size() > 2 * nLive + 1024 ){
+          compactCache();
+        }
+      }
+    };
+
+
+
+    //Removes stale rows, cacheMutex has to be locked
+    void compactCache() const{
+      std::vector< TransportNode<TPrecision> * > nodes;
+      std::vector<TPrecision> dists;
+      nodes.reserve(nLive);
+      dists.reserve(nLive);
+      for(int i=0; i<rowStart.size(); i++){
+        long start = nodes.size();
+        nodes.insert( nodes.end(), adjacency.begin() + rowStart[i], adjacency.begin() + rowEnd[i] );
+        dists.insert( dists.end(), adjacencyDist.begin() + rowStart[i],
+            adjacencyDist.begin() + rowEnd[i] );
+        rowStart[i] = start;
+        rowEnd[i] = nodes.size();
+      }
+      adjacency.swap(nodes);
+      adjacencyDist.swap(dists);
+    };
+
+
+
+    static int getMaxScale(GMRATree<TPrecision> *t, bool nodeMass){
+
+      class MaxScale : public Visitor<TPrecision>{
+        public:
+          int maxScale;
+          MaxScale(){ maxScale = 0; };
+
+          void visit(GMRANode<TPrecision> *node){
+            if(maxScale < node->getScale() ){
+              maxScale = node->getScale();
+            }
+          };
+      };
+
+      if( nodeMass && t->getMaxScale() >= 0 ){
+        return t->getMaxScale();
+      }
+      MaxScale ms;
+      t->breadthFirstVisitor(&ms);
+      return ms.maxScale;
+    };
+
+
+
+
+    //Adds transport nodes for the decorated subtree below node at scale,
+    //leaves are passed through to the finest level
+    static void addTransportNodes(std::vector< MultiscaleTransportLevel<TPrecision> *> &levels,
+        GMRANeighborhood<TPrecision> &nh, GMRANode<TPrecision> *node,
+        TransportNode<TPrecision> *parent, int scale,
+        std::vector<TPrecision> &weights, bool nodeMass){
+
+        int maxScale = levels.size() - 1;
 
         //populate multiscale transport levels 
         std::list< GMRANode<TPrecision> * > queue;
         std::list< TransportNode<TPrecision> * > parents;
         std::list< int > scales;
-        scales.push_back(0);
-        queue.push_back( root );
-        parents.push_back( NULL );
+        scales.push_back(scale);
+        queue.push_back( node );
+        parents.push_back( parent );
 
 
-        TPrecision nPoints = root->getPoints().size();
         while( !queue.empty() ){
           GMRANode<TPrecision> *node = queue.front();
           queue.pop_front();
@@ -406,11 +893,14 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
           scales.pop_front();
 
           TPrecision mass = 0;
-          if(weights.empty()){
+          if(nodeMass){
+            mass = node->getMass();
+          }
+          else if(weights.empty()){
             mass = node->getPoints().size(); // / nPoints;
           }
           else{
-            std::vector<int> pts = node->getPoints();
+            std::vector<int> &pts = node->getPoints();
             for(int i=0; i<pts.size(); i++){
               mass += weights[pts[i]];
             }
@@ -427,11 +917,10 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
           //  tNode = new GMRATransportNodeMS<TPrecision>( dec, nh.getNodeDistance(), idCounter[scale], scale );
           //}
          // else{
-            tNode = new GMRATransportNode<TPrecision>( dec, nh.getNodeDistance(), idCounter[scale], scale );
+            tNode = new GMRATransportNode<TPrecision>( dec, nh.getNodeDistance(),
+                levels[scale]->getNodes().size(), scale );
         //  }
 
-          idCounter[scale] += 1;
-
           tNode->setMass(mass);
           levels[scale]->addNode(tNode);
 
@@ -451,7 +940,7 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
          
 
           if( kids.empty() ){
-            if(scale < ms.maxScale){
+            if(scale < maxScale){
               queue.push_back(   node    );
               parents.push_back( tNode   );
               scales.push_back(  scale+1 );
@@ -463,25 +952,6 @@ class GMRAMultiscaleTransportLevel : public MultiscaleTransportLevel<TPrecision>
           }
           
         }
-
-        return levels; 
-    };
-
-
-
-    static GMRATransportNodeDecorator<TPrecision> *decorate(GMRANode<TPrecision>
-        *node, GMRATransportNodeDecorator<TPrecision> *parent){
-      
-      GMRATransportNodeDecorator<TPrecision> *tNode = new GMRATransportNodeDecorator<TPrecision>( node );
-      tNode->setParent(parent);
-
-      std::vector< GMRANode<TPrecision>* > &children = node->getChildren();
-      for(int i=0; i<children.size(); i++){ 
-        children[i] =  decorate(children[i], tNode);
-      }
-
-      return tNode;
-
     };
 
 };
@@ -4,6 +4,7 @@
 #include "GMRATree.h"
 
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 
@@ -28,6 +29,11 @@ class GMRANeighborhood{
 
     virtual ~GMRANeighborhood(){};
 
+
+    //Discards state derived from the tree, needed after the tree changed
+    virtual void reset(){
+    };
+
     typedef typename std::pair< TPrecision, GMRANode<TPrecision> * >  Neighbor;
     typedef typename std::list< Neighbor > NeighborList;
     typedef typename NeighborList::iterator NeighborListIterator;
@@ -36,6 +42,73 @@ class GMRANeighborhood{
     virtual int neighbors(GMRANode<TPrecision> *node, TPrecision epsilon,
          NeighborList &result, int stopScale = std::numeric_limits<int>::max() ) const = 0;
 
+
+
+    //Batched queries, result[i] gets the neighbors of queries[i] within
+    //eps[i]. Queries for the same node share a single search with the
+    //largest radius, the neighbors are then filtered by the radius of each
+    //query. Distinct nodes are searched in parallel, the node distance needs
+    //to be safe to call concurrently.
+    virtual void batchNeighbors(const std::vector< GMRANode<TPrecision> * > &queries,
+        const std::vector<TPrecision> &eps, std::vector<NeighborList> &result,
+        int stopScale = std::numeric_limits<int>::max() ) const{
+
+      result.resize( queries.size() );
+
+      //group the queries by node, the first query of a group is searched
+      std::unordered_map< GMRANode<TPrecision> *, int > first;
+      std::vector<int> searched;
+      std::vector<int> group( queries.size() );
+      std::vector<TPrecision> groupEps;
+      for(int i=0; i<queries.size(); i++){
+        typename std::unordered_map< GMRANode<TPrecision> *, int >::iterator it =
+          first.find( queries[i] );
+        if( it == first.end() ){
+          group[i] = searched.size();
+          first[ queries[i] ] = searched.size();
+          searched.push_back(i);
+          groupEps.push_back( eps[i] );
+        }
+        else{
+          group[i] = it->second;
+          groupEps[ it->second ] = std::max( groupEps[ it->second ], eps[i] );
+        }
+      }
+
+      Parallel::forBlocks(searched.size(), 64, [&](int t, long begin, long end){
+          for(long i=begin; i<end; i++){
+            neighbors( queries[ searched[i] ], groupEps[i], result[ searched[i] ], stopScale );
+          }
+      } );
+
+      for(int i=0; i<queries.size(); i++){
+        int index = searched[ group[i] ];
+        if(index == i){
+          continue;
+        }
+        NeighborList &all = result[index];
+        for(NeighborListIterator it = all.begin(); it != all.end(); ++it){
+          if( it->first <= eps[i] ){
+            result[i].push_back( *it );
+          }
+        }
+      }
+      for(int i=0; i<searched.size(); i++){
+        NeighborList &all = result[ searched[i] ];
+        if( groupEps[i] > eps[ searched[i] ] ){
+          for(NeighborListIterator it = all.begin(); it != all.end(); ){
+            if( it->first > eps[ searched[i] ] ){
+              it = all.erase(it);
+            }
+            else{
+              ++it;
+            }
+          }
+        }
+      }
+    };
+
+
     GMRATree<TPrecision> *getTree(){
       return tree;
     };
@@ -71,19 +144,18 @@ class GenericGMRANeighborhood : public GMRANeighborhood<TPrecision>{
         &collected, int stopScale = std::numeric_limits<int>::max() ) const{
 
       
-      NeighborList nodes;
+      //breadth first, nodes are not removed from the queue
+      std::vector<Neighbor> nodes;
       GMRANode<TPrecision> *root = this->tree->getRoot();
       TPrecision d = this->dist->distance(x, root);
       nodes.push_back( Neighbor(d, root) );
      
-      int nVisited =0; 
       int nCollected = 0;
-      while( !nodes.empty() ){
+      for(int i=0; i<nodes.size(); i++){
         
-        nVisited++;
-        Neighbor &n = nodes.front();
+        Neighbor n = nodes[i];
 
-        NodeVector kids = n.second->getChildren();
+        NodeVector &kids = n.second->getChildren();
         
         if( n.second->isStop() || n.second->getScale() == stopScale || kids.size() == 0 ){
           if( n.first <= eps ){
@@ -101,10 +173,8 @@ class GenericGMRANeighborhood : public GMRANeighborhood<TPrecision>{
             }
           }
         }
-        nodes.pop_front();
       }
 
-      //std::cout << nVisited << ", " << nCollected << std::endl;
       return nCollected;
     };
 
@@ -25,6 +25,7 @@ class GMRANode{
 
     TPrecision radius;
     TPrecision localRadius;
+    TPrecision mass;
 
     class CalculateRadius{
       private:
@@ -37,7 +38,7 @@ class GMRANode{
             radius = std::max( d->distance(source, node), radius );
           }
 
-          NodeVector kids = node->getChildren();
+          NodeVector &kids = node->getChildren();
           for(unsigned int i=0; i<kids.size(); i++){
             visit(kids[i]);
           }
@@ -64,6 +65,7 @@ class GMRANode{
     GMRANode(){
       radius = -1;
       localRadius = -1;
+      mass = -1;
     };
 
     virtual ~GMRANode(){};
@@ -100,6 +102,23 @@ class GMRANode{
       return localRadius;
     };
 
+    virtual void setRadius(TPrecision r){
+      radius = r;
+    };
+
+    virtual void setLocalRadius(TPrecision r){
+      localRadius = r;
+    };
+
+    //Mass of the points in the node, -1 if not computed
+    virtual TPrecision getMass(){
+      return mass;
+    };
+
+    virtual void setMass(TPrecision m){
+      mass = m;
+    };
+
 
     void removeChild(GMRANode<TPrecision> *kid){
       NodeVector &kids = getChildren();
@@ -334,6 +353,22 @@ class GMRANodeDecorator : public GMRANode<TPrecision>{
       return node->getLocalRadius();
     };
 
+    virtual void setRadius(TPrecision r){
+      node->setRadius(r);
+    };
+
+    virtual void setLocalRadius(TPrecision r){
+      node->setLocalRadius(r);
+    };
+
+    virtual TPrecision getMass(){
+      return node->getMass();
+    };
+
+    virtual void setMass(TPrecision m){
+      node->setMass(m);
+    };
+
 
     virtual GMRANode<TPrecision> *getDecoratedNode(){
       return node;
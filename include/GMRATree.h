@@ -6,9 +6,11 @@
 #include "GMRADecorator.h"
 #include "GMRADataObject.h"
 #include "NodeDistance.h"
+#include "Parallel.h"
 
 #include <Eigen/Dense>
 
+#include <algorithm>
 #include <list>
 #include <vector>
 #include <iostream>
@@ -28,11 +30,19 @@ private:
 
   GMRANode<TPrecision> *root;
 
+  //Deepest scale, set by computeStatistics
+  int maxScale;
+
 
 protected:
 
   GMRADataObject<TPrecision> *data;
 
+  //For trees that compute their statistics while building
+  void setMaxScale(int s){
+    maxScale = s;
+  };
+
 public:
     typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
     typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
@@ -40,12 +50,15 @@ public:
 
     GMRATree(GMRADataObject<TPrecision> *D):data(D){
       root = NULL;
+      maxScale = -1;
     };
 
 
     virtual ~GMRATree(){
-      DeleteVisitor<TPrecision> del;
-      depthFirstVisitor(&del);
+      if(root != NULL){
+        DeleteVisitor<TPrecision> del;
+        depthFirstVisitor(&del);
+      }
     };
 
 
@@ -70,20 +83,36 @@ public:
 
 
     void setupParents(){
+      setupParents( root );
+    };
+
+
+
+    //Set up parent pointers and scales of the subtree below node, node needs
+    //a valid scale unless it is the root. Updating a subtree keeps the deepest
+    //scale from computeStatistics current.
+    void setupParents(GMRANode<TPrecision> *node){
 
       //Set up parent pointers
       class SetParent : public Visitor<TPrecision>{
         public:
+          int maxScale;
+          GMRANode<TPrecision> *top;
+
+          SetParent(GMRANode<TPrecision> *t) : maxScale(0), top(t){
+          };
+
           //
           virtual void visit(GMRANode<TPrecision> *node){
             int scale = 1;
             GMRANode<TPrecision> *p = node->getParent();
-            if(p != NULL){
+            if(p != NULL || node != top){
               scale = node->getScale()+1;
             }
             else{
               node->setScale(0);
             }
+            maxScale = std::max(maxScale, node->getScale() );
             std::vector< GMRANode<TPrecision> * > &children = node->getChildren();
             for(unsigned int i=0; i<children.size(); i++){
               children[i]->setParent( node );
@@ -93,9 +122,20 @@ public:
 
       };
 
-      SetParent parenter;
+      if(node == NULL){
+        return;
+      }
+      SetParent parenter(node);
       //Breadth first required  for setting scale correctly
-      breadthFirstVisitor(&parenter);
+      breadthFirst(&parenter, node);
+
+      if(node == root){
+        //tree structure changed
+        maxScale = -1;
+      }
+      else if(maxScale >= 0){
+        maxScale = std::max(maxScale, parenter.maxScale);
+      }
 
     };
 
@@ -112,7 +152,7 @@ public:
     };
 
     static void depthFirst(Visitor<TPrecision> *v, GMRANode<TPrecision> *node){
-      std::vector<GMRANode<TPrecision> *> children = node->getChildren();
+      std::vector<GMRANode<TPrecision> *> &children = node->getChildren();
       for(typename std::vector< GMRANode<TPrecision>* >::iterator it = children.begin(); it !=
           children.end(); ++it){
         GMRATree<TPrecision>::depthFirst( v, *it );
@@ -126,14 +166,18 @@ public:
 
     //Pass each node in breadth first order to the Visitor v
     void breadthFirstVisitor(Visitor<TPrecision> *v){
+      breadthFirst( v, getRoot() );
+    };
+
+    static void breadthFirst(Visitor<TPrecision> *v, GMRANode<TPrecision> *node){
       std::list<GMRANode<TPrecision> *> nodes;
-      nodes.push_back( getRoot() );
+      nodes.push_back( node );
       while(!nodes.empty()){
         GMRANode<TPrecision> *node = nodes.front();
         nodes.pop_front();
 
         v->visit(node);
-        std::vector<GMRANode<TPrecision> *> children = node->getChildren();
+        std::vector<GMRANode<TPrecision> *> &children = node->getChildren();
         for(typename std::vector<GMRANode<TPrecision>*>::iterator it = children.begin(); it !=
            children.end(); ++it){
           nodes.push_back(*it);
@@ -152,44 +196,151 @@ public:
 
 
     void computeRadii(NodeDistance<TPrecision> *dist){
-      class RadiusVisitor : public Visitor<TPrecision>{
-        private:
-          NodeDistance<TPrecision> *dist;
-        public:
+      computeStatistics(dist);
+    };
 
-          RadiusVisitor(NodeDistance<TPrecision> *d):dist(d){
-          };
 
-          void visit(GMRANode<TPrecision> *node){
-              node->computeRadius(dist);
-          };
-      };
 
-      RadiusVisitor vis(dist);
-      this->breadthFirstVisitor(&vis);
 
+    //Deepest scale of the tree or -1 if computeStatistics was not called
+    //since the last change of the tree structure
+    int getMaxScale(){
+      return maxScale;
     };
 
 
 
 
-    void computeLocalRadii(NodeDistance<TPrecision> *dist){
-      class RadiusVisitor : public Visitor<TPrecision>{
-        private:
-          NodeDistance<TPrecision> *dist;
-        public:
+    void computeStatistics(NodeDistance<TPrecision> *dist, bool exactRadii = true){
+      std::vector<TPrecision> weights;
+      computeStatistics(dist, weights, exactRadii);
+    };
 
-          RadiusVisitor(NodeDistance<TPrecision> *d):dist(d){
-          };
 
-          void visit(GMRANode<TPrecision> *node){
-              node->computeLocalRadius(dist);
-          };
-      };
 
-      RadiusVisitor vis(dist);
-      this->breadthFirstVisitor(&vis);
+    //Computes scale, radius, local radius and mass of all nodes in a single
+    //bottom up pass. Exact radii are the maximal distance to the leaves of the
+    //subtree, computed from the merged leaf lists of the children. Otherwise
+    //the radius is bounded by max_k d(node, kid) + radius(kid). The mass is
+    //the summed weights of the points, or the number of points if weights is
+    //empty. Nodes of a scale are processed in parallel, dist needs to be safe
+    //to call concurrently.
+    void computeStatistics(NodeDistance<TPrecision> *dist,
+        std::vector<TPrecision> &weights, bool exactRadii = true){
+      computeStatistics(dist, weights, exactRadii, root);
+    };
+
+
+
+    //Statistics of the subtree below top only, top needs a valid scale unless
+    //it is the root. Used to update the tree after local changes.
+    void computeStatistics(NodeDistance<TPrecision> *dist,
+        std::vector<TPrecision> &weights, bool exactRadii, GMRANode<TPrecision> *top){
+
+      typedef std::vector< GMRANode<TPrecision> * > NodeList;
+      if(top == NULL){
+        return;
+      }
+      dist->addSubtree(top);
+
+      //nodes by scale, the kids of node i at scale s start at firstKid[s][i]
+      //in the list for scale s+1
+      std::vector< NodeList > scales(1, NodeList(1, top) );
+      std::vector< std::vector<int> > firstKid;
+      if(top == root){
+        top->setScale(0);
+      }
+      int topScale = top->getScale();
+      while( !scales.back().empty() ){
+        NodeList &current = scales.back();
+        NodeList next;
+        std::vector<int> first( current.size() );
+        for(int i=0; i<current.size(); i++){
+          first[i] = next.size();
+          NodeList &kids = current[i]->getChildren();
+          for(int j=0; j<kids.size(); j++){
+            kids[j]->setScale( topScale + scales.size() );
+            next.push_back( kids[j] );
+          }
+        }
+        firstKid.push_back(first);
+        scales.push_back(next);
+      }
+      scales.pop_back();
+      int depth = scales.size() - 1;
+      if(top == root){
+        maxScale = depth;
+      }
+      else if(maxScale >= 0){
+        maxScale = std::max(maxScale, topScale + depth);
+      }
+
+
+      std::vector< NodeList > kidLeaves;
+      for(int s = depth; s >= 0; s--){
+        NodeList &nodes = scales[s];
+        std::vector<int> &first = firstKid[s];
+        std::vector< NodeList > leaves( exactRadii ? nodes.size() : 0 );
+
+        //few nodes, parallelize over the leaves instead
+        bool parallelLeaves = nodes.size() < Parallel::getNumberOfThreads();
+        int blockSize = parallelLeaves ? nodes.size() : 16;
+
+        Parallel::forBlocks(nodes.size(), blockSize, [&](int t, long begin, long end){
+            for(long i=begin; i<end; i++){
+              GMRANode<TPrecision> *node = nodes[i];
+              NodeList &kids = node->getChildren();
+              TPrecision radius = 0;
+              TPrecision localRadius = 0;
+              TPrecision mass = 0;
+              if( kids.empty() ){
+                std::vector<int> &pts = node->getPoints();
+                if( weights.empty() ){
+                  mass = pts.size();
+                }
+                else{
+                  for(int j=0; j<pts.size(); j++){
+                    mass += weights[ pts[j] ];
+                  }
+                }
+                if(exactRadii){
+                  leaves[i].push_back(node);
+                }
+              }
+
+              for(int j=0; j<kids.size(); j++){
+                TPrecision d = dist->distance(node, kids[j]);
+                localRadius = std::max(localRadius, d);
+                mass += kids[j]->getMass();
+                if(exactRadii){
+                  NodeList &kl = kidLeaves[ first[i] + j ];
+                  leaves[i].insert( leaves[i].end(), kl.begin(), kl.end() );
+                }
+                else{
+                  radius = std::max(radius, d + kids[j]->getRadius() );
+                }
+              }
+
+              if(exactRadii && !kids.empty() ){
+                radius = leafRadius(node, leaves[i], dist, parallelLeaves);
+              }
+
+              node->setRadius(radius);
+              node->setLocalRadius(localRadius);
+              node->setMass(mass);
+            }
+        } );
+
+        kidLeaves.swap(leaves);
+      }
+
+    };
+
 
+
+
+    void computeLocalRadii(NodeDistance<TPrecision> *dist){
+      computeStatistics(dist);
     };
 
 
@@ -197,6 +348,31 @@ public:
   private:
 
 
+    static TPrecision leafRadius(GMRANode<TPrecision> *node,
+        std::vector< GMRANode<TPrecision> * > &leaves, NodeDistance<TPrecision> *dist,
+        bool parallel){
+
+      std::vector<TPrecision> d;
+      if(!parallel){
+        dist->distances(node, leaves, d);
+        return d.empty() ? 0 : *std::max_element(d.begin(), d.end() );
+      }
+
+      std::vector<TPrecision> radii( Parallel::getNumberOfThreads(leaves.size(), 1024), 0 );
+      Parallel::forBlocks(leaves.size(), 1024, [&](int t, long begin, long end){
+          std::vector< GMRANode<TPrecision> * > block( leaves.begin() + begin,
+              leaves.begin() + end );
+          std::vector<TPrecision> d;
+          dist->distances(node, block, d);
+          for(int i=0; i<d.size(); i++){
+            radii[t] = std::max(radii[t], d[i]);
+          }
+      } );
+      return *std::max_element(radii.begin(), radii.end() );
+    };
+
+
+
     GMRANode<TPrecision> *decorate(GMRANode<TPrecision> *node,
         GMRANode<TPrecision> *parent, Decorator<TPrecision> &decorator){
 
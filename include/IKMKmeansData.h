@@ -25,30 +25,37 @@ class IKMKmeansDataFactory{
 
 
 
+//Copies the subset into a dense matrix, the points are accessed many times
+//during the kmeans iterations
 template <typename TPrecision>
 class L2GMRAKmeansData : public KmeansData<TPrecision>{
+  public:
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
+
   private:
-    GMRADataObject<TPrecision> *data;
-    std::vector<int> subset;
+    MatrixXp X;
 
   public:
-    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
     
-    L2GMRAKmeansData(GMRADataObject<TPrecision> *d, std::vector<int> &sub) : data(d), subset(sub){
+    L2GMRAKmeansData(GMRADataObject<TPrecision> *d, std::vector<int> &sub) : X(d->dimension(), sub.size()){
+      for(int i=0; i<sub.size(); i++){
+        X.col(i) = d->getPoint( sub[i] );
+      }
     };
 
     virtual VectorXp getPoint(int index){
-      return data->getPoint( subset[index] );
+      return X.col(index);
     };
 
     virtual int getNumberOfPoints(){
-      return subset.size();
+      return X.cols();
     };
     
     VectorXp getMean( std::vector<int> &pts ){
-      VectorXp mean = VectorXp::Zero(data->dimension());
+      VectorXp mean = VectorXp::Zero(X.rows());
       for(int i=0; i<pts.size(); i++){
-        mean += getPoint( pts[i] );
+        mean += X.col( pts[i] );
       }
       mean /= pts.size();
       return mean;
@@ -56,7 +63,15 @@ class L2GMRAKmeansData : public KmeansData<TPrecision>{
 
     
     virtual TPrecision getSquaredSimilarity(int index, const VectorXp &p){
-      return (p -getPoint(index)).squaredNorm();
+      return (p - X.col(index)).squaredNorm();
+    };
+
+    virtual const MatrixXp *getEuclideanPoints(){
+      return &X;
+    };
+
+    virtual bool isMetric(){
+      return true;
     };
       
 
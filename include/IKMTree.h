@@ -34,6 +34,11 @@ class IKMTree : public GMRATree<TPrecision>{
     int nKids;
     TPrecision threshold;
     int maxIter;
+    //Nodes with more points are split with mini-batch kmeans
+    int miniBatchThreshold;
+    int miniBatchSize;
+    //Split and merge clusters locally instead of rerunning kmeans
+    bool bisect;
 
 
 
@@ -59,6 +64,9 @@ class IKMTree : public GMRATree<TPrecision>{
 
       KmeansData<TPrecision> *tmpData = getKmeansData(pts);
       Kmeans<TPrecision> kmeans(maxIter, threshold);
+      kmeans.setMiniBatchThreshold(miniBatchThreshold);
+      kmeans.setMiniBatchSize(miniBatchSize);
+      kmeans.setBisecting(bisect);
       std::vector< KmeansCenter<TPrecision> > centers;
       if(split != FIXED){
         centers =  kmeans.run( radius/2 , nKids, means, *tmpData);
@@ -79,6 +87,9 @@ class IKMTree : public GMRATree<TPrecision>{
 
       KmeansData<TPrecision> *tmpData = getKmeansData(pts);
       Kmeans<TPrecision> kmeans(maxIter, threshold);
+      kmeans.setMiniBatchThreshold(miniBatchThreshold);
+      kmeans.setMiniBatchSize(miniBatchSize);
+      kmeans.setBisecting(bisect);
       std::vector< KmeansCenter<TPrecision> > centers;
       if(split != FIXED){
         centers =  kmeans.run( radius/2, nKids, *tmpData);
@@ -92,6 +103,95 @@ class IKMTree : public GMRATree<TPrecision>{
     };
 
 
+    bool isStopped(IKMNode<TPrecision> *node){
+      if(node->getPoints().size() <= std::max(1, minPoints) ){
+        return true;
+      }
+      if(stop == R2 && (node->getMSE() / rootMSE) < epsilon){
+        return true;
+      }
+      if(stop == MSE && node->getMSE()  < epsilon){
+        return true;
+      }
+      if(stop == RADIUS && node->getKMRadius()  < epsilon){
+        return true;
+      }
+      if(stop == RELATIVE_RADIUS && (node->getKMRadius()/rootRadius)  < epsilon){
+        return true;
+      }
+      return false;
+    };
+
+
+
+
+    //IKMNode below any decorators
+    static IKMNode<TPrecision> *getIKMNode(GMRANode<TPrecision> *node){
+      GMRANodeDecorator<TPrecision> *dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+      while(dec != NULL){
+        node = dec->getDecoratedNode();
+        dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+      }
+      return dynamic_cast< IKMNode<TPrecision> *>( node );
+    };
+
+
+
+
+    //Adds the points to node and updates center, k-means radius and MSE, and
+    //if dist is not NULL and the node has statistics, mass and radius. The
+    //new radius bounds the old radius shifted by the center movement and the
+    //distances to the new points.
+    void insertIntoNode(GMRANode<TPrecision> *node, std::vector<int> &newPts,
+        NodeDistance<TPrecision> *dist, std::vector<TPrecision> &weights){
+
+      IKMNode<TPrecision> *ikm = getIKMNode(node);
+      std::vector<int> &nodePts = ikm->getPoints();
+      TPrecision n0 = nodePts.size();
+      TPrecision n1 = n0 + newPts.size();
+
+      VectorXp c0 = ikm->getCenter();
+      VectorXp c1 = c0 * n0;
+      for(int i=0; i<newPts.size(); i++){
+        c1 += this->getPoint( newPts[i] );
+      }
+      c1 /= n1;
+      TPrecision shift = (c1 - c0).norm();
+
+      TPrecision sse = n0 * ( ikm->getMSE() + shift*shift );
+      TPrecision kmRadius = ikm->getKMRadius() + shift;
+      for(int i=0; i<newPts.size(); i++){
+        TPrecision d2 = ( this->getPoint( newPts[i] ) - c1 ).squaredNorm();
+        sse += d2;
+        kmRadius = std::max( kmRadius, (TPrecision) sqrt(d2) );
+      }
+
+      nodePts.insert( nodePts.end(), newPts.begin(), newPts.end() );
+      ikm->setCenter(c1);
+      ikm->setMSE( sse / n1 );
+      ikm->setKMRadius( kmRadius );
+
+      if(dist == NULL || node->getMass() < 0){
+        return;
+      }
+
+      std::vector<int> empty;
+      IKMNode<TPrecision> old(c0, empty, 0, 0);
+      TPrecision radius = node->getRadius() + dist->distance(&old, node);
+      TPrecision mass = node->getMass();
+      for(int i=0; i<newPts.size(); i++){
+        VectorXp x = this->getPoint( newPts[i] );
+        IKMNode<TPrecision> point(x, empty, 0, 0);
+        radius = std::max( radius, dist->distance(node, &point) );
+        mass += weights.empty() ? 1 : weights[ newPts[i] ];
+      }
+      node->setRadius(radius);
+      node->setMass(mass);
+    };
+
+
+
+
     void buildTreeRecursive(IKMNode<TPrecision> *node, int scale){
 #ifdef VERBOSE
       std::cout << "Node MSE : " << node->getMSE() << std::endl;
@@ -104,19 +204,7 @@ class IKMTree : public GMRATree<TPrecision>{
 
 
       //Stop tree building?
-      if(node->getPoints().size() <= std::max(1, minPoints) ){
-        return;
-      }
-      if(stop == R2 && (node->getMSE() / rootMSE) < epsilon){
-        return;
-      }
-      if(stop == MSE && node->getMSE()  < epsilon){
-        return;
-      }
-      if(stop == RADIUS && node->getKMRadius()  < epsilon){
-        return;
-      }
-      if(stop == RELATIVE_RADIUS && (node->getKMRadius()/rootRadius)  < epsilon){
+      if( isStopped(node) ){
         return;
       }
 
@@ -205,6 +293,9 @@ class IKMTree : public GMRATree<TPrecision>{
       threshold= 0.01;
       maxIter = 100;
       minPoints = 1;
+      miniBatchThreshold = 1000000;
+      miniBatchSize = 1024;
+      bisect = false;
       dataFactory = NULL;
     };
 
@@ -262,6 +353,9 @@ class IKMTree : public GMRATree<TPrecision>{
 
 
 
+    //Builds the tree, an existing tree is rebuilt on all points. As after
+    //the first build, computeStatistics sets radii and masses. Use
+    //insertPoints to add points to a built tree incrementally.
     void addPoints(std::vector<int> &pts){
 
 
@@ -269,6 +363,9 @@ class IKMTree : public GMRATree<TPrecision>{
       if(root != NULL){
         std::vector<int> &ppts = root->getPoints();
         pts.insert(pts.end(), ppts.begin(), ppts.end() );
+        DeleteVisitor<TPrecision> del;
+        this->depthFirstVisitor(&del);
+        this->setRoot(NULL);
       }
 
       KmeansData<TPrecision> *tmpData = getKmeansData(pts);
@@ -291,21 +388,10 @@ class IKMTree : public GMRATree<TPrecision>{
 
 
 
-      if(root == NULL){
-        root = new IKMNode<TPrecision>(mean, pts, rootRadius, rootMSE);
-      }
-      else{
-        IKMNode<TPrecision> *node = dynamic_cast<IKMNode<TPrecision>*>( root );
-        node->setCenter(mean);
-        node->setPoints(pts);
-        node->setKMRadius(rootRadius);
-        node->setMSE(rootMSE);
-      };
-
-      IKMNode<TPrecision> *node = dynamic_cast<IKMNode<TPrecision>*>( root );
+      IKMNode<TPrecision> *node = new IKMNode<TPrecision>(mean, pts, rootRadius, rootMSE);
       buildTreeRecursive( node , 0);
 
-      this->setRoot(root);
+      this->setRoot(node);
       this->setupParents();
 
 
@@ -314,6 +400,84 @@ class IKMTree : public GMRATree<TPrecision>{
 
 
 
+    //Inserts points into the built tree without rebuilding it. The points are
+    //routed down the tree to the nearest kid centers, the nodes along the
+    //paths update center, k-means radius and MSE, and only the reached leaves
+    //that violate the stopping criterium are split. The root radius and MSE
+    //of the initial build are kept for the stopping criteria.
+    //
+    //If dist is not NULL the statistics from computeStatistics are updated:
+    //masses exactly, radii of the nodes along the paths as upper bounds and
+    //split leaves exactly. Works on trees decorated by buildTransportLevels,
+    //the levels are refreshed with
+    //GMRAMultiscaleTransportLevel::updateTransportLevels.
+    void insertPoints(std::vector<int> &pts, NodeDistance<TPrecision> *dist,
+        std::vector<TPrecision> &weights){
+
+      if(this->getRoot() == NULL){
+        addPoints(pts);
+        if(dist != NULL){
+          this->computeStatistics(dist, weights);
+        }
+        return;
+      }
+
+      //route points with the current centers, touched nodes are stored parents
+      //first
+      std::map< GMRANode<TPrecision> *, std::vector<int> > inserted;
+      std::vector< GMRANode<TPrecision> * > touched;
+      for(int i=0; i<pts.size(); i++){
+        VectorXp x = this->getPoint( pts[i] );
+        GMRANode<TPrecision> *node = this->getRoot();
+        while(node != NULL){
+          std::vector<int> &nodePts = inserted[node];
+          if( nodePts.empty() ){
+            touched.push_back(node);
+          }
+          nodePts.push_back( pts[i] );
+          node = node->findDescendant(x);
+        }
+      }
+
+      bool statistics = dist != NULL && this->getRoot()->getMass() >= 0;
+      for(int i=0; i<touched.size(); i++){
+        insertIntoNode( touched[i], inserted[ touched[i] ], dist, weights );
+      }
+
+
+      //split leaves
+      for(int i=0; i<touched.size(); i++){
+        GMRANode<TPrecision> *node = touched[i];
+        if( !node->getChildren().empty() ){
+          continue;
+        }
+        IKMNode<TPrecision> *ikm = getIKMNode(node);
+        buildTreeRecursive( ikm, node->getScale() );
+        if( !node->getChildren().empty() ){
+          this->setupParents(node);
+          if(statistics){
+            this->computeStatistics(dist, weights, true, node);
+            //the new leaves can be further out than the split leaf
+            GMRANode<TPrecision> *p = node->getParent();
+            for( ; p != NULL; p = p->getParent() ){
+              TPrecision r = dist->distance(p, node) + node->getRadius();
+              p->setRadius( std::max(p->getRadius(), r) );
+            }
+          }
+        }
+      }
+
+      if(statistics){
+        for(int i=0; i<touched.size(); i++){
+          touched[i]->computeLocalRadius(dist);
+        }
+      }
+
+    };
+
+
+
+
 
     std::vector<GMRANode<TPrecision> *> getLeafPath(const VectorXp &x ) {
 
@@ -3,13 +3,12 @@
 
 
 #include "IPCANode.h"
-#include "EigenRandomSVD.h"
+#include "EigenStreamingRandomRange.h"
+#include "Parallel.h"
 
 #include <queue>
 #include <map>
 
-#define STREAMING_THRESHOLD 100000000
-
 
 
 //Node factory decides on the dimensionality of each node
@@ -51,69 +50,125 @@ class IPCANodeFactory{
     
 
 
-    void computeSVD(std::vector<int> &indices, const VectorXp &mean){      
+    //Mean, total variance, radius and principal directions of the points
+    //in streaming passes over parallel chunks, without copying the points.
+    //In low dimensions the covariance is accumulated directly, otherwise it
+    //is restricted to a randomized range with one power iteration. The first
+    //pass computes the mean (and the range sketch), the last one the
+    //covariance, total variance and radius about that mean. In between,
+    //the randomized case makes one pass for the power iteration.
+    void computeSVD(std::vector<int> &indices, VectorXp &mean){
 
       using namespace Eigen;
-      
-      //Sample randomly from if matrix too large  
-      MatrixXp X;
+
       int d = data->dimension();
-      if( (indices.size() * d) > STREAMING_THRESHOLD){
-        int n = STREAMING_THRESHOLD / d;
-        X = MatrixXp( d, n );
-        for(unsigned int i=0; i < X.cols(); i++){
-          static Random<TPrecision> random;
-          int index = std::floor(random.Uniform() * indices.size() );
-          X.col(i)  = data->getPoint( indices[index] ) - mean;
+      long n = indices.size();
+      bool randomized = d >= maxDim+20;
+      int k = randomized ? maxDim+10 : d;
+      long blockSize = 4096;
+      int nThreads = Parallel::getNumberOfThreads(n, blockSize);
+
+      //mean and range sketch
+      std::vector<VectorXp> sums( nThreads, VectorXp::Zero(d) );
+      std::vector< EigenLinalg::ColumnStreamingRandomRange<TPrecision> > ranges;
+      if(randomized){
+        ranges.resize( nThreads, EigenLinalg::ColumnStreamingRandomRange<TPrecision>(d, k) );
+      }
+      Parallel::forBlocks(n, blockSize, [&](int t, long begin, long end){
+          if(randomized){
+            ranges[t].Seed(begin / blockSize);
+          }
+          for(long i=begin; i<end; i++){
+            VectorXp x = data->getPoint( indices[i] );
+            sums[t] += x;
+            if(randomized){
+              ranges[t].Add(x);
+            }
+          }
+      } );
+      for(int t=1; t<nThreads; t++){
+        sums[0] += sums[t];
+        if(randomized){
+          ranges[0].Merge( ranges[t] );
         }
-
       }
-      else{
-        X = MatrixXp( d, indices.size() );        
-        for(unsigned int i=0; i < X.cols(); i++){
-          X.col(i)  = data->getPoint( indices[i] ) - mean;
+      mean = sums[0] / n;
+
+      MatrixXp Q;
+      if(randomized){
+        Q = ranges[0].GetRange(mean);
+
+        //power iteration
+        std::vector<MatrixXp> Ys( nThreads, MatrixXp::Zero(d, k) );
+        Parallel::forBlocks(n, blockSize, [&](int t, long begin, long end){
+            for(long i=begin; i<end; i++){
+              VectorXp x = data->getPoint( indices[i] ) - mean;
+              Ys[t].noalias() += x * (x.transpose() * Q);
+            }
+        } );
+        for(int t=1; t<nThreads; t++){
+          Ys[0] += Ys[t];
         }
+        HouseholderQR<MatrixXp> qr(Ys[0]);
+        Q = qr.householderQ() * MatrixXp::Identity(d, k);
       }
 
+      //covariance in the range, total variance and radius
+      std::vector<MatrixXp> C( nThreads, MatrixXp::Zero(k, k) );
+      std::vector<TPrecision> vars(nThreads, 0);
+      std::vector<TPrecision> radii(nThreads, 0);
+      Parallel::forBlocks(n, blockSize, [&](int t, long begin, long end){
+          VectorXp z;
+          for(long i=begin; i<end; i++){
+            VectorXp x = data->getPoint( indices[i] ) - mean;
+            TPrecision tmp = x.squaredNorm();
+            vars[t] += tmp;
+            radii[t] = std::max(radii[t], tmp);
+            if(randomized){
+              z.noalias() = Q.transpose() * x;
+              C[t].template selfadjointView<Lower>().rankUpdate(z);
+            }
+            else{
+              C[t].template selfadjointView<Lower>().rankUpdate(x);
+            }
+          }
+      } );
 
       totalVar = 0;
       radius = 0;
-      for(unsigned int i=0; i < X.cols(); i++){
-        TPrecision tmp = X.col(i).squaredNorm();
-        totalVar += tmp;
-        radius = std::max(radius, tmp );
-      }
-      if(radius > 0 ){
-        radius = sqrt(radius);
-      }
-      if( X.cols() > 1){
-        totalVar /= (X.cols()-1);
+      for(int t=0; t<nThreads; t++){
+        totalVar += vars[t];
+        radius = std::max(radius, radii[t]);
+        if(t > 0){
+          C[0] += C[t];
+        }
       }
+      radius = sqrt(radius);
 
 
-      //Select method for computing svd depending on size of matrix
-
       //trivial case
-      if(X.cols() == 1){
-        phi = MatrixXp::Zero(this->data->dimension(), 1);
+      if(n == 1){
+        phi = MatrixXp::Zero(d, 1);
         sigma = VectorXp::Zero(1);
       }
-      //Do normal svd for smaller dimensions
-      else if(X.cols() < 1000 && X.rows() < maxDim+20  ){        
-        JacobiSVD<MatrixXd> svd(X, ComputeThinU | ComputeThinV);
-        sigma = svd.singularValues();
-        phi = svd.matrixU();
-      }
-      //else do randomized svd
-      else{ 
-        EigenLinalg::RandomSVD<TPrecision> svd(X, maxDim+4, 1);
-        phi = svd.GetU();
-        sigma = svd.GetS();
-      }
-      if(X.cols() > 1){
-        sigma.array() /= sqrt( X.cols()-1.0 );
+      else{
+        totalVar /= n-1;
+
+        //eigenvalues are ascending, keep at most n directions as the thin
+        //SVD of the n centered points did, the n-th one is trivial
+        SelfAdjointEigenSolver<MatrixXp> eig( C[0].template selfadjointView<Lower>() );
+        int m = std::min( (long) k, n );
+        sigma = eig.eigenvalues().reverse().head(m).cwiseMax(0).cwiseSqrt();
+        MatrixXp W = eig.eigenvectors().rowwise().reverse().leftCols(m);
+        if(randomized){
+          phi = Q * W;
+        }
+        else{
+          phi = W;
+        }
+        sigma.array() /= sqrt( n-1.0 );
       }
-      
+
       this->truncateSVD();
 
     };
@@ -145,12 +200,7 @@ class IPCANodeFactory{
 
     GMRANode<TPrecision> *createNode(std::vector<int> &indices){
 
-      VectorXp mean = VectorXp::Zero( this->data->dimension() );
-      for( int i=0; i< indices.size(); i++ ){
-        mean += this->data->getPoint( indices[i] );
-      }
-      mean.array() /= indices.size();
-
+      VectorXp mean;
       computeSVD(indices, mean);
 
 
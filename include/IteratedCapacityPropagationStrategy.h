@@ -2,9 +2,9 @@
 #define ITERATEDCAPACITYPROPAGATIONSTRATEGY_H
 
 #include "NeighborhoodPropagationStrategy.h"
-#include "Random.h"
 
-#include <ctime>
+#include <random>
+#include <vector>
 
 
 template <typename TPrecision>
@@ -24,11 +24,18 @@ class IteratedCapacityPropagationStrategy : public NeighborhoodPropagationStrate
 
   private:
     int nIterations;
+    int nChains;
+
+    //rounds of removing blocking bounds before removing all
+    enum{ maxRelaxRounds = 8 };
 
   public:
 
-    IteratedCapacityPropagationStrategy(int nIter, TPrecision eFactor=0) :
-      NeighborhoodPropagationStrategy<TPrecision>(eFactor), nIterations(nIter){
+    //nChain independent chains of nIter alternate solutions, the chains are
+    //solved concurrently
+    IteratedCapacityPropagationStrategy(int nIter, TPrecision eFactor=0, int nChain=1) :
+      NeighborhoodPropagationStrategy<TPrecision>(eFactor), nIterations(nIter),
+      nChains(nChain){
     };
 
     virtual ~IteratedCapacityPropagationStrategy(){};
@@ -38,122 +45,71 @@ class IteratedCapacityPropagationStrategy : public NeighborhoodPropagationStrate
 
   protected:
 
+    //Each iteration bounds the paths with mass of the previous solution to a
+    //random fraction of their mass, on top of the bounds of the previous
+    //iterations
     virtual void computeAlternateSolutions( TransportLPSolver<TPrecision> *solver,
                         TransportPlanSolutions<TPrecision> *pSol, double p, bool lastScale ){
 
-      TransportPlan<TPrecision> *sol = pSol->getPrimarySolution();
-
-      TransportPlan<TPrecision> *res = sol->createCopy();
-      solver->createLP(res);
+      this->solveAlternateSolutions(solver, pSol, p, nChains, nIterations,
+          [](TransportLPSolver<TPrecision> *s, TransportPlan<TPrecision> *res,
+            std::mt19937_64 &generator){
 
-      for(int i=0; i<nIterations; i++){
-        clock_t t1 = clock();
+        std::uniform_real_distribution<TPrecision> uniform(0, 1);
         for( res->pathIteratorBegin(); !res->pathIteratorIsAtEnd();
           res->pathIteratorNext() ){
           Path &path = res->pathIteratorCurrent();
 
           if(path.w > 0){
-            static Random<TPrecision> random;
-            int nFrom = res->getNumberOfToPaths( path.from->getID() );
-            int nTo = res->getNumberOfFromPaths( path.to->getID() );
-            int div = std::min(nTo, nFrom);
-            TPrecision ub =  path.w * ( 0.9 + 0.05*random.Uniform() );
-            //TPrecision ub =  path.w * ( 0.9 + 0.1 / (div-0.0001) );
-            solver->setColumnBounds(path.index, 0, ub);
-            //path.cost *= 10;
-            //solver->setCoefficent(path.index, path.cost);
+            TPrecision ub =  path.w * ( 0.9 + 0.05*uniform(generator) );
+            s->setColumnBounds(path.index, 0, ub);
           }
         }
-#ifdef VERBOSE
-        std::cout << "Solving iterated capacity propagation problem" << std::endl;
-#endif
-        clock_t t2 = clock();
-        solver->solveLP();
-        clock_t t3 = clock();
 
-
-
-        //Fix if unfeasible LP
-        if( !solver->isOptimal() ){
+        //Remove the bounds blocking a feasible solution before solving, the
+        //feasibility check is much cheaper than a solve. After a few rounds
+        //remove all bounds.
+        std::vector<long> blocking;
+        bool feasible = s->isFeasible(blocking);
+        for(int round = 0; !feasible && round < maxRelaxRounds; round++){
 #ifdef VERBOSE
-          std::cout << "Suboptimal, problem infeasible. Removing some upper bounds" << std::endl;
+          std::cout << "Infeasible, removing " << blocking.size() << " upper bounds" << std::endl;
 #endif
-          /*
-          TransportNodeVector &snodes = res->source->getNodes();
-          std::vector<double> solSNodeWeights(snodes.size(), 0);
-
-          TransportNodeVector &tnodes = res->target->getNodes();
-          std::vector<double> solTNodeWeights(tnodes.size(), 0);
-
+          for(int j=0; j<blocking.size(); j++){
+            s->setColumnBoundsLower(blocking[j], 0);
+          }
+          if( blocking.empty() ){
+            break;
+          }
+          blocking.clear();
+          feasible = s->isFeasible(blocking);
+        }
+        if(!feasible){
           for( res->pathIteratorBegin(); !res->pathIteratorIsAtEnd();
                res->pathIteratorNext() ){
             Path &path = res->pathIteratorCurrent();
-
-            if(path.w > 0){
-              int fromID =  path.from->getID();
-              solSNodeWeights[fromID] += path.w;
-              int toID =  path.to->getID();
-              solTNodeWeights[toID] += path.w;
-            }
-          }
-
-          std::vector<double> reqSNodeWeights(snodes.size(), 0);
-          for( TransportNodeVectorCIterator it = snodes.begin(); it != snodes.end();
-                ++it ){
-            reqSNodeWeights[ (*it)->getID() ] = (*it)->getMass();
-          }
-
-          std::vector<double> reqTNodeWeights(tnodes.size(), 0);
-          for( TransportNodeVectorCIterator it = tnodes.begin(); it != tnodes.end();
-                ++it ){
-            reqTNodeWeights[ (*it)->getID() ] = (*it)->getMass();
+            s->setColumnBoundsLower(path.index, 0);
           }
+        }
 
+#ifdef VERBOSE
+        std::cout << "Solving iterated capacity propagation problem" << std::endl;
+#endif
+        s->solveLP();
 
-          int nBounds = 0;
+        //Fix if unfeasible LP
+        if( !s->isOptimal() ){
+#ifdef VERBOSE
+          std::cout << "Suboptimal, problem infeasible. Removing upper bounds" << std::endl;
+#endif
           for( res->pathIteratorBegin(); !res->pathIteratorIsAtEnd();
                res->pathIteratorNext() ){
             Path &path = res->pathIteratorCurrent();
-
-            if(path.w > 0){
-              int fromID =  path.from->getID();
-              int toID =  path.to->getID();
-              if( solTNodeWeights[toID] < reqTNodeWeights[toID] ||
-                  solSNodeWeights[fromID] < reqSNodeWeights[fromID] ){
-	               solver->setColBounds(path.index);
-                 nBounds++;
-              }
-            }
-          }
-          std::cout << "Removed " << nBounds << " upper bounds" << std::endl;
-          std::cout << "Resolving" << std::endl;
-          solver->solveLP();
-
-
-
-
-          //reset bounds and recompute solution
-          */
-           for( res->pathIteratorBegin(); !res->pathIteratorIsAtEnd();
-		            res->pathIteratorNext() ){
-	          Path &path = res->pathIteratorCurrent();
-	          solver->setColumnBoundsLower(path.index, 0);
+            s->setColumnBoundsLower(path.index, 0);
           }
-          solver->solveLP();
-
-          //break;
+          s->solveLP();
         }
-
-        solver->storeLP(res, p);
-        pSol->addAlternativeSolution(res);
-        res = res->createCopy();
-
-      }
-
-      delete res;
-
-      //pSol->addAlternativeSolution(res);
-
+      } );
 
     };
 
@@ -6,6 +6,7 @@
 #include <Eigen/Dense>
 #include <vector>
 #include "Random.h"
+#include "Parallel.h"
 
 #include <cmath>
 #include <limits>
@@ -13,6 +14,7 @@
 template <typename TPrecision>
 class KmeansData{
   public:
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
     typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
 
     virtual ~KmeansData(){};
@@ -24,6 +26,116 @@ class KmeansData{
 
     virtual TPrecision getSquaredSimilarity(int index, const VectorXp &p) = 0;
 
+    //Squared similarity between two centers, only used if isMetric is true
+    virtual TPrecision getSquaredSimilarity(const VectorXp &p1, const VectorXp &p2){
+      return (p1 - p2).squaredNorm();
+    };
+
+    //True if the square root of the similarity satisfies the triangle
+    //inequality. Enables bound based pruning of the assignment step.
+    virtual bool isMetric(){
+      return false;
+    };
+
+    //Points as columns of a matrix if the similarity is the squared Euclidean
+    //distance and the mean the average, NULL otherwise. Enables the blocked
+    //matrix product based assignment.
+    virtual const MatrixXp *getEuclideanPoints(){
+      return NULL;
+    };
+
+};
+
+
+
+//Per point assignment and lower bound on the distance to the second closest
+//center (Hamerly). Kept across iterations and center additions.
+template <typename TPrecision>
+class KmeansBounds{
+  public:
+    std::vector<int> assignment;
+    std::vector<TPrecision> lower;
+
+    void reset(int n){
+      assignment.assign(n, -1);
+      lower.assign(n, 0);
+    };
+
+    //Centers appended at index first and later: the second closest center might
+    //now be one of the new centers
+    template <typename TCenters>
+    void addCenters(TCenters &centers, int first, KmeansData<TPrecision> &data){
+      for(int i=0; i<assignment.size(); i++){
+        if(assignment[i] < 0){
+          continue;
+        }
+        for(int j=first; j<centers.size(); j++){
+          TPrecision d = sqrt( data.getSquaredSimilarity(i, centers[j].center) );
+          lower[i] = std::min(lower[i], d);
+        }
+      }
+    };
+
+    //Center at index removed: its points need a full search, removing a center
+    //does not invalidate the lower bounds of the other points
+    void removeCenter(int index){
+      for(int i=0; i<assignment.size(); i++){
+        if(assignment[i] == index){
+          assignment[i] = -1;
+        }
+        else if(assignment[i] > index){
+          assignment[i]--;
+        }
+      }
+    };
+
+};
+
+
+
+//View of a subset of another KmeansData, used to refine single clusters
+template <typename TPrecision>
+class SubsetKmeansData : public KmeansData<TPrecision>{
+  public:
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
+
+  private:
+    KmeansData<TPrecision> &data;
+    std::vector<int> &subset;
+
+  public:
+
+    SubsetKmeansData(KmeansData<TPrecision> &d, std::vector<int> &sub) : data(d), subset(sub){
+    };
+
+    virtual VectorXp getPoint(int index){
+      return data.getPoint( subset[index] );
+    };
+
+    virtual int getNumberOfPoints(){
+      return subset.size();
+    };
+
+    virtual VectorXp getMean( std::vector<int> &pts ){
+      std::vector<int> tmp( pts.size() );
+      for(int i=0; i<pts.size(); i++){
+        tmp[i] = subset[ pts[i] ];
+      }
+      return data.getMean(tmp);
+    };
+
+    virtual TPrecision getSquaredSimilarity(int index, const VectorXp &p){
+      return data.getSquaredSimilarity( subset[index], p );
+    };
+
+    virtual TPrecision getSquaredSimilarity(const VectorXp &p1, const VectorXp &p2){
+      return data.getSquaredSimilarity(p1, p2);
+    };
+
+    virtual bool isMetric(){
+      return data.isMetric();
+    };
+
 };
 
 
@@ -50,13 +162,147 @@ class KmeansCenter{
 template <typename TPrecision>
 class Kmeans{
 
+  public:
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
+    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
+
+
   private:
     int maxIter;
     TPrecision threshold;
     int minPoints;
 
+    //Number of points per block in the blocked assignment
+    int blockSize;
+    //Use the blocked assignment for data with at least this dimension, below
+    //the bound based assignment evaluates fewer distances
+    int blockedMinDimension;
+
+    //Use mini-batch iterations followed by a single full assignment for data
+    //with more than miniBatchThreshold points
+    int miniBatchThreshold;
+    int miniBatchSize;
+
+    //Refine only the offending cluster instead of rerunning kmeans on all
+    //points when centers are added or removed
+    bool bisecting;
+
+
+
+    static int randomIndex(int n){
+      int index = (int) ( Random<double>::Uniform() * n );
+      return std::min(index, n-1);
+    };
+
+
+
+    //Sample an index from pts with probability proportional to d2
+    static int sampleIndex(std::vector<TPrecision> &d2, TPrecision total){
+      TPrecision r = Random<double>::Uniform() * total;
+      TPrecision sum = 0;
+      for(int i=0; i<d2.size(); i++){
+        sum += d2[i];
+        if(r < sum){
+          return i;
+        }
+      }
+      //r == total due to rounding, pick the last non zero weight
+      for(int i=d2.size()-1; i>=0; i--){
+        if(d2[i] > 0){
+          return i;
+        }
+      }
+      return d2.size()-1;
+    };
+
+
+
+    //kmeans++ seeding, might return less than nClusters centers if there are
+    //less distinct points
+    std::vector< VectorXp > seed( int nClusters, KmeansData<TPrecision> &data ){
+      int n = data.getNumberOfPoints();
+      std::vector< VectorXp > centers;
+      if(n == 0 || nClusters == 0){
+        return centers;
+      }
+      centers.push_back( data.getPoint( randomIndex(n) ) );
+
+      std::vector<TPrecision> d2(n, std::numeric_limits<TPrecision>::max() );
+      while( centers.size() < nClusters ){
+        VectorXp &last = centers.back();
+        TPrecision total = 0;
+        for(int i=0; i<n; i++){
+          d2[i] = std::min( d2[i], data.getSquaredSimilarity(i, last) );
+          total += d2[i];
+        }
+        if(total <= 0){
+          break;
+        }
+        centers.push_back( data.getPoint( sampleIndex(d2, total) ) );
+      }
+
+      return centers;
+    };
+
+
+
+    //kmeans++ style sample from the points of a single center
+    VectorXp seed( KmeansCenter<TPrecision> &c, KmeansData<TPrecision> &data ){
+      std::vector<TPrecision> d2( c.points.size() );
+      TPrecision total = 0;
+      for(int i=0; i<c.points.size(); i++){
+        d2[i] = data.getSquaredSimilarity(c.points[i], c.center);
+        total += d2[i];
+      }
+      if(total <= 0){
+        return data.getPoint( c.points[ randomIndex( c.points.size() ) ] );
+      }
+      return data.getPoint( c.points[ sampleIndex(d2, total) ] );
+    };
+
+
+
+    //Sculley's mini-batch kmeans, the per center counts start at the number
+    //of points already assigned to the center
+    void miniBatch( std::vector< KmeansCenter<TPrecision> > &centers,
+        const MatrixXp &X ){
+
+      int k = centers.size();
+      int n = X.cols();
+      std::vector<TPrecision> counts(k);
+      for(int j=0; j<k; j++){
+        counts[j] = centers[j].points.size();
+      }
+
+      std::vector<int> batch(miniBatchSize);
+      std::vector<int> assignment(miniBatchSize);
+      for(int iter=0; iter<maxIter; iter++){
+        for(int i=0; i<miniBatchSize; i++){
+          batch[i] = randomIndex(n);
+          TPrecision dist = std::numeric_limits<TPrecision>::max();
+          int index = -1;
+          for(int j=0; j<k; j++){
+            TPrecision tmp = ( X.col(batch[i]) - centers[j].center ).squaredNorm();
+            if(tmp < dist){
+              dist = tmp;
+              index = j;
+            }
+          }
+          assignment[i] = index;
+        }
+
+        for(int i=0; i<miniBatchSize; i++){
+          int j = assignment[i];
+          counts[j] += 1;
+          TPrecision eta = 1.0 / counts[j];
+          centers[j].center += eta * ( X.col(batch[i]) - centers[j].center );
+        }
+      }
+
+    };
+
     void update( std::vector< KmeansCenter<TPrecision> > &centers,
-        KmeansData<TPrecision> &data ){
+        KmeansData<TPrecision> &data, KmeansBounds<TPrecision> &bounds ){
 
       for(int i=0; i<centers.size(); i++){
         centers[i].points.clear();
@@ -64,6 +310,16 @@ class Kmeans{
         centers[i].radius = 0;
       }
 
+      const MatrixXp *X = data.getEuclideanPoints();
+      if( X != NULL && X->rows() >= blockedMinDimension ){
+        updateBlocked(centers, *X);
+        return;
+      }
+
+      if( data.isMetric() ){
+        updateBounded(centers, data, bounds);
+        return;
+      }
 
       for(int i=0; i<data.getNumberOfPoints(); i++){
         TPrecision dist = std::numeric_limits<TPrecision>::max();
@@ -92,58 +348,265 @@ class Kmeans{
 
 
 
+    //Hamerly style assignment. The distance to the assigned center is always
+    //evaluated to keep mse and radius exact, the remaining centers are only
+    //searched if the point is not provably closer to its current center than
+    //to any other center.
+    void updateBounded( std::vector< KmeansCenter<TPrecision> > &centers,
+        KmeansData<TPrecision> &data, KmeansBounds<TPrecision> &bounds ){
 
+      int k = centers.size();
 
+      //half distance to the closest other center
+      std::vector<TPrecision> s(k, std::numeric_limits<TPrecision>::max() );
+      for(int i=0; i<k; i++){
+        for(int j=i+1; j<k; j++){
+          TPrecision d = sqrt( data.getSquaredSimilarity(centers[i].center,
+                centers[j].center) ) / 2;
+          s[i] = std::min(s[i], d);
+          s[j] = std::min(s[j], d);
+        }
+      }
 
-  public:
-    typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
 
-    Kmeans(int mIter = 100, TPrecision t = 0.01){
-      maxIter = mIter;
-      threshold = t;
+      for(int i=0; i<data.getNumberOfPoints(); i++){
+        int index = bounds.assignment[i];
+        TPrecision dist = std::numeric_limits<TPrecision>::max();
+        bool search = true;
+        if(index >= 0){
+          dist = data.getSquaredSimilarity(i, centers[index].center);
+          TPrecision u = sqrt(dist);
+          search = u > std::max( s[index], bounds.lower[i] );
+        }
+
+        if(search){
+          TPrecision second = std::numeric_limits<TPrecision>::max();
+          dist = std::numeric_limits<TPrecision>::max();
+          index = -1;
+          for(int j=0; j<k; j++){
+            TPrecision tmp = data.getSquaredSimilarity(i, centers[j].center);
+            if(tmp < dist){
+              second = dist;
+              dist = tmp;
+              index = j;
+            }
+            else if(tmp < second){
+              second = tmp;
+            }
+          }
+          bounds.lower[i] = sqrt(second);
+        }
+        bounds.assignment[i] = index;
+
+        centers[index].mse += dist;
+        centers[index].radius = std::max(centers[index].radius, dist);
+        centers[index].points.push_back(i);
+      }
+
+
+      //update means and track center movement
+      std::vector<TPrecision> delta(k, 0);
+      int maxIndex = -1;
+      TPrecision maxDelta = 0;
+      TPrecision secondDelta = 0;
+      for(int i=0; i<k; i++){
+        if( centers[i].points.empty() ){
+          //Empty centers end up undefined and never attract points
+          centers[i].center =  data.getMean(centers[i].points);
+          continue;
+        }
+        VectorXp mean = data.getMean(centers[i].points);
+        delta[i] = sqrt( data.getSquaredSimilarity(mean, centers[i].center) );
+        centers[i].center = mean;
+        if(delta[i] > maxDelta){
+          secondDelta = maxDelta;
+          maxDelta = delta[i];
+          maxIndex = i;
+        }
+        else if(delta[i] > secondDelta){
+          secondDelta = delta[i];
+        }
+      }
+
+      for(int i=0; i<bounds.lower.size(); i++){
+        if( bounds.assignment[i] == maxIndex ){
+          bounds.lower[i] -= secondDelta;
+        }
+        else{
+          bounds.lower[i] -= maxDelta;
+        }
+      }
+
     };
 
-    ~Kmeans(){};
 
 
 
-    std::vector< KmeansCenter<TPrecision> > run( int nClusters, KmeansData<TPrecision> &data ){
-      if(nClusters > data.getNumberOfPoints() ){
-        nClusters = data.getNumberOfPoints();
+    //Squared Euclidean assignment computed as ||x||^2 - 2 C^T x + ||c||^2 over
+    //blocks of points with a matrix product. Blocks are processed in parallel
+    //with per thread sums for the mean update.
+    void updateBlocked( std::vector< KmeansCenter<TPrecision> > &centers,
+        const MatrixXp &X ){
+
+      int k = centers.size();
+      int d = X.rows();
+      long n = X.cols();
+
+      MatrixXp C(d, k);
+      VectorXp cNorm(k);
+      for(int j=0; j<k; j++){
+        C.col(j) = centers[j].center;
+        cNorm(j) = C.col(j).squaredNorm();
       }
 
-      std::vector<int> perm = Random<int>::PermutationFisherYates( data.getNumberOfPoints() );
+      int nThreads = Parallel::getNumberOfThreads(n, blockSize);
+      std::vector<MatrixXp> sums(nThreads, MatrixXp::Zero(d, k) );
+      std::vector< std::vector<int> > counts(nThreads, std::vector<int>(k, 0) );
+      std::vector< std::vector<TPrecision> > mse(nThreads, std::vector<TPrecision>(k, 0) );
+      std::vector< std::vector<TPrecision> > radius(nThreads, std::vector<TPrecision>(k, 0) );
+      std::vector<int> assignment(n);
+
+      Parallel::forBlocks(n, blockSize, [&](int t, long begin, long end){
+          MatrixXp D = C.transpose() * X.middleCols(begin, end-begin);
+          for(long i=begin; i<end; i++){
+            TPrecision dist = std::numeric_limits<TPrecision>::max();
+            int index = -1;
+            for(int j=0; j<k; j++){
+              TPrecision tmp = cNorm(j) - 2 * D(j, i-begin);
+              if(tmp < dist){
+                dist = tmp;
+                index = j;
+              }
+            }
+            //exact distance to the closest center, avoids cancellation
+            dist = ( X.col(i) - C.col(index) ).squaredNorm();
+
+            assignment[i] = index;
+            sums[t].col(index) += X.col(i);
+            counts[t][index]++;
+            mse[t][index] += dist;
+            radius[t][index] = std::max(radius[t][index], dist);
+          }
+      } );
 
-      std::vector< VectorXp > centers( nClusters );
-      for(int i=0; i<nClusters; i++){
-        centers[i] = data.getPoint( perm[i] );
+      for(long i=0; i<n; i++){
+        centers[ assignment[i] ].points.push_back(i);
+      }
+
+      for(int j=0; j<k; j++){
+        VectorXp sum = VectorXp::Zero(d);
+        int count = 0;
+        for(int t=0; t<nThreads; t++){
+          sum += sums[t].col(j);
+          count += counts[t][j];
+          centers[j].mse += mse[t][j];
+          centers[j].radius = std::max( centers[j].radius, radius[t][j] );
+        }
+        centers[j].center = sum / count;
       }
 
-      return run(centers, data);
     };
 
 
 
-    std::vector< KmeansCenter<TPrecision> > run( std::vector< VectorXp > &centers, KmeansData<TPrecision> &data ){
-      std::vector< KmeansCenter<TPrecision> > km( centers.size() );
-      for(int i=0; i<km.size(); i++){
-        km[i].center = centers[i];
+
+    //2-means on the points of a single center, returns less than two centers
+    //if the points can not be split
+    std::vector< KmeansCenter<TPrecision> > bisect( KmeansCenter<TPrecision> &c,
+        KmeansData<TPrecision> &data ){
+
+      SubsetKmeansData<TPrecision> sub(data, c.points);
+      std::vector< KmeansCenter<TPrecision> > km;
+      std::vector< VectorXp > seeds = seed(2, sub);
+      if(seeds.size() < 2){
+        return km;
       }
-      return run(km, data);
+      km = run(seeds, sub);
+
+      for(int j=0; j<km.size(); j++){
+        std::vector<int> &pts = km[j].points;
+        if(pts.empty()){
+          km.clear();
+          return km;
+        }
+        for(int i=0; i<pts.size(); i++){
+          pts[i] = c.points[ pts[i] ];
+        }
+      }
+      return km;
     };
 
 
 
-    std::vector< KmeansCenter<TPrecision> > run( std::vector< KmeansCenter<TPrecision> > centers,
-                                                 KmeansData<TPrecision> &data ){
+    //Remove center index and move its points to the closest remaining
+    //centers. Only the centers receiving points are updated.
+    void merge( std::vector< KmeansCenter<TPrecision> > &km, int index,
+        KmeansData<TPrecision> &data ){
+
+      std::vector<int> pts;
+      pts.swap( km[index].points );
+      km.erase( km.begin() + index );
+      if( km.empty() ){
+        return;
+      }
+
+      std::vector<bool> changed(km.size(), false);
+      for(int i=0; i<pts.size(); i++){
+        TPrecision dist = std::numeric_limits<TPrecision>::max();
+        int closest = 0;
+        for(int j=0; j<km.size(); j++){
+          TPrecision tmp = data.getSquaredSimilarity(pts[i], km[j].center);
+          if(tmp < dist){
+            dist = tmp;
+            closest = j;
+          }
+        }
+        km[closest].points.push_back( pts[i] );
+        changed[closest] = true;
+      }
 
+      for(int j=0; j<km.size(); j++){
+        if( !changed[j] ){
+          continue;
+        }
+        KmeansCenter<TPrecision> &c = km[j];
+        c.center = data.getMean(c.points);
+        c.mse = 0;
+        c.radius = 0;
+        for(int i=0; i<c.points.size(); i++){
+          TPrecision tmp = data.getSquaredSimilarity(c.points[i], c.center);
+          c.mse += tmp;
+          c.radius = std::max(c.radius, tmp);
+        }
+        c.mse /= c.points.size();
+        c.radius = sqrt(c.radius);
+      }
+
+    };
+
+
+
+
+    std::vector< KmeansCenter<TPrecision> > iterate( std::vector< KmeansCenter<TPrecision> > centers,
+                                                 KmeansData<TPrecision> &data,
+                                                 KmeansBounds<TPrecision> &bounds ){
+
+
+      int nIter = maxIter;
+      const MatrixXp *X = data.getEuclideanPoints();
+      if( X != NULL && X->cols() > miniBatchThreshold ){
+        miniBatch(centers, *X);
+        //centers moved, previous bounds are invalid
+        bounds.reset( data.getNumberOfPoints() );
+        nIter = 1;
+      }
 
       TPrecision totalMSE = std::numeric_limits<TPrecision>::max();
       TPrecision mse = 0;
       int iter = 0;
-      for(iter=0; iter<maxIter; iter++){
+      for(iter=0; iter<nIter; iter++){
 
-        update( centers, data );
+        update( centers, data, bounds );
 
         mse = 0;
         for(int j=0; j<centers.size(); j++){
@@ -180,50 +643,149 @@ class Kmeans{
 
 
 
+  public:
+
+    Kmeans(int mIter = 100, TPrecision t = 0.01){
+      maxIter = mIter;
+      threshold = t;
+      blockSize = 1024;
+      blockedMinDimension = 8;
+      miniBatchThreshold = 1000000;
+      miniBatchSize = 1024;
+      bisecting = false;
+    };
 
-    //iteratively refine kmeans until each center has radius at most maxRadius
-    std::vector< KmeansCenter<TPrecision> > run( TPrecision maxRadius, int maxCenters,
-        KmeansData<TPrecision> &data ){
 
-      std::vector<int> perm  = Random<int>::PermutationFisherYates(data.getNumberOfPoints() );
-      std::vector< VectorXp > centers(1);
-      for(int i=0; i<centers.size(); i++){
-        centers[i] = data.getPoint( perm[i] );
+    void setBlockSize(int n){
+      blockSize = n;
+    };
+
+
+    void setBlockedMinimumDimension(int d){
+      blockedMinDimension = d;
+    };
+
+
+    void setMiniBatchThreshold(int n){
+      miniBatchThreshold = n;
+    };
+
+
+    void setMiniBatchSize(int n){
+      miniBatchSize = n;
+    };
+
+
+    void setBisecting(bool b){
+      bisecting = b;
+    };
+
+    ~Kmeans(){};
+
+
+
+    std::vector< KmeansCenter<TPrecision> > run( int nClusters, KmeansData<TPrecision> &data ){
+      if(nClusters > data.getNumberOfPoints() ){
+        nClusters = data.getNumberOfPoints();
+      }
+
+      std::vector< VectorXp > centers = seed(nClusters, data);
+
+      return run(centers, data);
+    };
+
+
+
+    std::vector< KmeansCenter<TPrecision> > run( std::vector< VectorXp > &centers, KmeansData<TPrecision> &data ){
+      std::vector< KmeansCenter<TPrecision> > km( centers.size() );
+      for(int i=0; i<km.size(); i++){
+        km[i].center = centers[i];
       }
+      return run(km, data);
+    };
+
 
-      return run(maxRadius, maxCenters, centers, data, perm, centers.size() );
+
+    std::vector< KmeansCenter<TPrecision> > run( std::vector< KmeansCenter<TPrecision> > centers,
+                                                 KmeansData<TPrecision> &data ){
+      KmeansBounds<TPrecision> bounds;
+      bounds.reset( data.getNumberOfPoints() );
+      return iterate(centers, data, bounds);
     }
 
 
 
-    std::vector< KmeansCenter<TPrecision> > run( TPrecision maxRadius, int
-        maxCenters, std::vector<VectorXp> &centers, KmeansData<TPrecision> &data
-        ){
-      std::vector<int> perm  = Random<int>::PermutationFisherYates(data.getNumberOfPoints() );
 
-      return run(maxRadius, maxCenters, centers, data, perm, 0 );
+
+
+
+    //iteratively refine kmeans until each center has radius at most maxRadius
+    std::vector< KmeansCenter<TPrecision> > run( TPrecision maxRadius, int maxCenters,
+        KmeansData<TPrecision> &data ){
+
+      std::vector< VectorXp > centers = seed(1, data);
+
+      return run(maxRadius, maxCenters, centers, data);
     }
 
 
 
+    //Centers with radius above maxRadius get an additional center sampled
+    //kmeans++ style from their points
     std::vector< KmeansCenter<TPrecision> > run( TPrecision maxRadius, int
-        maxCenters, std::vector<VectorXp> &centers, KmeansData<TPrecision> &data,
-        std::vector<int> &permutation, int index
+        maxCenters, std::vector<VectorXp> &centers, KmeansData<TPrecision> &data
         ){
 
       maxCenters = std::min( maxCenters, data.getNumberOfPoints() );
-      std::vector< KmeansCenter<TPrecision> > km = run(centers, data);
+
+      std::vector< KmeansCenter<TPrecision> > km( centers.size() );
+      for(int i=0; i<km.size(); i++){
+        km[i].center = centers[i];
+      }
+      KmeansBounds<TPrecision> bounds;
+      bounds.reset( data.getNumberOfPoints() );
+      km = iterate(km, data, bounds);
+
+      if(bisecting){
+        //split the center with the largest radius until all are within
+        //maxRadius
+        std::vector<bool> splittable(km.size(), true);
+        while( km.size() < maxCenters ){
+          int index = -1;
+          TPrecision r = maxRadius;
+          for(int i=0; i<km.size(); i++){
+            if( splittable[i] && km[i].radius > r ){
+              r = km[i].radius;
+              index = i;
+            }
+          }
+          if(index == -1){
+            break;
+          }
+
+          std::vector< KmeansCenter<TPrecision> > split = bisect(km[index], data);
+          if(split.size() < 2){
+            splittable[index] = false;
+            continue;
+          }
+          km[index] = split[0];
+          km.push_back( split[1] );
+          splittable.push_back(true);
+        }
+        return km;
+      }
+
       bool added = true;
       while(added && km.size() < maxCenters ){
         added = false;
+        int first = km.size();
 
         for(int i=0; i<km.size(); i++){
           KmeansCenter<TPrecision> &c = km[i];
 
           if(c.radius > maxRadius){
             KmeansCenter<TPrecision> add;
-            add.center = data.getPoint( permutation[index] );
-            ++index;
+            add.center = seed(c, data);
             km.push_back(add);
             added=true;
             if( km.size() == maxCenters){
@@ -234,7 +796,8 @@ class Kmeans{
         }
 
         if(added){
-          km = run(km, data);
+          bounds.addCenters(km, first, data);
+          km = iterate(km, data, bounds);
         }
       }
 
@@ -247,11 +810,8 @@ class Kmeans{
     std::vector< KmeansCenter<TPrecision> > run( int maxCenters,
         KmeansData<TPrecision> &data, int minPoints ){
 
-      std::vector<int> perm = Random<int>::PermutationFisherYates( data.getNumberOfPoints() );
-      std::vector< VectorXp > centers( std::min( maxCenters, (int)  perm.size() ) );
-      for(int i=0; i<centers.size(); i++){
-        centers[i] = data.getPoint( perm[i] );
-      }
+      std::vector< VectorXp > centers = seed( std::min( maxCenters,
+            data.getNumberOfPoints() ), data );
 
       return run(centers, data, minPoints);
     }
@@ -264,20 +824,32 @@ class Kmeans{
     std::vector< KmeansCenter<TPrecision> > run( std::vector<VectorXp>
         &centers, KmeansData<TPrecision> &data, int minPoints){
 
-      std::vector< KmeansCenter<TPrecision> > km = run(centers, data);
+      std::vector< KmeansCenter<TPrecision> > km( centers.size() );
+      for(int i=0; i<km.size(); i++){
+        km[i].center = centers[i];
+      }
+      KmeansBounds<TPrecision> bounds;
+      bounds.reset( data.getNumberOfPoints() );
+      km = iterate(km, data, bounds);
+
       bool toMany = true;
       while( toMany  ){
         toMany=false;
-        for(typename std::vector< KmeansCenter<TPrecision> >::iterator it =
-            km.begin(); it != km.end(); ++it){
-          if( (*it).points.size() < minPoints ){
+        for(int i=0; i<km.size(); i++){
+          if( km[i].points.size() < minPoints ){
             toMany = true;
-            km.erase(it);
+            if(bisecting){
+              merge(km, i, data);
+            }
+            else{
+              km.erase(km.begin() + i);
+              bounds.removeCenter(i);
+            }
             break;
           }
         }
-        if(toMany){
-          km = run(km, data);
+        if(toMany && !bisecting){
+          km = iterate(km, data, bounds);
         }
       }
 
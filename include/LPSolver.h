@@ -3,6 +3,8 @@
 
 #include "MultiscaleTransport.h"
 
+#include <vector>
+
 class LPSolver {
   public:
 
@@ -19,8 +21,31 @@ class LPSolver {
 
     virtual ~LPSolver(){};
 
+    //New solver with the same settings for solving another LP concurrently,
+    //NULL if not supported. The caller owns the solver.
+    virtual LPSolver *createSolver(){
+      return NULL;
+    };
+
     virtual void solveLP() = 0;
     virtual bool isOptimal() = 0;
+
+    //Solve independent parts of the LP separately, if supported
+    virtual void setDecomposeComponents(bool decompose){
+    };
+
+    //Solve the LP again after columns were added starting from the previous
+    //solution, improved by n sweeps over blocks of the LP first, if
+    //supported. -1 solves from scratch.
+    virtual void setBlockSweeps(int n){
+    };
+
+    //Checks whether the LP has a feasible solution without solving it. If
+    //not, adds to blocking columns from first on whose upper bounds are part
+    //of the reason. Solvers without a check report the LP as feasible.
+    virtual bool isFeasible(std::vector<long> &blocking, long first = 0){
+      return true;
+    };
     virtual long getNumberOfRows() = 0;
     virtual long getNumberOfColumns() = 0;
     virtual double getObjectiveValue() = 0;
@@ -35,6 +60,13 @@ class LPSolver {
     virtual void addRows(long n) = 0;
    
     virtual double getRowDual(long row) = 0;
+
+    //Factor f of the duals of a network LP whose largest column cost is
+    //maxCost, dual(s) - dual(t) = f * cost for a basic column from row s to
+    //row t. Used to report potentials of LPs solved without the solver.
+    virtual double getDualScaling(double maxCost){
+      return 1;
+    };
     virtual double getColumnPrimal(long col) = 0;
    
     virtual void setRowBounds(long row, double mass) = 0;
@@ -0,0 +1,276 @@
+#ifndef LSHGMRANEIGHBORHOOD_H
+#define LSHGMRANEIGHBORHOOD_H
+
+#include "GMRATree.h"
+#include "GMRANeighborhood.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+
+
+//Approximate neighborhood search for high dimensional node centers with
+//locality sensitive hashing. Each scale has its own index over the nodes a
+//tree search with that stop scale can return: the nodes of the scale and the
+//leaves of coarser scales. An index has nTables tables, each hashing the
+//node centers by nHashes Gaussian random projections a^T x + b bucketed with
+//width w. The width is bucketWidth times the median local radius of the
+//parents of the nodes of the scale. The neighborhood strategies query with
+//radii of a few parent local radii.
+//
+//A query collects the nodes sharing a bucket with it in any table and keeps
+//those within eps, there are no false positives. Two centers at distance r
+//share a bucket of a single projection with probability
+//p(r) = 1 - 2 Phi(-w/r) - 2 r / (sqrt(2 pi) w) (1 - exp(-w^2 / (2 r^2))),
+//so a neighbor is found with probability 1 - (1 - p(r)^nHashes)^nTables.
+//More tables or a larger width increase the recall, more hashes decrease
+//the number of candidates. Levels with fewer than minLevelSize nodes are
+//scanned linearly.
+//
+//The index is built on the first query from the tree at that time, queries
+//on the transport levels need the decorated tree, i.e. buildTransportLevels
+//has to be called before. Call reset after changing the tree,
+//GMRAMultiscaleTransportLevel::updateTransportLevels does so. Queries are
+//safe to run concurrently.
+template <typename TPrecision>
+class LSHGMRANeighborhood : public GMRANeighborhood<TPrecision>{
+
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+    int nTables;
+    int nHashes;
+    TPrecision bucketWidth;
+    int minLevelSize;
+    unsigned long seed;
+
+
+  private:
+    typedef typename GMRANeighborhood<TPrecision>::Neighbor Neighbor;
+    typedef typename GMRANeighborhood<TPrecision>::NeighborList NeighborList;
+
+    typedef typename GMRANode<TPrecision>::NodeVector  NodeVector;
+
+    typedef std::unordered_map< uint64_t, std::vector<int> > Table;
+
+
+    struct Level{
+      NodeVector nodes;
+      //projections of table l are rows l*nHashes to (l+1)*nHashes-1
+      MatrixXp A;
+      VectorXp b;
+      TPrecision width;
+      std::vector<Table> tables;
+    };
+
+    mutable std::vector<Level> levels;
+    mutable std::atomic<bool> built;
+    mutable std::mutex buildMutex;
+
+
+
+    static uint64_t hashCell(uint64_t h, int64_t cell){
+      uint64_t x = h ^ ( (uint64_t) cell + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2) );
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      return x ^ (x >> 31);
+    };
+
+
+
+    void build() const{
+      levels.clear();
+      GMRANode<TPrecision> *root = this->tree->getRoot();
+      if(root == NULL){
+        return;
+      }
+
+      //nodes a tree search stops at, by scale
+      NodeVector queue(1, root);
+      int maxScale = 0;
+      std::vector<NodeVector> byScale;
+      std::vector<NodeVector> leavesByScale;
+      for(int i=0; i<queue.size(); i++){
+        GMRANode<TPrecision> *node = queue[i];
+        int s = node->getScale();
+        maxScale = std::max(maxScale, s);
+        if( byScale.size() <= s ){
+          byScale.resize(s+1);
+          leavesByScale.resize(s+1);
+        }
+        byScale[s].push_back(node);
+        NodeVector &kids = node->getChildren();
+        if( node->isStop() || kids.empty() ){
+          leavesByScale[s].push_back(node);
+        }
+        else{
+          queue.insert( queue.end(), kids.begin(), kids.end() );
+        }
+      }
+
+      std::mt19937_64 generator(seed);
+      std::normal_distribution<TPrecision> normal;
+      std::uniform_real_distribution<TPrecision> uniform(0, 1);
+      int dim = root->getCenter().size();
+      levels.resize(maxScale+1);
+      for(int s=0; s<=maxScale; s++){
+        Level &level = levels[s];
+        level.nodes = byScale[s];
+        for(int k=0; k<s; k++){
+          level.nodes.insert( level.nodes.end(), leavesByScale[k].begin(),
+              leavesByScale[k].end() );
+        }
+        if( level.nodes.size() < minLevelSize ){
+          continue;
+        }
+
+        std::vector<TPrecision> radii;
+        for(int i=0; i<byScale[s].size(); i++){
+          GMRANode<TPrecision> *parent = byScale[s][i]->getParent();
+          if(parent != NULL){
+            radii.push_back( parent->getLocalRadius() );
+          }
+        }
+        level.width = 0;
+        if( !radii.empty() ){
+          std::nth_element(radii.begin(), radii.begin() + radii.size()/2, radii.end() );
+          level.width = bucketWidth * radii[ radii.size()/2 ];
+        }
+        if( level.width <= 0 ){
+          level.width = 1;
+        }
+
+        level.A.resize(nTables * nHashes, dim);
+        level.b.resize(nTables * nHashes);
+        for(int i=0; i<level.A.rows(); i++){
+          for(int j=0; j<dim; j++){
+            level.A(i, j) = normal(generator);
+          }
+          level.b(i) = uniform(generator) * level.width;
+        }
+
+        MatrixXp C(dim, level.nodes.size() );
+        for(int i=0; i<level.nodes.size(); i++){
+          C.col(i) = level.nodes[i]->getCenter();
+        }
+        MatrixXp P = level.A * C;
+        P.colwise() += level.b;
+
+        level.tables.resize(nTables);
+        Parallel::forBlocks(nTables, 1, [&](int t, long begin, long end){
+            for(long l=begin; l<end; l++){
+              Table &table = level.tables[l];
+              for(int i=0; i<level.nodes.size(); i++){
+                uint64_t h = l;
+                for(int j=0; j<nHashes; j++){
+                  h = hashCell(h, (int64_t) std::floor( P(l*nHashes + j, i) / level.width ) );
+                }
+                table[h].push_back(i);
+              }
+            }
+        } );
+      }
+    };
+
+
+
+    int collect(GMRANode<TPrecision> *x, TPrecision eps, const NodeVector &nodes,
+        const std::vector<int> &candidates, NeighborList &result) const{
+      int nCollected = 0;
+      for(int i=0; i<candidates.size(); i++){
+        GMRANode<TPrecision> *node = nodes[ candidates[i] ];
+        TPrecision d = this->dist->distance(node, x);
+        if( d <= eps ){
+          result.push_back( Neighbor(d, node) );
+          nCollected++;
+        }
+      }
+      return nCollected;
+    };
+
+
+
+  public:
+
+    LSHGMRANeighborhood(GMRATree<TPrecision> *t, NodeDistance<TPrecision> *d) :
+      GMRANeighborhood<TPrecision>(t, d), built(false){
+      nTables = 16;
+      nHashes = 6;
+      bucketWidth = 4;
+      minLevelSize = 256;
+      seed = 0;
+    };
+
+    virtual ~LSHGMRANeighborhood(){
+    };
+
+
+
+    //Discards the index, it is rebuilt on the next query
+    virtual void reset(){
+      std::lock_guard<std::mutex> lock(buildMutex);
+      levels.clear();
+      built = false;
+    };
+
+
+
+    int neighbors(GMRANode<TPrecision> *x, TPrecision eps, NeighborList
+        &result, int stopScale = std::numeric_limits<int>::max() ) const{
+
+      if( !built ){
+        std::lock_guard<std::mutex> lock(buildMutex);
+        if( !built ){
+          build();
+          built = true;
+        }
+      }
+      if( levels.empty() ){
+        return 0;
+      }
+
+      Level &level = levels[ std::min( stopScale, (int) levels.size()-1 ) ];
+      std::vector<int> candidates;
+
+      VectorXp &center = x->getCenter();
+      bool scan = level.tables.empty() || center.size() != level.A.cols();
+      if(!scan){
+        VectorXp p = level.A * center + level.b;
+        for(int l=0; l<nTables; l++){
+          uint64_t h = l;
+          for(int j=0; j<nHashes; j++){
+            h = hashCell(h, (int64_t) std::floor( p(l*nHashes + j) / level.width ) );
+          }
+          typename Table::const_iterator it = level.tables[l].find(h);
+          if( it != level.tables[l].end() ){
+            candidates.insert( candidates.end(), it->second.begin(), it->second.end() );
+          }
+        }
+      }
+
+      if(scan){
+        candidates.resize( level.nodes.size() );
+        for(int i=0; i<candidates.size(); i++){
+          candidates[i] = i;
+        }
+      }
+      else{
+        std::sort( candidates.begin(), candidates.end() );
+        candidates.erase( std::unique( candidates.begin(), candidates.end() ),
+            candidates.end() );
+      }
+
+      return collect(x, eps, level.nodes, candidates, result);
+    };
+
+};
+
+
+#endif
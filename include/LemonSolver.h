@@ -4,9 +4,16 @@
 #define LEMONSOLVER_H
 
 #include "LPSolver.h"
+#include "Parallel.h"
 
 #include <lemon/smart_graph.h>
 #include <lemon/network_simplex.h>
+#include <lemon/circulation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 class LemonSolver : public LPSolver{
 
@@ -33,6 +40,11 @@ class LemonSolver : public LPSolver{
     long ns;
     long nt;
     bool success;
+    bool decompose;
+    int nSweeps;
+
+    //primal is the solution of the LP before columns were added
+    bool warm;
 
 
 
@@ -43,6 +55,9 @@ class LemonSolver : public LPSolver{
       ns = 0;
       nt = 0;
       success = false;
+      decompose = false;
+      nSweeps = -1;
+      warm = false;
     };
 
     ~LemonSolver(){
@@ -50,6 +65,85 @@ class LemonSolver : public LPSolver{
     };
 
 
+    virtual LPSolver *createSolver(){
+      LemonSolver *res = new LemonSolver();
+      res->decompose = decompose;
+      res->nSweeps = nSweeps;
+      return res;
+    };
+
+
+    //Solve the connected components of the network separately and
+    //concurrently, see solveComponents
+    virtual void setDecomposeComponents(bool d){
+      decompose = d;
+    };
+
+
+    //Number of block sweeps before solving an LP from the solution of the
+    //previous solve, see solveFromPrimal, -1 solves each LP from scratch
+    virtual void setBlockSweeps(int n){
+      nSweeps = n;
+    };
+
+
+    //Network of a block of a block sweep with the rows numbered within the
+    //block, the supply is the net flow of the columns of the block, see
+    //sweepBlocks
+    struct SweepBlock{
+      long nRows;
+      std::vector<long> source;
+      std::vector<long> target;
+      std::vector<long long> lower;
+      std::vector<long long> capacity;
+      std::vector<long long> cost;
+      std::vector<long long> supply;
+    };
+
+
+    //Optimal flow of the columns of a block, false if the block has less than
+    //two columns or no optimal flow
+    static bool solveSweepBlock(const SweepBlock &block, std::vector<long long> &flow){
+      using namespace lemon;
+
+      if( block.source.size() < 2 ){
+        return false;
+      }
+      SmartDigraph g;
+      g.reserveNode( block.nRows );
+      g.reserveArc( block.source.size() );
+      for(long j=0; j<block.nRows; j++){
+        g.addNode();
+      }
+      IntNodeMap bSupply(g, 0);
+      IntArcMap bLower(g), bCapacity(g), bCost(g);
+      for(long j=0; j<block.nRows; j++){
+        bSupply[ g.nodeFromId(j) ] = block.supply[j];
+      }
+      for(long j=0; j<block.source.size(); j++){
+        SmartDigraph::Arc a = g.addArc( g.nodeFromId( block.source[j] ),
+            g.nodeFromId( block.target[j] ) );
+        bLower[a] = block.lower[j];
+        bCapacity[a] = block.capacity[j];
+        bCost[a] = block.cost[j];
+      }
+
+      NetworkSimplex<SmartDigraph, long long> simplex(g);
+      simplex.upperMap(bCapacity);
+      simplex.lowerMap(bLower);
+      simplex.costMap(bCost);
+      simplex.supplyMap(bSupply);
+      if( simplex.run() != NetworkSimplex<SmartDigraph, long long>::OPTIMAL ){
+        return false;
+      }
+      flow.resize( block.source.size() );
+      for(long j=0; j<flow.size(); j++){
+        flow[j] = simplex.flow( g.arcFromId(j) );
+      }
+      return true;
+    };
+
+
 
 
    virtual void solveLP(){
@@ -57,21 +151,10 @@ class LemonSolver : public LPSolver{
      using namespace lemon;
 
      SmartDigraph graph;
-     typedef SmartDigraph::Node Node;
-     typedef SmartDigraph::NodeIt NodeIt;
      typedef SmartDigraph::Arc Arc;
-     typedef SmartDigraph::ArcIt ArcIt;
-     typedef SmartDigraph::InArcIt InArcIt;
-     typedef SmartDigraph::OutArcIt OutArcIt;
-     typedef SmartDigraph::NodeMap<long long> IntNodeMap;
-     typedef SmartDigraph::ArcMap<long long> IntArcMap;
-
-     long status;
 
      //Lemon allwos integer only:
      //Scale cost and capacities
-     static const long long maxVal = 10000000000L;
-
      double costScaling = 0;
      for(long i=0; i<coeff.size(); i++){
        if(coeff[i] > costScaling){
@@ -79,114 +162,36 @@ class LemonSolver : public LPSolver{
        }
      }
      if( costScaling == 0){
-       costScaling = maxVal;
+       costScaling = maxValue();
      }
      else{
-       costScaling = ((double) maxVal ) / costScaling;
-     }
-
-
-     double mPositive = 0;
-     double mNegative = 0;
-     for(long i=0; i < mass.size(); i++){
-        double m = mass[i];
-        if( m > 0 ){
-          mPositive += m;
-        }
-        else{
-          mNegative += m;
-        }
+       costScaling = ((double) maxValue() ) / costScaling;
      }
-     double maxCapacity = std::max( mPositive, -mNegative);
-     double capacityScaling = ((double) maxVal ) / maxCapacity;
 
 #ifdef VERBOSE
-     std::cout << "capacityScaling: "<< capacityScaling << std::endl;
      std::cout << "costScaling: "<< costScaling << std::endl;
 #endif
 
-     //Setup nodes
-     long long massPositive = 0;
-     long long massNegative = 0;
-     graph.reserveNode( mass.size() +1 );
-     for(long i=0; i <= mass.size(); i++){
-        graph.addNode();
-     }
      IntNodeMap supply(graph);
-
-     long long maxMass = 0;
-     int maxMassID = -1;
-     long long minMass = 0;
-     int minMassID = -1;
-     for(long i=0; i<mass.size(); i++){
-        long long m = (long long) ( mass[i] * capacityScaling );
-        //double m = mass[i];
-        supply[ graph.nodeFromId(i) ] = m;
-
-        if( m > 0 ){
-          massPositive += m;
-        }
-        else{
-          massNegative += m;
-        }
-
-        if( m > maxMass ){
-          maxMass = m;
-          maxMassID = i;
-        }
-        if( m < minMass ){
-          minMass = m;
-          minMassID = i;
-        }
-
-     }
-
-     long long massImbalance = massPositive + massNegative;
-     if(massImbalance > 0 ){
-       supply[ graph.nodeFromId(maxMassID) ] = maxMass - massImbalance;
-     }
-     if(massImbalance < 0 ){
-       supply[ graph.nodeFromId(minMassID) ] = minMass - massImbalance;
-     }
-     
-#ifdef VERBOSE
-       std::cout << "Mass positive: " << massPositive << std::endl;
-       std::cout << "Mass negative: " << massNegative << std::endl;
-       std::cout << "Mass imbalance: " << massImbalance << std::endl;
-       std::cout << "Max  Mass: " << maxMass<< std::endl;
-       std::cout << "Min  Mass: " << minMass<< std::endl;
-       std::cout << "Max  Mass ID: " << maxMassID<< std::endl;
-       std::cout << "Min  Mass ID: " << minMassID<< std::endl;
-#endif
-
-     
-
-
-     graph.reserveArc( sInd.size()  );
-
-
-     //Add regular node
-     for( long i=0; i < sInd.size(); i++){
-       graph.addArc( graph.nodeFromId(sInd[i]), graph.nodeFromId(tInd[i]) );
-     }
-
      IntArcMap capacity(graph), lower(graph), cost(graph);
+     double capacityScaling = setupNetwork(graph, supply, lower, capacity);
      for( long i=0; i < coeff.size(); i++){
        Arc a = graph.arcFromId(i);
-       if( colUB[i] > maxCapacity ){
-         capacity[a] = (long long) (capacityScaling * maxCapacity ) + 1;
-       }
-       else{
-         capacity[a] = (long long) (capacityScaling * colUB[i] ) + 1;
-       }
-       //capacity[a] = colUB[i];
-       lower[a] = (long long) std::max( 0LL, (long long) (capacityScaling * colLB[i] ) -1 );
-       //lower[a] = colLB[i];
        cost[a] = (long long)( costScaling * coeff[i] );
        //cost[a] = coeff[i];
      }
 
 
+     if( decompose && solveComponents(graph, supply, lower, capacity, cost,
+           capacityScaling, costScaling) ){
+       warm = success;
+       return;
+     }
+     if( nSweeps >= 0 && warm && solveFromPrimal(graph, supply, lower, capacity,
+           cost, capacityScaling, costScaling) ){
+       return;
+     }
+
      //Solve
      NetworkSimplex<SmartDigraph, long long> simplex(graph);
      simplex.upperMap(capacity);
@@ -216,8 +221,81 @@ class LemonSolver : public LPSolver{
      for(long i=0; i<dual.size(); i++){
        dual[i] = simplex.potential( graph.nodeFromId(i) );
      }
+     warm = success;
+
+
+   };
+
+
+
+   //Checks with a circulation on the network of solveLP whether the LP is
+   //feasible. If not, the preflow of the circulation leaves excess at rows
+   //whose supply cannot be carried out. For each such row the saturated
+   //bounded column leaving it with the largest capacity is added to
+   //blocking, if there is none, the bounded column with the largest
+   //capacity leaving the barrier. Only columns from first on are
+   //considered.
+   virtual bool isFeasible(std::vector<long> &blocking, long first = 0){
+
+     using namespace lemon;
+
+     typedef SmartDigraph::NodeIt NodeIt;
+     typedef SmartDigraph::Arc Arc;
+     typedef SmartDigraph::InArcIt InArcIt;
+     typedef SmartDigraph::OutArcIt OutArcIt;
+
+     SmartDigraph graph;
+     IntNodeMap supply(graph);
+     IntArcMap capacity(graph), lower(graph);
+     setupNetwork(graph, supply, lower, capacity);
+
+     Circulation<SmartDigraph, IntArcMap, IntArcMap, IntNodeMap>
+       circulation(graph, lower, capacity, supply);
+     if( circulation.run() ){
+       return true;
+     }
 
+     for(NodeIt n(graph); n != INVALID; ++n){
+       long long excess = supply[n];
+       for(OutArcIt a(graph, n); a != INVALID; ++a){
+         excess -= circulation.flow(a);
+       }
+       for(InArcIt a(graph, n); a != INVALID; ++a){
+         excess += circulation.flow(a);
+       }
+       if(excess <= 0){
+         continue;
+       }
+       Arc maxArc = INVALID;
+       for(OutArcIt a(graph, n); a != INVALID; ++a){
+         if( graph.id(a) >= first && isBounded(graph, a) &&
+             circulation.flow(a) == capacity[a] &&
+             (maxArc == INVALID || capacity[a] > capacity[maxArc]) ){
+           maxArc = a;
+         }
+       }
+       if(maxArc != INVALID){
+         blocking.push_back( graph.id(maxArc) );
+       }
+     }
+     if( !blocking.empty() ){
+       return false;
+     }
 
+     Arc maxArc = INVALID;
+     for(long i=first; i<sInd.size(); i++){
+       Arc a = graph.arcFromId(i);
+       if( isBounded(graph, a) &&
+           circulation.barrier( graph.nodeFromId( sInd[i] ) ) &&
+           !circulation.barrier( graph.nodeFromId( tInd[i] ) ) &&
+           (maxArc == INVALID || capacity[a] > capacity[maxArc]) ){
+         maxArc = a;
+       }
+     }
+     if(maxArc != INVALID){
+       blocking.push_back( graph.id(maxArc) );
+     }
+     return false;
    };
 
 
@@ -349,13 +427,737 @@ class LemonSolver : public LPSolver{
      return dual[row];
    };
 
+   //Potentials of the integer costs, with the sign of the network simplex
+   virtual double getDualScaling(double maxCost){
+     if(maxCost <= 0){
+       return -(double) maxValue();
+     }
+     return -( (double) maxValue() ) / maxCost;
+   };
+
    virtual Status getRowStatus(long row){
      return rowStatus[row];
    };
 
 
 
+  protected:
+
+   //Solves the blocks of a sweep concurrently, the flow of a block is left
+   //empty if it has none, see solveSweepBlock. The blocks are independent,
+   //a subclass can solve them elsewhere, e.g. in other processes.
+   virtual void solveSweepBlocks(std::vector<SweepBlock> &blocks,
+       std::vector< std::vector<long long> > &flows){
+     Parallel::forBlocks(blocks.size(), 1, [&](int t, long begin, long end){
+         for(long b=begin; b<end; b++){
+           if( !solveSweepBlock( blocks[b], flows[b] ) ){
+             flows[b].clear();
+           }
+         }
+     } );
+   };
+
+
+
   private:
+
+   typedef lemon::SmartDigraph::NodeMap<long long> IntNodeMap;
+   typedef lemon::SmartDigraph::ArcMap<long long> IntArcMap;
+
+
+   static long long maxValue(){
+     return 10000000000L;
+   };
+
+
+
+   //Solves the connected components of the network separately and
+   //concurrently, the solution is that of the whole network. Rows without
+   //mass whose columns in or out all have zero upper bounds carry no flow,
+   //for the balanced transport LP these are the auxiliary rows, and the
+   //components are those of the paths. At fine scales, where the paths are
+   //local, there are often many. The scaled capacities have one unit of
+   //slack for rounding, each component gets a copy of the rows without flow
+   //and their columns to keep it. The potentials of a component are
+   //determined up to a constant, they are aligned through the shared rows,
+   //see alignPotentials. Returns false if there are less than two
+   //components or one is infeasible, the whole network is then solved, as
+   //its flow is used even if infeasible.
+   bool solveComponents(lemon::SmartDigraph &graph, IntNodeMap &supply,
+       IntArcMap &lower, IntArcMap &capacity, IntArcMap &cost,
+       double capacityScaling, double costScaling){
+
+     using namespace lemon;
+
+     typedef SmartDigraph::Node Node;
+     typedef SmartDigraph::Arc Arc;
+
+     long nNodes = graph.nodeNum();
+     long nArcs = sInd.size();
+
+     //rows that carry no flow
+     std::vector<char> live(nNodes, 1);
+     bool changed = true;
+     while(changed){
+       changed = false;
+       std::vector<int> nIn(nNodes, 0);
+       std::vector<int> nOut(nNodes, 0);
+       for(long i=0; i<nArcs; i++){
+         if( colUB[i] > 0 && live[ sInd[i] ] && live[ tInd[i] ] ){
+           nOut[ sInd[i] ]++;
+           nIn[ tInd[i] ]++;
+         }
+       }
+       for(long i=0; i<nNodes; i++){
+         bool empty = i >= mass.size() || mass[i] == 0;
+         if( live[i] && empty && (nIn[i] == 0 || nOut[i] == 0) ){
+           live[i] = 0;
+           changed = true;
+         }
+       }
+     }
+
+     //components of the remaining rows
+     std::vector<long> parent(nNodes);
+     for(long i=0; i<nNodes; i++){
+       parent[i] = i;
+     }
+     std::vector<long> deadNodes;
+     std::vector<long> deadArcs;
+     for(long i=0; i<nNodes; i++){
+       if( !live[i] ){
+         deadNodes.push_back(i);
+       }
+     }
+     for(long i=0; i<nArcs; i++){
+       if( !live[ sInd[i] ] && !live[ tInd[i] ] ){
+         //copies would each carry the lower bound
+         if( lower[ graph.arcFromId(i) ] > 0 ){
+           return false;
+         }
+         deadArcs.push_back(i);
+       }
+       else if( colUB[i] > 0 && live[ sInd[i] ] && live[ tInd[i] ] ){
+         long r1 = findRoot(parent, sInd[i]);
+         long r2 = findRoot(parent, tInd[i]);
+         if(r1 != r2){
+           parent[r1] = r2;
+         }
+       }
+     }
+
+     std::vector<long> component(nNodes, -1);
+     std::vector<long> position(nNodes, -1);
+     std::vector< std::vector<long> > nodes;
+     for(long i=0; i<nNodes; i++){
+       if( !live[i] ){
+         continue;
+       }
+       long r = findRoot(parent, i);
+       if( component[r] == -1 ){
+         component[r] = nodes.size();
+         nodes.push_back( std::vector<long>() );
+       }
+       component[i] = component[r];
+       position[i] = nodes[ component[i] ].size();
+       nodes[ component[i] ].push_back(i);
+     }
+     if(nodes.size() < 2){
+       return false;
+     }
+
+     //columns with a row that carries flow, by component
+     std::vector< std::vector<long> > arcs( nodes.size() );
+     for(long i=0; i<nArcs; i++){
+       long s = sInd[i];
+       long t = tInd[i];
+       if( live[s] && live[t] && component[s] != component[t] ){
+         //zero upper bound between components
+         if( lower[ graph.arcFromId(i) ] > 0 ){
+           return false;
+         }
+         continue;
+       }
+       if( live[s] ){
+         arcs[ component[s] ].push_back(i);
+       }
+       else if( live[t] ){
+         arcs[ component[t] ].push_back(i);
+       }
+     }
+     for(long i=0; i<deadNodes.size(); i++){
+       position[ deadNodes[i] ] = i;
+     }
+
+     //largest first for the load balance
+     std::vector<long> order( nodes.size() );
+     for(long i=0; i<order.size(); i++){
+       order[i] = i;
+     }
+     std::sort(order.begin(), order.end(), [&](long a, long b){
+         return arcs[a].size() > arcs[b].size();
+     } );
+
+     std::fill( primal.begin(), primal.end(), 0 );
+     std::fill( dual.begin(), dual.end(), 0 );
+     std::vector<double> costs( nodes.size(), 0 );
+     std::vector<char> solved( nodes.size(), 0 );
+     std::vector< std::vector<long long> > flows( nodes.size() );
+     std::vector< std::vector<long long> > potentials( nodes.size() );
+     Parallel::forBlocks(order.size(), 1, [&](int t, long begin, long end){
+         for(long k=begin; k<end; k++){
+           long c = order[k];
+           std::vector<long> &cNodes = nodes[c];
+           std::vector<long> &cArcs = arcs[c];
+
+           SmartDigraph g;
+           g.reserveNode( cNodes.size() + deadNodes.size() );
+           g.reserveArc( cArcs.size() + deadArcs.size() );
+           std::vector<Node> local( cNodes.size() );
+           for(long i=0; i<cNodes.size(); i++){
+             local[i] = g.addNode();
+           }
+           std::vector<Node> localDead( deadNodes.size() );
+           for(long i=0; i<deadNodes.size(); i++){
+             localDead[i] = g.addNode();
+           }
+           IntNodeMap cSupply(g, 0);
+
+           //rounding of the masses can leave the component imbalanced,
+           //balanced as for the whole network
+           long long imbalance = 0;
+           long maxID = 0;
+           long minID = 0;
+           for(long i=0; i<cNodes.size(); i++){
+             long long m = supply[ graph.nodeFromId( cNodes[i] ) ];
+             cSupply[ local[i] ] = m;
+             imbalance += m;
+             if( m > cSupply[ local[maxID] ] ){
+               maxID = i;
+             }
+             if( m < cSupply[ local[minID] ] ){
+               minID = i;
+             }
+           }
+           if( imbalance > 0 && imbalance <= nNodes ){
+             cSupply[ local[maxID] ] -= imbalance;
+           }
+           if( imbalance < 0 && -imbalance <= nNodes ){
+             cSupply[ local[minID] ] -= imbalance;
+           }
+
+           IntArcMap cLower(g), cCapacity(g), cCost(g);
+           for(long j=0; j < cArcs.size() + deadArcs.size(); j++){
+             long i = j < cArcs.size() ? cArcs[j] : deadArcs[ j - cArcs.size() ];
+             Node s = live[ sInd[i] ] ? local[ position[ sInd[i] ] ] :
+               localDead[ position[ sInd[i] ] ];
+             Node t = live[ tInd[i] ] ? local[ position[ tInd[i] ] ] :
+               localDead[ position[ tInd[i] ] ];
+             Arc a = graph.arcFromId(i);
+             Arc ca = g.addArc(s, t);
+             cLower[ca] = lower[a];
+             cCapacity[ca] = capacity[a];
+             cCost[ca] = cost[a];
+           }
+
+           NetworkSimplex<SmartDigraph, long long> simplex(g);
+           simplex.upperMap(cCapacity);
+           simplex.lowerMap(cLower);
+           simplex.costMap(cCost);
+           simplex.supplyMap(cSupply);
+           solved[c] = simplex.run() == NetworkSimplex<SmartDigraph, long long>::OPTIMAL;
+           if( !solved[c] ){
+             continue;
+           }
+           costs[c] = simplex.totalCost<double>();
+
+           flows[c].resize( cArcs.size() + deadArcs.size() );
+           for(long j=0; j<flows[c].size(); j++){
+             flows[c][j] = simplex.flow( g.arcFromId(j) );
+           }
+           potentials[c].resize( cNodes.size() );
+           for(long i=0; i<cNodes.size(); i++){
+             potentials[c][i] = simplex.potential( local[i] );
+           }
+         }
+     } );
+
+     for(long c=0; c<nodes.size(); c++){
+       if( !solved[c] ){
+         return false;
+       }
+     }
+
+     //flows of the copies add up
+     std::vector<long long> deadFlow( deadArcs.size(), 0 );
+     objValue = 0;
+     for(long c=0; c<nodes.size(); c++){
+       objValue += costs[c];
+       for(long j=0; j<arcs[c].size(); j++){
+         primal[ arcs[c][j] ] = ( (double) flows[c][j] ) / capacityScaling;
+       }
+       for(long j=0; j<deadArcs.size(); j++){
+         deadFlow[j] += flows[c][ arcs[c].size() + j ];
+       }
+     }
+     for(long j=0; j<deadArcs.size(); j++){
+       primal[ deadArcs[j] ] = ( (double) deadFlow[j] ) / capacityScaling;
+     }
+
+     if( !alignPotentials(graph, cost, nodes, arcs, deadNodes, deadArcs,
+           live, position, flows, deadFlow, potentials) ){
+       return false;
+     }
+     objValue /= capacityScaling;
+     objValue /= costScaling;
+     iCount = 1;
+     success = true;
+
+#ifdef VERBOSE
+     std::cout << "components: " << nodes.size() << std::endl;
+     std::cout << "success: " << success << std::endl;
+     std::cout << "objective: " << objValue << std::endl;
+#endif
+     return true;
+   };
+
+
+
+   //Sets the duals from the potentials of the components, each shifted by a
+   //constant, and the potentials of the shared rows such that the columns
+   //without flow between the components and the shared rows have non
+   //negative reduced costs. The duals are then optimal for the whole network
+   //and the reduced costs of columns between components are comparable, as
+   //the neighborhood strategies need. The constraints are differences of the
+   //shifts and the shared potentials, solved by shortest paths over the
+   //shared rows, a shift is tight at a column to a shared row where there is
+   //one. Returns false if the constraints are infeasible.
+   bool alignPotentials(lemon::SmartDigraph &graph, IntArcMap &cost,
+       std::vector< std::vector<long> > &nodes,
+       std::vector< std::vector<long> > &arcs, std::vector<long> &deadNodes,
+       std::vector<long> &deadArcs, std::vector<char> &live,
+       std::vector<long> &position,
+       std::vector< std::vector<long long> > &flows,
+       std::vector<long long> &deadFlow,
+       std::vector< std::vector<long long> > &potentials){
+
+     long nDead = deadNodes.size();
+     const long long inf = std::numeric_limits<long long>::max() / 4;
+
+     //in[c][d] bounds shift c minus potential d, out[c][d] potential d minus
+     //shift c
+     std::vector< std::vector<long long> > in( nodes.size(),
+         std::vector<long long>(nDead, inf) );
+     std::vector< std::vector<long long> > out( nodes.size(),
+         std::vector<long long>(nDead, inf) );
+     for(long c=0; c<nodes.size(); c++){
+       long nc = nodes[c].size();
+       for(long j=0; j<arcs[c].size(); j++){
+         long i = arcs[c][j];
+         if( flows[c][j] != 0 || colUB[i] <= 0 ){
+           continue;
+         }
+         long long w = cost[ graph.arcFromId(i) ];
+         if( !live[ tInd[i] ] ){
+           long d = position[ tInd[i] ];
+           w += potentials[c][ position[ sInd[i] ] ];
+           out[c][d] = std::min( out[c][d], w );
+         }
+         else if( !live[ sInd[i] ] ){
+           long d = position[ sInd[i] ];
+           w -= potentials[c][ position[ tInd[i] ] ];
+           in[c][d] = std::min( in[c][d], w );
+         }
+       }
+     }
+
+     //bounds between the shared rows, directly and through a component
+     std::vector< std::vector<long long> > W( nDead,
+         std::vector<long long>(nDead, inf) );
+     for(long j=0; j<deadArcs.size(); j++){
+       long i = deadArcs[j];
+       if( deadFlow[j] == 0 && colUB[i] > 0 ){
+         long d1 = position[ sInd[i] ];
+         long d2 = position[ tInd[i] ];
+         W[d1][d2] = std::min( W[d1][d2], cost[ graph.arcFromId(i) ] );
+       }
+     }
+     for(long c=0; c<nodes.size(); c++){
+       for(long d1=0; d1<nDead; d1++){
+         if( in[c][d1] == inf ){
+           continue;
+         }
+         for(long d2=0; d2<nDead; d2++){
+           if( out[c][d2] != inf ){
+             W[d1][d2] = std::min( W[d1][d2], in[c][d1] + out[c][d2] );
+           }
+         }
+       }
+     }
+
+     std::vector<long long> x(nDead, 0);
+     for(long k=0; k<=nDead; k++){
+       bool changed = false;
+       for(long d1=0; d1<nDead; d1++){
+         for(long d2=0; d2<nDead; d2++){
+           if( W[d1][d2] != inf && x[d1] + W[d1][d2] < x[d2] ){
+             x[d2] = x[d1] + W[d1][d2];
+             changed = true;
+           }
+         }
+       }
+       if( !changed ){
+         break;
+       }
+       if( k == nDead ){
+         return false;
+       }
+     }
+
+     for(long c=0; c<nodes.size(); c++){
+       std::vector<long> &cNodes = nodes[c];
+       long long shift = inf;
+       for(long d=0; d<nDead; d++){
+         if( in[c][d] != inf ){
+           shift = std::min( shift, x[d] + in[c][d] );
+         }
+       }
+       if( shift == inf ){
+         shift = -inf;
+         for(long d=0; d<nDead; d++){
+           if( out[c][d] != inf ){
+             shift = std::max( shift, x[d] - out[c][d] );
+           }
+         }
+         if( shift == -inf ){
+           shift = 0;
+         }
+       }
+       for(long i=0; i<cNodes.size(); i++){
+         if( cNodes[i] < dual.size() ){
+           dual[ cNodes[i] ] = potentials[c][i] + shift;
+         }
+       }
+     }
+     for(long d=0; d<nDead; d++){
+       if( deadNodes[d] < dual.size() ){
+         dual[ deadNodes[d] ] = x[d];
+       }
+     }
+     return true;
+   };
+
+
+
+   //Solves the LP starting from the primal of the previous solve, which the
+   //propagation and neighborhood strategies only extend by columns. The flow
+   //is first improved by nSweeps sweeps over blocks of rows, each block
+   //solved with the flows of the columns of other blocks fixed, see
+   //sweepBlocks. The final pass solves for the optimal change of the flow on
+   //the residual network, exact, the flow and the potentials are optimal for
+   //the LP. Starting from the previous solution it needs fewer pivots than
+   //solving the whole network. Returns false if the residual network is
+   //infeasible, the whole network is then solved.
+   bool solveFromPrimal(lemon::SmartDigraph &graph, IntNodeMap &supply,
+       IntArcMap &lower, IntArcMap &capacity, IntArcMap &cost,
+       double capacityScaling, double costScaling){
+
+     using namespace lemon;
+
+     typedef SmartDigraph::Arc Arc;
+
+     long nNodes = graph.nodeNum();
+     long nArcs = sInd.size();
+     std::vector<long long> x(nArcs);
+     for(long i=0; i<nArcs; i++){
+       Arc a = graph.arcFromId(i);
+       long long f = std::llround( primal[i] * capacityScaling );
+       x[i] = std::max( lower[a], std::min( capacity[a], f ) );
+     }
+
+     //small blocks are cheap to solve and many keep the threads busy,
+     //offsets alternate by half a block
+     long blockRows = 256;
+     for(int k=0; k<nSweeps; k++){
+       sweepBlocks(graph, lower, capacity, cost, x, blockRows,
+           (k % 2) * blockRows / 2 );
+     }
+
+     //residual network, column i has the forward arc fwd[i] if it can
+     //increase and the backward arc bwd[i] if it can decrease
+     SmartDigraph res;
+     res.reserveNode(nNodes);
+     res.reserveArc(2 * nArcs);
+     for(long i=0; i<nNodes; i++){
+       res.addNode();
+     }
+     IntNodeMap rSupply(res);
+     for(long i=0; i<nNodes; i++){
+       rSupply[ res.nodeFromId(i) ] = supply[ graph.nodeFromId(i) ];
+     }
+     std::vector<Arc> fwd(nArcs, INVALID);
+     std::vector<Arc> bwd(nArcs, INVALID);
+     for(long i=0; i<nArcs; i++){
+       Arc a = graph.arcFromId(i);
+       rSupply[ res.nodeFromId( sInd[i] ) ] -= x[i];
+       rSupply[ res.nodeFromId( tInd[i] ) ] += x[i];
+       if( x[i] < capacity[a] ){
+         fwd[i] = res.addArc( res.nodeFromId( sInd[i] ), res.nodeFromId( tInd[i] ) );
+       }
+       if( x[i] > lower[a] ){
+         bwd[i] = res.addArc( res.nodeFromId( tInd[i] ), res.nodeFromId( sInd[i] ) );
+       }
+     }
+     IntArcMap rCapacity(res), rCost(res);
+     for(long i=0; i<nArcs; i++){
+       Arc a = graph.arcFromId(i);
+       if( fwd[i] != INVALID ){
+         rCapacity[ fwd[i] ] = capacity[a] - x[i];
+         rCost[ fwd[i] ] = cost[a];
+       }
+       if( bwd[i] != INVALID ){
+         rCapacity[ bwd[i] ] = x[i] - lower[a];
+         rCost[ bwd[i] ] = -cost[a];
+       }
+     }
+
+     NetworkSimplex<SmartDigraph, long long> simplex(res);
+     simplex.upperMap(rCapacity);
+     simplex.costMap(rCost);
+     simplex.supplyMap(rSupply);
+     if( simplex.run() != NetworkSimplex<SmartDigraph, long long>::OPTIMAL ){
+       return false;
+     }
+
+     objValue = 0;
+     for(long i=0; i<nArcs; i++){
+       if( fwd[i] != INVALID ){
+         x[i] += simplex.flow( fwd[i] );
+       }
+       if( bwd[i] != INVALID ){
+         x[i] -= simplex.flow( bwd[i] );
+       }
+       primal[i] = ( (double) x[i] ) / capacityScaling;
+       objValue += ( (double) cost[ graph.arcFromId(i) ] ) * x[i];
+     }
+     for(long i=0; i<dual.size(); i++){
+       dual[i] = simplex.potential( res.nodeFromId(i) );
+     }
+     objValue /= capacityScaling;
+     objValue /= costScaling;
+     iCount = 1;
+     success = true;
+     warm = true;
+
+#ifdef VERBOSE
+     std::cout << "sweeps: " << nSweeps << std::endl;
+     std::cout << "success: " << success << std::endl;
+     std::cout << "objective: " << objValue << std::endl;
+#endif
+     return true;
+   };
+
+
+
+   //One sweep over blocks of blockRows rows starting at -offset. A column
+   //belongs to the block of its smaller row, for the transport LP the block
+   //of its source. The blocks are solved concurrently, each for the flow of
+   //its columns that keeps the net flow of these columns at every row. The
+   //flows of the other columns are fixed and the flow stays feasible if it
+   //was, each block decreases the cost or keeps it. Rows of a block are
+   //close in the LP when the node ids are ordered in space, see
+   //GMRAMultiscaleTransportLevel::sortNodes.
+   void sweepBlocks(lemon::SmartDigraph &graph, IntArcMap &lower,
+       IntArcMap &capacity, IntArcMap &cost, std::vector<long long> &x,
+       long blockRows, long offset){
+
+     using namespace lemon;
+
+     typedef SmartDigraph::Arc Arc;
+
+     long nArcs = sInd.size();
+     long nBlocks = ( graph.nodeNum() + offset ) / blockRows + 1;
+     std::vector< std::vector<long> > arcs(nBlocks);
+     for(long i=0; i<nArcs; i++){
+       long row = std::min( sInd[i], tInd[i] );
+       arcs[ (row + offset) / blockRows ].push_back(i);
+     }
+
+     std::vector<SweepBlock> blocks(nBlocks);
+     Parallel::forBlocks(nBlocks, 1, [&](int t, long begin, long end){
+         for(long b=begin; b<end; b++){
+           std::vector<long> &bArcs = arcs[b];
+           SweepBlock &block = blocks[b];
+           block.nRows = 0;
+           if( bArcs.size() < 2 ){
+             continue;
+           }
+           std::vector<long> rows;
+           rows.reserve( 2 * bArcs.size() );
+           for(long j=0; j<bArcs.size(); j++){
+             rows.push_back( sInd[ bArcs[j] ] );
+             rows.push_back( tInd[ bArcs[j] ] );
+           }
+           std::sort( rows.begin(), rows.end() );
+           rows.erase( std::unique( rows.begin(), rows.end() ), rows.end() );
+
+           block.nRows = rows.size();
+           block.supply.resize( rows.size(), 0 );
+           for(long j=0; j<bArcs.size(); j++){
+             long i = bArcs[j];
+             long s = std::lower_bound( rows.begin(), rows.end(), sInd[i] ) - rows.begin();
+             long r = std::lower_bound( rows.begin(), rows.end(), tInd[i] ) - rows.begin();
+             Arc a = graph.arcFromId(i);
+             block.source.push_back(s);
+             block.target.push_back(r);
+             block.lower.push_back( lower[a] );
+             block.capacity.push_back( capacity[a] );
+             block.cost.push_back( cost[a] );
+             block.supply[s] += x[i];
+             block.supply[r] -= x[i];
+           }
+         }
+     } );
+
+     std::vector< std::vector<long long> > flows(nBlocks);
+     solveSweepBlocks(blocks, flows);
+     for(long b=0; b<nBlocks; b++){
+       if( flows[b].size() != arcs[b].size() ){
+         continue;
+       }
+       for(long j=0; j<arcs[b].size(); j++){
+         x[ arcs[b][j] ] = flows[b][j];
+       }
+     }
+   };
+
+
+
+   static long findRoot(std::vector<long> &parent, long i){
+     while( parent[i] != i ){
+       parent[i] = parent[ parent[i] ];
+       i = parent[i];
+     }
+     return i;
+   };
+
+
+
+   //Column of arc has an upper bound
+   bool isBounded(lemon::SmartDigraph &graph, lemon::SmartDigraph::Arc a){
+     return colUB[ graph.id(a) ] < std::numeric_limits<double>::max();
+   };
+
+
+
+   //Adds the nodes and arcs of the LP to graph with masses and bounds scaled
+   //to integers, returns the capacity scaling
+   double setupNetwork(lemon::SmartDigraph &graph, IntNodeMap &supply,
+       IntArcMap &lower, IntArcMap &capacity){
+
+     using namespace lemon;
+
+     typedef SmartDigraph::Arc Arc;
+
+     double mPositive = 0;
+     double mNegative = 0;
+     for(long i=0; i < mass.size(); i++){
+        double m = mass[i];
+        if( m > 0 ){
+          mPositive += m;
+        }
+        else{
+          mNegative += m;
+        }
+     }
+     double maxCapacity = std::max( mPositive, -mNegative);
+     double capacityScaling = ((double) maxValue() ) / maxCapacity;
+
+#ifdef VERBOSE
+     std::cout << "capacityScaling: "<< capacityScaling << std::endl;
+#endif
+
+     //Setup nodes
+     long long massPositive = 0;
+     long long massNegative = 0;
+     graph.reserveNode( mass.size() +1 );
+     for(long i=0; i <= mass.size(); i++){
+        graph.addNode();
+     }
+
+     long long maxMass = 0;
+     int maxMassID = -1;
+     long long minMass = 0;
+     int minMassID = -1;
+     for(long i=0; i<mass.size(); i++){
+        long long m = (long long) ( mass[i] * capacityScaling );
+        //double m = mass[i];
+        supply[ graph.nodeFromId(i) ] = m;
+
+        if( m > 0 ){
+          massPositive += m;
+        }
+        else{
+          massNegative += m;
+        }
+
+        if( m > maxMass ){
+          maxMass = m;
+          maxMassID = i;
+        }
+        if( m < minMass ){
+          minMass = m;
+          minMassID = i;
+        }
+
+     }
+
+     long long massImbalance = massPositive + massNegative;
+     if(massImbalance > 0 ){
+       supply[ graph.nodeFromId(maxMassID) ] = maxMass - massImbalance;
+     }
+     if(massImbalance < 0 ){
+       supply[ graph.nodeFromId(minMassID) ] = minMass - massImbalance;
+     }
+     
+#ifdef VERBOSE
+       std::cout << "Mass positive: " << massPositive << std::endl;
+       std::cout << "Mass negative: " << massNegative << std::endl;
+       std::cout << "Mass imbalance: " << massImbalance << std::endl;
+       std::cout << "Max  Mass: " << maxMass<< std::endl;
+       std::cout << "Min  Mass: " << minMass<< std::endl;
+       std::cout << "Max  Mass ID: " << maxMassID<< std::endl;
+       std::cout << "Min  Mass ID: " << minMassID<< std::endl;
+#endif
+
+     
+
+
+     graph.reserveArc( sInd.size()  );
+
+
+     //Add regular node
+     for( long i=0; i < sInd.size(); i++){
+       graph.addArc( graph.nodeFromId(sInd[i]), graph.nodeFromId(tInd[i]) );
+     }
+
+     for( long i=0; i < coeff.size(); i++){
+       Arc a = graph.arcFromId(i);
+       if( colUB[i] > maxCapacity ){
+         capacity[a] = (long long) (capacityScaling * maxCapacity ) + 1;
+       }
+       else{
+         capacity[a] = (long long) (capacityScaling * colUB[i] ) + 1;
+       }
+       //capacity[a] = colUB[i];
+       lower[a] = (long long) std::max( 0LL, (long long) (capacityScaling * colLB[i] ) -1 );
+       //lower[a] = colLB[i];
+     }
+
+     return capacityScaling;
+   };
+
+
    
    virtual void deleteLP(){
      sInd.clear();
@@ -369,6 +1171,7 @@ class LemonSolver : public LPSolver{
      colLB.clear();
      colUB.clear();
      ns = 0;
+     warm = false;
    };
 
 
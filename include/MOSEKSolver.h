@@ -49,6 +49,11 @@ class MOSEKSolver : public LPSolver{
     };
 
 
+    virtual LPSolver *createSolver(){
+      return new MOSEKSolver(optimType);
+    };
+
+
    virtual void solveLP(){
 
      if(primal != NULL){
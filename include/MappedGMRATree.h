@@ -0,0 +1,608 @@
+#ifndef MAPPEDGMRATREE_H
+#define MAPPEDGMRATREE_H
+
+#include "GMRATree.h"
+#include "Parallel.h"
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+
+//Binary GMRA tree file layout, version 2. All arrays start at a multiple of
+//8 bytes, nodes are stored in breadth first order such that the kids of a
+//node are a contiguous range of nodes and the points of a node a contiguous
+//range of the point permutation. The header holds a checksum of the point
+//coordinates the tree was built on.
+//
+// header
+// TPrecision centers[nNodes * dimension]
+// TPrecision radius[nNodes]
+// TPrecision localRadius[nNodes]
+// TPrecision mass[nNodes]
+// int32_t    scale[nNodes]
+// int32_t    parent[nNodes]
+// int32_t    kidStart[nNodes]
+// int32_t    kidCount[nNodes]
+// int32_t    pointStart[nNodes]
+// int32_t    pointCount[nNodes]
+// int32_t    points[nPoints]
+struct GMRATreeFileHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t precisionSize;
+  int64_t nNodes;
+  int64_t dimension;
+  int64_t nPoints;
+  int64_t nDataPoints;
+  uint64_t dataChecksum;
+  int64_t reserved[2];
+};
+
+
+
+//Arrays of a mapped tree file
+template <typename TPrecision>
+struct GMRATreeFileArrays{
+  int dimension;
+  const TPrecision *centers;
+  const TPrecision *radius;
+  const TPrecision *localRadius;
+  const TPrecision *mass;
+  const int32_t *scale;
+  const int32_t *parent;
+  const int32_t *kidStart;
+  const int32_t *kidCount;
+  const int32_t *pointStart;
+  const int32_t *pointCount;
+  const int32_t *points;
+};
+
+
+
+
+//Node of a memory mapped GMRA tree. Nodes are created when their parent's
+//kids are first requested, centers and point indices are only copied out of
+//the mapped file when requested. A node owns the kids it created.
+template <typename TPrecision>
+class MappedGMRANode : public GMRANodeBase<TPrecision>{
+  public:
+    typedef typename GMRANode<TPrecision>::NodeVector NodeVector;
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+
+  private:
+    const GMRATreeFileArrays<TPrecision> *file;
+    long index;
+
+    VectorXp center;
+    NodeVector children;
+    std::vector<int> points;
+    std::once_flag centerFlag;
+    std::once_flag childrenFlag;
+    std::once_flag pointsFlag;
+    bool hasChildren;
+
+
+  public:
+
+    MappedGMRANode(const GMRATreeFileArrays<TPrecision> *f, long i) : file(f),
+      index(i), hasChildren(false){
+      this->setRadius( file->radius[index] );
+      this->setLocalRadius( file->localRadius[index] );
+      this->setMass( file->mass[index] );
+      this->setScale( file->scale[index] );
+    };
+
+    virtual ~MappedGMRANode(){
+      if(hasChildren){
+        for(int i=0; i<children.size(); i++){
+          delete children[i];
+        }
+      }
+    };
+
+
+    virtual NodeVector &getChildren(){
+      std::call_once(childrenFlag, [this](){
+          int n = file->kidCount[index];
+          children.resize(n);
+          for(int i=0; i<n; i++){
+            children[i] = new MappedGMRANode<TPrecision>(file, file->kidStart[index] + i);
+            children[i]->setParent(this);
+          }
+          hasChildren = true;
+      } );
+      return children;
+    };
+
+
+    virtual GMRANode<TPrecision> *findDescendant(const VectorXp &x ){
+      NodeVector &kids = getChildren();
+      TPrecision dist = std::numeric_limits<TPrecision>::max();
+      GMRANode<TPrecision> *closest = NULL;
+      for(int i=0; i<kids.size(); i++){
+        TPrecision tmp = (kids[i]->getCenter() - x).squaredNorm();
+        if(tmp < dist){
+          dist = tmp;
+          closest = kids[i];
+        }
+      }
+      return closest;
+    };
+
+
+    std::vector<int> &getPoints(){
+      std::call_once(pointsFlag, [this](){
+          const int32_t *pts = file->points + file->pointStart[index];
+          points.assign(pts, pts + file->pointCount[index] );
+      } );
+      return points;
+    };
+
+
+    int getIntrinsicDimension(){
+      return file->dimension;
+    };
+
+
+    VectorXp &getCenter(){
+      std::call_once(centerFlag, [this](){
+          center = Eigen::Map<const VectorXp>( file->centers + index * file->dimension,
+            file->dimension );
+      } );
+      return center;
+    };
+
+
+    virtual void translate(VectorXp &x){
+      getCenter() += x;
+    };
+
+
+    virtual void affine(MatrixXp &A){
+      getCenter() = A*getCenter();
+    };
+
+};
+
+
+
+
+//Read only GMRA tree backed by a memory mapped file written with
+//MappedGMRATree::write. Radii, local radii, masses and scales are read from
+//the file, no computeStatistics pass is needed. Loading validates the file
+//and creates the root only, the other nodes are created as the tree is
+//traversed.
+template <typename TPrecision>
+class MappedGMRATree : public GMRATree<TPrecision>{
+
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+    static const uint32_t VERSION = 2;
+
+
+  private:
+
+    const char *mapped;
+    size_t mappedSize;
+    std::vector<char> buffer;
+    GMRATreeFileArrays<TPrecision> arrays;
+
+
+    static size_t align(size_t offset){
+      return (offset + 7) & ~((size_t) 7);
+    };
+
+
+    static const char *magic(){
+      return "GMRATRE";
+    };
+
+
+
+  public:
+
+    MappedGMRATree(GMRADataObject<TPrecision> *D) : GMRATree<TPrecision>(D),
+      mapped(NULL), mappedSize(0){
+    };
+
+
+    //Nodes own the kids they created, only those are deleted before the
+    //file is unmapped
+    virtual ~MappedGMRATree(){
+      delete this->getRoot();
+      this->setRoot(NULL);
+      unmap();
+    };
+
+
+    virtual void addPoints(std::vector<int> &points){
+      std::cout << "MappedGMRATree is read only, points not added" << std::endl;
+    };
+
+
+    std::vector<GMRANode<TPrecision> *> getLeafPath(const VectorXp &x ) {
+      GMRANode<TPrecision> *node = this->getRoot();
+      std::vector<GMRANode<TPrecision> *> path;
+      while(node != NULL ){
+        path.push_back( node );
+        node = node->findDescendant( x );
+      }
+      return path;
+    };
+
+
+
+    //Map the tree file, returns false if the file can not be read, is not a
+    //valid tree file of this version and precision or was not built on the
+    //points of the data object
+    bool load(const std::string &filename){
+
+      if( this->getRoot() != NULL ){
+        std::cout << "MappedGMRATree already loaded" << std::endl;
+        return false;
+      }
+
+      if( !map(filename) ){
+        std::cout << "Unable to read GMRA tree file " << filename << std::endl;
+        return false;
+      }
+
+      if( mappedSize < sizeof(GMRATreeFileHeader) ){
+        std::cout << "Not a GMRA tree file " << filename << std::endl;
+        unmap();
+        return false;
+      }
+
+      GMRATreeFileHeader header;
+      memcpy(&header, mapped, sizeof(GMRATreeFileHeader) );
+      if( strncmp(header.magic, magic(), 8) != 0 || header.version != VERSION ||
+          header.precisionSize != sizeof(TPrecision) ){
+        std::cout << "Incompatible GMRA tree file " << filename << std::endl;
+        unmap();
+        return false;
+      }
+
+      GMRADataObject<TPrecision> *data = this->getDataObject();
+      if( header.nDataPoints != data->numberOfPoints() ||
+          header.dimension != data->dimension() ||
+          header.dataChecksum != checksum(data) ){
+        std::cout << "GMRA tree file " << filename << " does not match data" << std::endl;
+        unmap();
+        return false;
+      }
+
+      if( !setupArrays(header) || !validate(header) ){
+        std::cout << "Corrupt GMRA tree file " << filename << std::endl;
+        unmap();
+        return false;
+      }
+
+      this->setRoot( new MappedGMRANode<TPrecision>(&arrays, 0) );
+      return true;
+    };
+
+
+
+    //Checksum of the point coordinates of data, independent of the number
+    //of threads
+    static uint64_t checksum(GMRADataObject<TPrecision> *data){
+      long n = data->numberOfPoints();
+      long block = 4096;
+      long nBlocks = (n + block - 1) / block;
+      std::vector<uint64_t> hashes(nBlocks);
+      Parallel::forBlocks(n, block, [&](int t, long begin, long end){
+          uint64_t h = 14695981039346656037ULL;
+          for(long i=begin; i<end; i++){
+            VectorXp x = data->getPoint(i);
+            h = hash(h, (const unsigned char *) x.data(), x.size() * sizeof(TPrecision) );
+          }
+          hashes[begin/block] = h;
+      } );
+      return hash(14695981039346656037ULL, (const unsigned char *) hashes.data(),
+          hashes.size() * sizeof(uint64_t) );
+    };
+
+
+
+    //Write the tree to filename. Assumes the kids of a node partition its
+    //points, the points of a node are stored as the points of its leaves.
+    static bool write(GMRATree<TPrecision> *tree, const std::string &filename){
+
+      typedef std::vector< GMRANode<TPrecision> * > NodeList;
+
+      GMRANode<TPrecision> *root = tree->getRoot();
+      if(root == NULL){
+        return false;
+      }
+
+      //breadth first order
+      NodeList nodes(1, root);
+      std::vector<int32_t> parent(1, -1);
+      std::vector<int32_t> kidStart;
+      std::vector<int32_t> kidCount;
+      for(long i=0; i<nodes.size(); i++){
+        NodeList &kids = nodes[i]->getChildren();
+        kidStart.push_back( nodes.size() );
+        kidCount.push_back( kids.size() );
+        for(int j=0; j<kids.size(); j++){
+          nodes.push_back( kids[j] );
+          parent.push_back( i );
+        }
+      }
+
+      long nNodes = nodes.size();
+      int d = root->getCenter().size();
+
+      //point ranges in depth first leaf order
+      std::vector<int32_t> pointStart(nNodes);
+      std::vector<int32_t> pointCount(nNodes);
+      std::vector<int32_t> points;
+      placePoints(0, nodes, kidStart, kidCount, pointStart, pointCount, points);
+
+      std::ofstream file;
+      file.open(filename.c_str(), std::ios::binary);
+      if( !file.is_open() ){
+        std::cout << "Unable to write GMRA tree file " << filename << std::endl;
+        return false;
+      }
+
+      GMRATreeFileHeader header;
+      memset(&header, 0, sizeof(GMRATreeFileHeader) );
+      memcpy(header.magic, magic(), 8);
+      header.version = VERSION;
+      header.precisionSize = sizeof(TPrecision);
+      header.nNodes = nNodes;
+      header.dimension = d;
+      header.nPoints = points.size();
+      header.nDataPoints = tree->getDataObject()->numberOfPoints();
+      header.dataChecksum = checksum( tree->getDataObject() );
+      size_t offset = 0;
+      writeBlock(file, offset, (const char *) &header, sizeof(GMRATreeFileHeader) );
+
+      std::vector<TPrecision> values(nNodes * d);
+      for(long i=0; i<nNodes; i++){
+        VectorXp &c = nodes[i]->getCenter();
+        for(int j=0; j<d; j++){
+          values[i*d + j] = c(j);
+        }
+      }
+      writeBlock(file, offset, values);
+
+      values.resize(nNodes);
+      for(long i=0; i<nNodes; i++){
+        values[i] = nodes[i]->getRadius();
+      }
+      writeBlock(file, offset, values);
+      for(long i=0; i<nNodes; i++){
+        values[i] = nodes[i]->getLocalRadius();
+      }
+      writeBlock(file, offset, values);
+      for(long i=0; i<nNodes; i++){
+        values[i] = nodes[i]->getMass();
+      }
+      writeBlock(file, offset, values);
+
+      std::vector<int32_t> scale(nNodes);
+      for(long i=0; i<nNodes; i++){
+        scale[i] = nodes[i]->getScale();
+      }
+      writeBlock(file, offset, scale);
+      writeBlock(file, offset, parent);
+      writeBlock(file, offset, kidStart);
+      writeBlock(file, offset, kidCount);
+      writeBlock(file, offset, pointStart);
+      writeBlock(file, offset, pointCount);
+      writeBlock(file, offset, points);
+
+      file.close();
+      return !file.fail();
+    };
+
+
+
+
+  private:
+
+    //FNV-1a
+    static uint64_t hash(uint64_t h, const unsigned char *bytes, size_t size){
+      for(size_t i=0; i<size; i++){
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+      }
+      return h;
+    };
+
+
+
+    //Points the arrays into the mapped file, false if it is too short
+    bool setupArrays(const GMRATreeFileHeader &header){
+      if( header.nNodes <= 0 || header.nNodes > INT32_MAX || header.dimension <= 0 ||
+          header.nPoints < 0 || header.nPoints > INT32_MAX ){
+        return false;
+      }
+      size_t nNodes = header.nNodes;
+      size_t d = header.dimension;
+      if( d > mappedSize / nNodes / sizeof(TPrecision) ){
+        return false;
+      }
+
+      size_t offset = align( sizeof(GMRATreeFileHeader) );
+      arrays.dimension = d;
+      arrays.centers = (const TPrecision *) (mapped + offset);
+      offset = align( offset + nNodes * d * sizeof(TPrecision) );
+      const TPrecision *values[3];
+      for(int i=0; i<3; i++){
+        values[i] = (const TPrecision *) (mapped + offset);
+        offset = align( offset + nNodes * sizeof(TPrecision) );
+      }
+      arrays.radius = values[0];
+      arrays.localRadius = values[1];
+      arrays.mass = values[2];
+
+      const int32_t *ints[6];
+      for(int i=0; i<6; i++){
+        ints[i] = (const int32_t *) (mapped + offset);
+        offset = align( offset + nNodes * sizeof(int32_t) );
+      }
+      arrays.scale = ints[0];
+      arrays.parent = ints[1];
+      arrays.kidStart = ints[2];
+      arrays.kidCount = ints[3];
+      arrays.pointStart = ints[4];
+      arrays.pointCount = ints[5];
+      arrays.points = (const int32_t *) (mapped + offset);
+      offset = align( offset + header.nPoints * sizeof(int32_t) );
+
+      return offset <= mappedSize;
+    };
+
+
+
+    //Checks that the nodes form a tree in breadth first order and that all
+    //point ranges and indices are in bounds
+    bool validate(const GMRATreeFileHeader &header){
+      long nNodes = header.nNodes;
+      long nPoints = header.nPoints;
+      if( arrays.parent[0] != -1 ){
+        return false;
+      }
+      for(long i=0; i<nNodes; i++){
+        long start = arrays.kidStart[i];
+        long count = arrays.kidCount[i];
+        if( count < 0 || (count > 0 && (start <= i || start + count > nNodes) ) ){
+          return false;
+        }
+        for(long j=start; j<start+count; j++){
+          if( arrays.parent[j] != i ){
+            return false;
+          }
+        }
+        if( i > 0 && (arrays.parent[i] < 0 || arrays.parent[i] >= i) ){
+          return false;
+        }
+        long pStart = arrays.pointStart[i];
+        long pCount = arrays.pointCount[i];
+        if( pStart < 0 || pCount < 0 || pStart + pCount > nPoints ){
+          return false;
+        }
+      }
+      for(long i=0; i<nPoints; i++){
+        if( arrays.points[i] < 0 || arrays.points[i] >= header.nDataPoints ){
+          return false;
+        }
+      }
+      return true;
+    };
+
+
+
+    static void placePoints(long i, std::vector< GMRANode<TPrecision> * > &nodes,
+        std::vector<int32_t> &kidStart, std::vector<int32_t> &kidCount,
+        std::vector<int32_t> &pointStart, std::vector<int32_t> &pointCount,
+        std::vector<int32_t> &points){
+
+      pointStart[i] = points.size();
+      if( kidCount[i] == 0 ){
+        std::vector<int> &pts = nodes[i]->getPoints();
+        points.insert( points.end(), pts.begin(), pts.end() );
+      }
+      for(int j=0; j<kidCount[i]; j++){
+        placePoints(kidStart[i] + j, nodes, kidStart, kidCount, pointStart,
+            pointCount, points);
+      }
+      pointCount[i] = points.size() - pointStart[i];
+    };
+
+
+
+    template <typename T>
+    static void writeBlock(std::ofstream &file, size_t &offset, std::vector<T> &v){
+      writeBlock(file, offset, (const char *) v.data(), v.size() * sizeof(T) );
+    };
+
+
+
+    static void writeBlock(std::ofstream &file, size_t &offset, const char *data, size_t size){
+      file.write(data, size);
+      offset += size;
+      size_t padding = align(offset) - offset;
+      static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      file.write(zeros, padding);
+      offset += padding;
+    };
+
+
+
+    bool map(const std::string &filename){
+#ifndef _WIN32
+      int fd = open(filename.c_str(), O_RDONLY);
+      if(fd < 0){
+        return false;
+      }
+      struct stat st;
+      if( fstat(fd, &st) != 0 || st.st_size == 0 ){
+        close(fd);
+        return false;
+      }
+      void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(ptr == MAP_FAILED){
+        return false;
+      }
+      mapped = (const char *) ptr;
+      mappedSize = st.st_size;
+      return true;
+#else
+      std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+      if( !file.is_open() ){
+        return false;
+      }
+      buffer.resize( file.tellg() );
+      file.seekg(0, std::ios::beg);
+      file.read( buffer.data(), buffer.size() );
+      if( file.fail() ){
+        buffer.clear();
+        return false;
+      }
+      mapped = buffer.data();
+      mappedSize = buffer.size();
+      return true;
+#endif
+    };
+
+
+
+    void unmap(){
+#ifndef _WIN32
+      if(mapped != NULL){
+        munmap( (void *) mapped, mappedSize );
+      }
+#else
+      buffer.clear();
+#endif
+      mapped = NULL;
+      mappedSize = 0;
+    };
+
+};
+
+
+#endif
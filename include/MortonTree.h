@@ -0,0 +1,331 @@
+#ifndef MORTONTREE_H
+#define MORTONTREE_H
+
+#include "GMRATree.h"
+#include "BallTree.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+
+
+
+//Linear octree (quadtree in 2D) for low dimensional point sets. Points are
+//sorted by their Morton (Z-order) codes with a parallel radix sort, nodes are
+//dyadic cells, i.e. contiguous ranges of the sorted codes. Chains of cells
+//with a single non-empty subcell are collapsed, so each scale splits a node
+//into up to 2^d kids. Nodes stop splitting with at most minPoints points, a
+//radius below epsilon times the root radius or all points in the same finest
+//cell. Kids and the nodes of a scale are in Morton order.
+//
+//The codes have 64 bits, so the grid gets coarser with the dimension. Above
+//getMaximumDimension() dimensions it has too few cells per coordinate for a
+//useful number of scales and the tree is only a root holding all points.
+//
+//As for the BallTree, scale, radius (to the points), local radius, mass
+//(number of points) and the deepest scale are set while building.
+template <typename TPrecision>
+class MortonTree : public GMRATree<TPrecision>{
+
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+    int minPoints;
+    TPrecision epsilon;
+
+
+  private:
+
+    MatrixXp X;
+    std::vector<uint64_t> codes;
+    std::vector<int> perm;
+    int bits;
+    TPrecision rootRadius;
+
+
+    //Fewest bits per coordinate for a useful tree
+    static const int minBits = 8;
+
+
+    struct Cell{
+      long begin;
+      long end;
+      int level;
+      Cell(long b, long e, int l) : begin(b), end(e), level(l){};
+    };
+
+
+
+    //Sorts codes and perm by codes, least significant digit first with 8 bit
+    //digits. Each thread counts and scatters a fixed chunk.
+    static void radixSort(std::vector<uint64_t> &codes, std::vector<int> &perm, int nBits){
+      long n = codes.size();
+      int nThreads = Parallel::getNumberOfThreads();
+      long chunk = std::max(1L, (n + nThreads - 1) / nThreads);
+      long nChunks = (n + chunk - 1) / chunk;
+
+      std::vector<uint64_t> codes2(n);
+      std::vector<int> perm2(n);
+      std::vector< std::vector<long> > counts( nChunks, std::vector<long>(256) );
+      for(int shift = 0; shift < nBits; shift += 8){
+        Parallel::forBlocks(n, chunk, [&](int t, long begin, long end){
+            std::vector<long> &c = counts[begin/chunk];
+            std::fill(c.begin(), c.end(), 0);
+            for(long i=begin; i<end; i++){
+              c[ (codes[i] >> shift) & 255 ]++;
+            }
+        } );
+
+        //offsets by digit, then by chunk to keep the sort stable
+        long offset = 0;
+        for(int digit = 0; digit < 256; digit++){
+          for(long b = 0; b < nChunks; b++){
+            long tmp = counts[b][digit];
+            counts[b][digit] = offset;
+            offset += tmp;
+          }
+        }
+
+        Parallel::forBlocks(n, chunk, [&](int t, long begin, long end){
+            std::vector<long> &c = counts[begin/chunk];
+            for(long i=begin; i<end; i++){
+              long &pos = c[ (codes[i] >> shift) & 255 ];
+              codes2[pos] = codes[i];
+              perm2[pos] = perm[i];
+              pos++;
+            }
+        } );
+        codes.swap(codes2);
+        perm.swap(perm2);
+      }
+    };
+
+
+
+    BallNode<TPrecision> *createNode(long begin, long end, int scale){
+      VectorXp mean = VectorXp::Zero( X.rows() );
+      for(long i=begin; i<end; i++){
+        mean += X.col( perm[i] );
+      }
+      mean /= end - begin;
+
+      TPrecision radius = 0;
+      for(long i=begin; i<end; i++){
+        radius = std::max( radius, (X.col( perm[i] ) - mean).squaredNorm() );
+      }
+
+      BallNode<TPrecision> *node = new BallNode<TPrecision>(mean,
+          perm.begin() + begin, perm.begin() + end);
+      node->setScale(scale);
+      node->setRadius( sqrt(radius) );
+      node->setLocalRadius(0);
+      node->setMass( end - begin );
+      return node;
+    };
+
+
+
+    //Splits the cell into its non-empty subcells, descending through levels
+    //with a single non-empty subcell
+    void buildKids(BallNode<TPrecision> *node, Cell cell,
+        std::vector<BallNode<TPrecision> *> &kids, std::vector<Cell> &kidCells){
+
+      if( cell.end - cell.begin <= std::max(1, minPoints) ||
+          node->getRadius() <= epsilon * rootRadius ){
+        return;
+      }
+
+      int d = X.rows();
+      std::vector<Cell> parts;
+      for(int level = cell.level+1; level <= bits; level++){
+        int shift = (bits - level) * d;
+        parts.clear();
+        long pos = cell.begin;
+        while(pos < cell.end){
+          uint64_t last = ( (codes[pos] >> shift) << shift ) | ( ( (uint64_t) 1 << shift) - 1 );
+          long next = std::upper_bound( codes.begin() + pos, codes.begin() + cell.end,
+              last ) - codes.begin();
+          parts.push_back( Cell(pos, next, level) );
+          pos = next;
+        }
+        if(parts.size() > 1){
+          break;
+        }
+      }
+      if(parts.size() < 2){
+        return;
+      }
+
+      for(int i=0; i<parts.size(); i++){
+        BallNode<TPrecision> *kid = createNode( parts[i].begin, parts[i].end,
+            node->getScale()+1 );
+        kid->setParent(node);
+        node->addChild(kid);
+        node->setLocalRadius( std::max( node->getLocalRadius(),
+              (kid->getCenter() - node->getCenter()).norm() ) );
+        kids.push_back(kid);
+        kidCells.push_back( parts[i] );
+      }
+    };
+
+
+
+  public:
+
+    static int getMaximumDimension(){
+      return 63 / minBits;
+    };
+
+
+
+    MortonTree(GMRADataObject<TPrecision> *D) : GMRATree<TPrecision>(D){
+      minPoints = 1;
+      epsilon = 0;
+    };
+
+
+    virtual ~MortonTree(){
+    };
+
+
+
+    //Builds the tree on the points, an existing tree is rebuilt on all points
+    void addPoints(std::vector<int> &pts){
+
+      GMRANode<TPrecision> *root = this->getRoot();
+      if(root != NULL){
+        std::vector<int> &ppts = root->getPoints();
+        pts.insert(pts.end(), ppts.begin(), ppts.end() );
+        DeleteVisitor<TPrecision> del;
+        this->depthFirstVisitor(&del);
+        this->setRoot(NULL);
+      }
+      if( pts.empty() ){
+        return;
+      }
+
+      GMRADataObject<TPrecision> *data = this->getDataObject();
+      int d = data->dimension();
+      bits = std::min(31, 63 / d);
+      long n = pts.size();
+      X.resize( d, n );
+      for(long i=0; i<n; i++){
+        X.col(i) = data->getPoint( pts[i] );
+      }
+
+      if( d > getMaximumDimension() ){
+        std::cout << "MortonTree supports at most " << getMaximumDimension() <<
+          " dimensions, building a single node" << std::endl;
+        perm.resize(n);
+        for(long i=0; i<n; i++){
+          perm[i] = i;
+        }
+        BallNode<TPrecision> *root = createNode(0, n, 0);
+        root->getPoints() = pts;
+        X.resize(0, 0);
+        perm.clear();
+        this->setRoot(root);
+        this->setMaxScale(0);
+        return;
+      }
+
+      //quantize to a cube grid on the bounding box
+      VectorXp lo = X.rowwise().minCoeff();
+      VectorXp hi = X.rowwise().maxCoeff();
+      TPrecision extent = (hi - lo).maxCoeff();
+      if(extent <= 0){
+        extent = 1;
+      }
+      TPrecision nCells = (TPrecision) ( (uint64_t) 1 << bits );
+      uint64_t maxCell = ( (uint64_t) 1 << bits ) - 1;
+
+      codes.resize(n);
+      perm.resize(n);
+      Parallel::forBlocks(n, 4096, [&](int t, long begin, long end){
+          for(long i=begin; i<end; i++){
+            uint64_t code = 0;
+            for(int j=0; j<d; j++){
+              uint64_t q = (uint64_t) ( (X(j, i) - lo(j)) / extent * nCells );
+              q = std::min(q, maxCell);
+              for(int b=0; b<bits; b++){
+                code |= ( (q >> b) & 1 ) << (b*d + j);
+              }
+            }
+            codes[i] = code;
+            perm[i] = i;
+          }
+      } );
+      radixSort(codes, perm, bits*d);
+
+
+      //build by scale, nodes of a scale cover disjoint ranges of the codes
+      BallNode<TPrecision> *node = createNode(0, n, 0);
+      rootRadius = node->getRadius();
+      std::vector<BallNode<TPrecision> *> nodes(1, node);
+      std::vector<Cell> cells(1, Cell(0, n, 0) );
+      int scale = 0;
+      while( !nodes.empty() ){
+        std::vector< std::vector<BallNode<TPrecision> *> > kids( nodes.size() );
+        std::vector< std::vector<Cell> > kidCells( nodes.size() );
+        Parallel::forBlocks(nodes.size(), 1, [&](int t, long begin, long end){
+            for(long i=begin; i<end; i++){
+              buildKids(nodes[i], cells[i], kids[i], kidCells[i]);
+            }
+        } );
+
+        std::vector<BallNode<TPrecision> *> next;
+        std::vector<Cell> nextCells;
+        for(int i=0; i<nodes.size(); i++){
+          next.insert( next.end(), kids[i].begin(), kids[i].end() );
+          nextCells.insert( nextCells.end(), kidCells[i].begin(), kidCells[i].end() );
+        }
+        if( !next.empty() ){
+          scale++;
+        }
+        nodes.swap(next);
+        cells.swap(nextCells);
+      }
+
+      //node point lists refer to the local copy
+      class Reindex : public Visitor<TPrecision>{
+        public:
+          std::vector<int> &pts;
+          Reindex(std::vector<int> &p) : pts(p){};
+          void visit(GMRANode<TPrecision> *node){
+            std::vector<int> &np = node->getPoints();
+            for(int i=0; i<np.size(); i++){
+              np[i] = pts[ np[i] ];
+            }
+          };
+      };
+      Reindex reindex(pts);
+      GMRATree<TPrecision>::depthFirst(&reindex, node);
+
+      X.resize(0, 0);
+      codes.clear();
+      perm.clear();
+
+      this->setRoot(node);
+      this->setMaxScale(scale);
+    };
+
+
+
+    std::vector<GMRANode<TPrecision> *> getLeafPath(const VectorXp &x ) {
+      GMRANode<TPrecision> *node = this->getRoot();
+      std::vector<GMRANode<TPrecision> *> path;
+      while(node != NULL ){
+        path.push_back( node );
+        node = node->findDescendant( x );
+      }
+      return path;
+    };
+
+};
+
+
+#endif
@@ -7,7 +7,9 @@
 #include "PropagationStrategy.h"
 #include "NeighborhoodStrategy.h"
 #include "NeighborhoodPropagationStrategy.h"
+#include "TransportAutoTuner.h"
 
+#include <chrono>
 #include <list>
 
 
@@ -32,6 +34,9 @@ class MultiscaleTransportLP : public MultiscaleTransport<TPrecision> {
 
     TransportLPSolver<TPrecision> *solver;
 
+    TransportAutoTuner<TPrecision> *tuner;
+
+
 
 
 
@@ -44,6 +49,7 @@ class MultiscaleTransportLP : public MultiscaleTransport<TPrecision> {
       maxNeighborhoodSize = 10000000;
       lastScaleNeighborhood = NULL;
       propagation1 =  new NeighborhoodPropagationStrategy<TPrecision>(0);
+      tuner = NULL;
     };
 
     virtual ~MultiscaleTransportLP(){
@@ -86,6 +92,36 @@ class MultiscaleTransportLP : public MultiscaleTransport<TPrecision> {
     };
 
 
+    //Adapt the settings from scale to scale with tuner, NULL (default) to
+    //keep them fixed. A cutoff for the second propagation strategy loaded
+    //by the tuner replaces maxNeighborhoodSize. The tuner is not owned.
+    void setAutoTuner(TransportAutoTuner<TPrecision> *t){
+      tuner = t;
+      if( tuner != NULL && tuner->getMaxNeighborhoodSize() > 0 &&
+          propagation2 != NULL ){
+        maxNeighborhoodSize = tuner->getMaxNeighborhoodSize();
+      }
+    };
+
+
+    //Solve the connected components of the LPs separately and concurrently,
+    //if the LP solver supports it. Exact, for balanced transport the paths
+    //at fine scales often fall into many components.
+    void setDecomposeComponents(bool decompose){
+      solver->getLPSolver()->setDecomposeComponents(decompose);
+    };
+
+
+    //Solve the LPs again after columns were added starting from their
+    //previous solution, after n sweeps over blocks of the LP solved
+    //concurrently. The final solve is exact, the potentials stay optimal.
+    //-1 (default) solves each LP from scratch. Blocks are of nearby rows if
+    //the transport levels are sorted in space.
+    void setBlockSweeps(int n){
+      solver->getLPSolver()->setBlockSweeps(n);
+    };
+
+
 
   protected:
 
@@ -99,8 +135,21 @@ class MultiscaleTransportLP : public MultiscaleTransport<TPrecision> {
 
       int nPoints =  source->getNodes().size() + target->getNodes().size();
 
+      //the propagation evaluates about the costs of the kids of the previous
+      //paths
+      TransportPlan<TPrecision> *prev = prevSol == NULL ? NULL : prevSol->getPrimarySolution();
+      if( prev != NULL && !prev->source->getNodes().empty() &&
+          !prev->target->getNodes().empty() ){
+        double nKidPairs = (double) source->getNodes().size() / prev->source->getNodes().size() *
+          target->getNodes().size() / prev->target->getNodes().size();
+        source->reserveTransportCosts( target, p, prev->getNumberOfPaths() * nKidPairs );
+      }
+
       TransportPlanSolutions<TPrecision> *sols;
 
+      //wall clock time for the tuner, CPU time adds up over the threads
+      std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+      bool refined = false;
       if( nPoints > maxNeighborhoodSize ){
         sols = propagation2->propagate(solver, source, target, prevSol, p,
             lastScale);
@@ -114,6 +163,7 @@ class MultiscaleTransportLP : public MultiscaleTransport<TPrecision> {
             TransportPlan<TPrecision> *res = (*it)->solveNeighborhoodLP(source, target, sols->getPrimarySolution(),
                sols->getCombinedPaths(), solver, p);
 	          sols->setPrimarySolution(res);
+            refined = true;
           }
           if(lastScale && lastScaleNeighborhood!=NULL){
 	          TransportPlan<TPrecision> *res =
@@ -126,6 +176,15 @@ class MultiscaleTransportLP : public MultiscaleTransport<TPrecision> {
 
       solver->setLastScale(false);
 
+      if(tuner != NULL){
+        tuner->addScale( nPoints, sols->getPrimarySolution(),
+            std::chrono::duration<double>( std::chrono::steady_clock::now() - t1 ).count(),
+            refined );
+        if( propagation2 != NULL && tuner->getMaxNeighborhoodSize() > 0 ){
+          maxNeighborhoodSize = tuner->getMaxNeighborhoodSize();
+        }
+      }
+
       return sols;
     };
 
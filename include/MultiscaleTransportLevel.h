@@ -2,6 +2,11 @@
 #define MULTISCALETRANSPORTLEVEL_H
 
 #include "TransportNode.h" 
+#include "TransportCostCache.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 
 template <typename TPrecision>
@@ -21,9 +26,69 @@ class MultiscaleTransportLevel{
 
     MultiscaleTransportLevel<TPrecision> *parent;
 
+    //Costs to the nodes of other levels by target level and exponent. The
+    //numbering of a level gets a new, globally unique, key whenever ids
+    //change. A cache for an old key is never cleared in place, since other
+    //threads may still hold it, it is retired and replaced by a new cache.
+    struct CostCache{
+      long key;
+      long targetKey;
+      const MultiscaleTransportLevel<TPrecision> *target;
+      double p;
+      TransportCostCache<TPrecision> *cache;
+    };
+
+    mutable std::mutex costCacheMutex;
+    mutable std::vector<CostCache> costCaches;
+    mutable std::vector< TransportCostCache<TPrecision> * > retiredCostCaches;
+    long numberingKey;
+    bool cacheCosts;
+
+
+    static long nextNumberingKey(){
+      static std::atomic<long> key(0);
+      return key++;
+    };
+
+
+    bool contains(const TransportNode<TPrecision> *node) const{
+      int id = node->getID();
+      return id >= 0 && id < nodes.size() && nodes[id] == node;
+    };
+
+
+    TransportCostCache<TPrecision> *getCostCache(
+        const MultiscaleTransportLevel<TPrecision> *target, double p) const{
+      std::lock_guard<std::mutex> lock(costCacheMutex);
+      for(int i=0; i<costCaches.size(); i++){
+        CostCache &c = costCaches[i];
+        if(c.target == target && c.p == p){
+          if(c.key != numberingKey || c.targetKey != target->numberingKey){
+            retiredCostCaches.push_back(c.cache);
+            c.cache = new TransportCostCache<TPrecision>();
+            c.key = numberingKey;
+            c.targetKey = target->numberingKey;
+          }
+          return c.cache;
+        }
+      }
+      CostCache c;
+      c.key = numberingKey;
+      c.targetKey = target->numberingKey;
+      c.target = target;
+      c.p = p;
+      c.cache = new TransportCostCache<TPrecision>();
+      costCaches.push_back(c);
+      return c.cache;
+    };
+
+
+
   public:
 
     MultiscaleTransportLevel(int s, MultiscaleTransportLevel<TPrecision> *parentLevel) : scale(s), parent(parentLevel){
+      numberingKey = nextNumberingKey();
+      cacheCosts = true;
     };
 
 
@@ -32,6 +97,7 @@ class MultiscaleTransportLevel{
         delete *it;
       }
       nodes.clear();
+      clearTransportCostCache();
     };
 
 
@@ -40,14 +106,175 @@ class MultiscaleTransportLevel{
     };
 
 
+    //Removes node without deleting it, the last node of the level takes over
+    //its id
+    void removeNode(TransportNode<TPrecision> *node){
+      int id = node->getID();
+      nodes[id] = nodes.back();
+      nodes[id]->setID(id);
+      nodes.pop_back();
+      invalidateTransportCosts();
+    };
+
+
+    //Renumbers the nodes, the node with id order[i] gets id i
+    virtual void reorderNodes(const std::vector<int> &order){
+      TransportNodeVector reordered( order.size() );
+      for(int i=0; i<order.size(); i++){
+        reordered[i] = nodes[ order[i] ];
+        reordered[i]->setID(i);
+      }
+      nodes.swap(reordered);
+      invalidateTransportCosts();
+    };
+
+
+
+    //Cache of the costs from this level to target with exponent p, NULL if
+    //costs are not cached. Loops that evaluate many costs, in particular
+    //parallel ones, resolve the cache once and pass it to getTransportCost
+    //and getTransportCostLowerBound, lookups then only lock a shard of the
+    //cache. The cache stays valid until the caches of this level are
+    //invalidated or cleared. Renumbering this level or target, which
+    //invalidates the costs, must not happen while the cache is in use.
+    TransportCostCache<TPrecision> *getTransportCostCache(
+        const MultiscaleTransportLevel<TPrecision> *target, double p) const{
+      if( !cacheCosts ){
+        return NULL;
+      }
+      return getCostCache(target, p);
+    };
+
+
+
+    //Transport cost from the node from of this level to the node to of the
+    //target level. Costs are cached per target level and exponent, nodes
+    //that are not at the position of their id in their level, e.g. while the
+    //level is renumbered, bypass the cache. Safe to call concurrently, but
+    //each call looks up the cache under a lock of the level, loops should
+    //resolve it once with getTransportCostCache.
+    TPrecision getTransportCost(TransportNode<TPrecision> *from,
+        const MultiscaleTransportLevel<TPrecision> *target,
+        TransportNode<TPrecision> *to, double p) const{
+      if( !cacheCosts || !contains(from) || !target->contains(to) ){
+        return from->getTransportCost(to, p);
+      }
+      return getTransportCost( from, target, to, p, getCostCache(target, p) );
+    };
+
+
+    //Transport cost with the cache of getTransportCostCache(target, p)
+    TPrecision getTransportCost(TransportNode<TPrecision> *from,
+        const MultiscaleTransportLevel<TPrecision> *target,
+        TransportNode<TPrecision> *to, double p,
+        TransportCostCache<TPrecision> *cache) const{
+      if( cache == NULL || !contains(from) || !target->contains(to) ){
+        return from->getTransportCost(to, p);
+      }
+      TPrecision cost;
+      if( !cache->find( from->getID(), to->getID(), cost ) ){
+        cost = from->getTransportCost(to, p);
+        cache->insert( from->getID(), to->getID(), cost );
+      }
+      return cost;
+    };
+
+
+    //Lower bound of the transport cost to screen arcs. The cached cost if
+    //there is one, otherwise the bound of the nodes or, without one, the
+    //cost.
+    TPrecision getTransportCostLowerBound(TransportNode<TPrecision> *from,
+        const MultiscaleTransportLevel<TPrecision> *target,
+        TransportNode<TPrecision> *to, double p) const{
+      return getTransportCostLowerBound( from, target, to, p,
+          getTransportCostCache(target, p) );
+    };
+
+
+    //Lower bound with the cache of getTransportCostCache(target, p)
+    TPrecision getTransportCostLowerBound(TransportNode<TPrecision> *from,
+        const MultiscaleTransportLevel<TPrecision> *target,
+        TransportNode<TPrecision> *to, double p,
+        TransportCostCache<TPrecision> *cache) const{
+      if( !from->hasTransportCostLowerBound() ){
+        return getTransportCost(from, target, to, p, cache);
+      }
+      TPrecision cost;
+      if( cache != NULL && contains(from) && target->contains(to) &&
+          cache->find( from->getID(), to->getID(), cost ) ){
+        return cost;
+      }
+      return from->getTransportCostLowerBound(to, p);
+    };
+
+
+    //Sizes the cache of the costs to target for n costs
+    void reserveTransportCosts(const MultiscaleTransportLevel<TPrecision> *target,
+        double p, long n){
+      if(cacheCosts){
+        getCostCache(target, p)->reserve(n);
+      }
+    };
+
+
+    //Marks the cached costs from and to this level as invalid, needed if the
+    //costs of the nodes changed. Drops the caches from this level, caches of
+    //other levels to this level are replaced when next requested. Must not
+    //be called while costs from or to this level are evaluated.
+    void invalidateTransportCosts(){
+      numberingKey = nextNumberingKey();
+      clearTransportCostCache();
+    };
+
+
+    //Deletes the caches from this level, including retired ones. Must not be
+    //called while they are in use.
+    void clearTransportCostCache(){
+      std::lock_guard<std::mutex> lock(costCacheMutex);
+      for(int i=0; i<costCaches.size(); i++){
+        delete costCaches[i].cache;
+      }
+      costCaches.clear();
+      for(int i=0; i<retiredCostCaches.size(); i++){
+        delete retiredCostCaches[i];
+      }
+      retiredCostCaches.clear();
+    };
+
+
+    //Turns the cost cache on (default) or off
+    void setCacheTransportCosts(bool cache){
+      cacheCosts = cache;
+      if(!cache){
+        clearTransportCostCache();
+      }
+    };
+
+
     TransportNodeVector &getNodes(){
       return nodes;
     };
 
 
+    const TransportNodeVector &getNodes() const{
+      return nodes;
+    };
+
+
     virtual TransportNodeVector getNeighborhood(TransportNode<TPrecision> *node,
         TPrecision eps) const = 0;
 
+
+    //Neighborhoods of nodes[i] within eps[i]
+    virtual std::vector<TransportNodeVector> getNeighborhoods(const TransportNodeVector &nodes,
+        const std::vector<TPrecision> &eps) const{
+      std::vector<TransportNodeVector> neighbors( nodes.size() );
+      for(int i=0; i<nodes.size(); i++){
+        neighbors[i] = getNeighborhood( nodes[i], eps[i] );
+      }
+      return neighbors;
+    };
+
     TPrecision getMaximalRadius(){
       TPrecision radius = 0;
       TransportNodeVector &nodes = getNodes();
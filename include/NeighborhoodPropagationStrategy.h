@@ -5,7 +5,10 @@
 
 #include <ctime>
 #include "TransportLPSolver.h"
+#include "Parallel.h"
 #include <iostream>
+#include <random>
+#include <vector>
 
 
 template <typename TPrecision>
@@ -26,12 +29,30 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
   private:
     TPrecision expansionFactor;
 
+    //LP solvers for alternate solutions, reused across levels
+    std::vector<LPSolver *> lpPool;
+    unsigned long seed;
+    unsigned long nAlternates;
+
   public:
 
-    NeighborhoodPropagationStrategy(TPrecision eFactor=0) :  expansionFactor(eFactor) {
+    NeighborhoodPropagationStrategy(TPrecision eFactor=0) :  expansionFactor(eFactor),
+      seed(0), nAlternates(0) {
+    };
+
+    virtual ~NeighborhoodPropagationStrategy(){
+      for(int i=0; i<lpPool.size(); i++){
+        delete lpPool[i];
+      }
     };
 
-    virtual ~NeighborhoodPropagationStrategy(){};
+
+    //Seed of the random perturbations of the alternate solutions, the n-th
+    //chain of alternate solutions computed by the strategy uses seed + n
+    void setSeed(unsigned long s){
+      seed = s;
+      nAlternates = 0;
+    };
 
     virtual TransportPlanSolutions<TPrecision> *propagate( TransportLPSolver<TPrecision> *solver,
         MultiscaleTransportLevel<TPrecision> *source,
@@ -44,6 +65,7 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
               new TransportPlanSolutions<TPrecision>(source, target);
         TransportPlan<TPrecision> *sol = sols->getPrimarySolution();
         //Add all variables
+        TransportCostCache<TPrecision> *cache = source->getTransportCostCache(target, p);
         const TransportNodeVector &sourceNodes = source->getNodes();
         for(TransportNodeVectorCIterator sIt = sourceNodes.begin(); sIt !=
             sourceNodes.end(); ++sIt){
@@ -52,14 +74,16 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
           for(TransportNodeVectorCIterator tIt = targetNodes.begin(); tIt !=
               targetNodes.end(); ++tIt){
             Path path(*sIt, *tIt);
-            path.cost = (*sIt)->getTransportCost( *tIt, p );
+            path.cost = source->getTransportCost( *sIt, target, *tIt, p, cache );
             sol->addPath(path);
           }
         }
 
-        solver->createLP( sol );
-        solver->solveLP();
-        solver->storeLP(sol, p);
+        if( !solver->solveDense(sol, p) ){
+          solver->createLP( sol );
+          solver->solveLP();
+          solver->storeLP(sol, p);
+        }
 
         return sols;
       }
@@ -110,6 +134,84 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
 
 
 
+    //Adds nChains * chainLength alternate solutions to pSol. A chain starts
+    //from a copy of the primary solution and solver->createLP on it. Each step
+    //calls step(solver, res, generator) to modify and solve the LP, stores the
+    //solution in res and continues with a copy of res on the same LP. Chains
+    //are independent and run concurrently, each on a solver of the pool, if
+    //the LP solver supports createSolver. The generator of the n-th chain of
+    //the strategy is seeded with seed + n, so the results do not depend on the
+    //number of threads. step must not modify the nodes.
+    template <typename TStep>
+    void solveAlternateSolutions( TransportLPSolver<TPrecision> *solver,
+      TransportPlanSolutions<TPrecision> *pSol, double p, int nChains,
+      int chainLength, TStep step ){
+
+      if(nChains < 1 || chainLength < 1){
+        return;
+      }
+
+      TransportPlan<TPrecision> *sol = pSol->getPrimarySolution();
+      std::vector< TransportPlan<TPrecision> * > res( nChains * chainLength );
+      for(int i=0; i<nChains; i++){
+        res[i*chainLength] = sol->createCopy();
+      }
+
+      int nThreads = Parallel::getNumberOfThreads(nChains, 1);
+      while( nThreads > 1 && lpPool.size() < nThreads ){
+        LPSolver *lp = solver->getLPSolver()->createSolver();
+        if(lp == NULL){
+          break;
+        }
+        lpPool.push_back(lp);
+      }
+
+      std::vector< TransportLPSolver<TPrecision> * > pool;
+      if( nThreads < 2 || lpPool.size() < nThreads ){
+        pool.push_back(solver);
+      }
+      else{
+        for(int i=0; i<nThreads; i++){
+          pool.push_back( solver->createSolver( lpPool[i] ) );
+        }
+      }
+
+      unsigned long first = seed + nAlternates;
+      auto solveChains = [&](int t, long begin, long end){
+          TransportLPSolver<TPrecision> *s = pool[t];
+          for(long i=begin; i<end; i++){
+            std::mt19937_64 generator( first + i );
+            s->createLP( res[i*chainLength] );
+            for(int k=0; k<chainLength; k++){
+              TransportPlan<TPrecision> *r = res[i*chainLength + k];
+              step( s, r, generator );
+              s->storePaths( r, p );
+              if(k+1 < chainLength){
+                res[i*chainLength + k+1] = r->createCopy();
+              }
+            }
+          }
+      };
+      if( pool.size() > 1 ){
+        Parallel::forBlocks(nChains, 1, solveChains);
+      }
+      else{
+        solveChains(0, 0, nChains);
+      }
+      nAlternates += nChains;
+
+      for(int i=0; i<res.size(); i++){
+        pSol->addAlternativeSolution( res[i] );
+      }
+      if( pool[0] != solver ){
+        for(int i=0; i<pool.size(); i++){
+          delete pool[i];
+        }
+      }
+    };
+
+
+
 
 
 
@@ -117,7 +219,8 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
 
 
     void addAllCombinations(const TransportNodeVector &fKids, const
-        TransportNodeVector &tKids, TransportPlan<TPrecision> *sol, double p, std::vector<Path> &toAdd){
+        TransportNodeVector &tKids, TransportPlan<TPrecision> *sol, double p,
+        TransportCostCache<TPrecision> *cache, std::vector<Path> &toAdd){
 
       for(TransportNodeVectorCIterator fkIt = fKids.begin(); fkIt != fKids.end();
           ++fkIt){
@@ -132,7 +235,7 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
           Path path(f2, t2);
 
           if( !sol->hasPath(path) ){
-            path.cost = f2->getTransportCost(t2, p);
+            path.cost = sol->source->getTransportCost(f2, sol->target, t2, p, cache);
             toAdd.push_back(path);
           }
 
@@ -153,7 +256,13 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
       //TPrecision r = (rTo + rFrom) * rFactor;
 
       std::vector<Path> toAdd;
+      TransportCostCache<TPrecision> *cache =
+        sol->source->getTransportCostCache(sol->target, p);
       double sumw = 0;
+      TransportNodeVector from;
+      TransportNodeVector to;
+      std::vector<TPrecision> rFrom;
+      std::vector<TPrecision> rTo;
       for(prevSol->pathIteratorBegin(); !prevSol->pathIteratorIsAtEnd();
           prevSol->pathIteratorNext()){
 
@@ -168,13 +277,28 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
         TransportNode<TPrecision> *t1  = path.to;
 
         if(rFactor > 0){
-          TPrecision rFrom = f1->getLocalNodeRadius() * rFactor;
-          TPrecision rTo   = t1->getLocalNodeRadius() * rFactor;
           //TPrecision r = (rTo + rFrom) * rFactor;
+          from.push_back(f1);
+          to.push_back(t1);
+          rFrom.push_back( f1->getLocalNodeRadius() * rFactor );
+          rTo.push_back( t1->getLocalNodeRadius() * rFactor );
+        }
+        else{
+          const TransportNodeVector &fKids = f1->getChildren();
+          const TransportNodeVector &tKids = t1->getChildren();
+
+          addAllCombinations(fKids, tKids, sol, p, cache, toAdd);
+        }
 
-          const TransportNodeVector &f1n = prevSol->source->getNeighborhood(f1, rFrom);
-          const TransportNodeVector &t1n = prevSol->target->getNeighborhood(t1, rTo);
+      }
 
+      //neighborhoods of the endpoints, one batch per level
+      if( !from.empty() ){
+        std::vector<TransportNodeVector> fN = prevSol->source->getNeighborhoods(from, rFrom);
+        std::vector<TransportNodeVector> tN = prevSol->target->getNeighborhoods(to, rTo);
+        for(int i=0; i<from.size(); i++){
+          const TransportNodeVector &f1n = fN[i];
+          const TransportNodeVector &t1n = tN[i];
 
           for(TransportNodeVectorCIterator fIt = f1n.begin(); fIt != f1n.end();
               ++fIt){
@@ -184,19 +308,11 @@ class NeighborhoodPropagationStrategy : public PropagationStrategy<TPrecision>{
               const TransportNodeVector &fKids = (*fIt)->getChildren();
               const TransportNodeVector &tKids = (*tIt)->getChildren();
 
-              addAllCombinations(fKids, tKids, sol, p, toAdd);
+              addAllCombinations(fKids, tKids, sol, p, cache, toAdd);
 
             }
           }
-
         }
-        else{
-          const TransportNodeVector &fKids = f1->getChildren();
-          const TransportNodeVector &tKids = t1->getChildren();
-
-          addAllCombinations(fKids, tKids, sol, p, toAdd);
-        }
-
       }
 
 
@@ -3,6 +3,8 @@
 
 #include <Eigen/Dense>
 
+#include <vector>
+
 
 #include "EigenMetric.h"
 
@@ -18,6 +20,31 @@ class NodeDistance{
 
     virtual TPrecision distance(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2) = 0;
 
+    //Expensive distances can provide a cheap lower bound to screen out
+    //node pairs before computing the distance
+    virtual bool hasLowerBound(){
+      return false;
+    };
+
+    virtual TPrecision lowerBound(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2){
+      return distance(n1, n2);
+    };
+
+    //Called by GMRATree::computeStatistics before the statistics of the
+    //subtree below top are computed, for distances that precompute data per
+    //node. Not called concurrently with the other methods.
+    virtual void addSubtree(GMRANode<TPrecision> *top){
+    };
+
+    //Distances of x to all nodes, for distances that can share work
+    virtual void distances(GMRANode<TPrecision> *x,
+        const std::vector< GMRANode<TPrecision> * > &nodes, std::vector<TPrecision> &result){
+      result.resize( nodes.size() );
+      for(int i=0; i<nodes.size(); i++){
+        result[i] = distance(x, nodes[i]);
+      }
+    };
+
 };
 
 
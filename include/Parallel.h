@@ -0,0 +1,113 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+
+//Minimal helper to split independent work over threads
+class Parallel{
+
+  public:
+
+    static int getNumberOfThreads(){
+      return numberOfThreads();
+    };
+
+    //Number of threads used by all parallel loops, n < 1 resets to the number
+    //of hardware threads
+    static void setNumberOfThreads(int n){
+      if(n < 1){
+        n = std::max(1, (int) std::thread::hardware_concurrency() );
+      }
+      numberOfThreads() = n;
+    };
+
+
+    //Calls f(thread, begin, end) for the blocks [begin, end) of [0, n). Blocks
+    //are assigned round robin to the threads, i.e. the blocks a thread
+    //processes only depend on n, blockSize and the number of threads. Runs in
+    //the calling thread if there is only a single block.
+    template <typename TFunction>
+    static void forBlocks(long n, long blockSize, TFunction f){
+      if(n <= 0){
+        return;
+      }
+      blockSize = std::max(1L, blockSize);
+      long nBlocks = (n + blockSize - 1) / blockSize;
+      int nThreads = (int) std::min( (long) getNumberOfThreads(), nBlocks );
+
+      if(nThreads <= 1){
+        for(long b = 0; b < nBlocks; b++){
+          f(0, b*blockSize, std::min(n, (b+1)*blockSize) );
+        }
+        return;
+      }
+
+      std::vector<std::thread> threads;
+      threads.reserve(nThreads-1);
+      for(int t=1; t<nThreads; t++){
+        threads.push_back( std::thread( [=, &f](){
+              for(long b = t; b < nBlocks; b += nThreads){
+                f(t, b*blockSize, std::min(n, (b+1)*blockSize) );
+              }
+            } ) );
+      }
+      for(long b = 0; b < nBlocks; b += nThreads){
+        f(0, b*blockSize, std::min(n, (b+1)*blockSize) );
+      }
+      for(int t=0; t<threads.size(); t++){
+        threads[t].join();
+      }
+    };
+
+
+    //Stable sort of [begin, end). Each thread sorts a chunk, the chunks are
+    //merged pairwise, the merges of a round run in parallel.
+    template <typename TIterator, typename TCompare>
+    static void sort(TIterator begin, TIterator end, TCompare comp){
+      long n = end - begin;
+      int nThreads = getNumberOfThreads(n, 4096);
+      long chunk = (n + nThreads - 1) / std::max(1, nThreads);
+      if(nThreads <= 1){
+        std::stable_sort(begin, end, comp);
+        return;
+      }
+      forBlocks(n, chunk, [&](int t, long b, long e){
+          std::stable_sort(begin + b, begin + e, comp);
+      } );
+      for(long width = chunk; width < n; width *= 2){
+        long nMerges = (n + 2*width - 1) / (2*width);
+        forBlocks(nMerges, 1, [&](int t, long b, long e){
+            for(long i=b; i<e; i++){
+              long mid = std::min(n, (2*i+1)*width);
+              long last = std::min(n, (2*i+2)*width);
+              std::inplace_merge(begin + 2*i*width, begin + mid, begin + last, comp);
+            }
+        } );
+      }
+    };
+
+
+    //Number of threads forBlocks will use for n items
+    static int getNumberOfThreads(long n, long blockSize){
+      blockSize = std::max(1L, blockSize);
+      long nBlocks = (n + blockSize - 1) / blockSize;
+      return (int) std::max(1L, std::min( (long) getNumberOfThreads(), nBlocks ) );
+    };
+
+
+
+  private:
+
+    static int &numberOfThreads(){
+      static int n = std::max(1, (int) std::thread::hardware_concurrency() );
+      return n;
+    };
+
+};
+
+
+#endif
@@ -2,8 +2,10 @@
 #define POTENTIALNEIGHBORHOODSTRATEGY_H
 
 #include "NeighborhoodStrategy.h"
+#include "Parallel.h"
 
 #include <list>
+#include <vector>
 
 template <typename TPrecision>
 class ReducedCostPath{
@@ -52,7 +54,7 @@ class PotentialNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
 
   private:
 
-    typedef typename std::list< ReducedCostPath<TPrecision> > RCList;
+    typedef typename std::vector< ReducedCostPath<TPrecision> > RCList;
     typedef typename RCList::iterator RCListIterator;
 
     TPrecision reducedCostThresholdFactor;
@@ -133,65 +135,47 @@ class PotentialNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
         RCList rcArcs;
         int nComparisons = 0;
 
-        for(TransportNodeVectorIterator sIt = sourceNodes.begin(); sIt != sourceNodes.end(); ++sIt){
-          TransportNode<TPrecision> *nFrom = *sIt;
-
-          std::list< TransportNode<TPrecision>* > queue;
-          queue.insert( queue.end(), targetRootNodes.begin(), targetRootNodes.end() );
-          std::list<int> scales;
-          scales.insert( scales.end(), targetRootNodes.size(), rootT->getScale() );
-
-          while( !queue.empty() ){
-            nComparisons++;
-
-            TransportNode<TPrecision> *nTo = queue.front();
-            queue.pop_front();
-            int s = scales.front();
-            scales.pop_front();
-
-            TPrecision cost = -1;
-            cost = nFrom->getTransportCost(nTo, 1);
-
-
-            TPrecision d = cost;
-            if(s < tScale){
-              d = d - nTo->getNodeRadius();
-            }
-            if(d > 0 ){
-              d = pow(d, p);
-            }
-            TPrecision delta = nFrom->getPiMax() - nTo->getPiMin();
-            //TPrecision delta = nFrom->getPiMax() + nTo->getPiMax();
-
-            TPrecision rc = d-delta;
+        //levels of the target hierarchy by scale, for the cost caches
+        std::vector< MultiscaleTransportLevel<TPrecision> * > targetLevels( tScale+1 );
+        for(MultiscaleTransportLevel<TPrecision> *l = target; l != NULL; l = l->getParent() ){
+          targetLevels[ l->getScale() ] = l;
+        }
+        //resolved before the parallel searches, which then only lock shards
+        //of the caches
+        std::vector< TransportCostCache<TPrecision> * > costCaches( tScale+1 );
+        for(int s=0; s<=tScale; s++){
+          costCaches[s] = source->getTransportCostCache( targetLevels[s], 1 );
+        }
 
-            if( rc <= reducedCostThresholdFactor * pow(cost,p) ){
-              if(s == tScale){
-                Path path(nFrom, nTo);
-                path.cost = pow(cost, p);
-                rcArcs.push_back( ReducedCostPath<TPrecision>(path, rc) );
-              }
-              else{
-                const TransportNodeVector &kids = nTo->getChildren();
-                queue.insert( queue.end(), kids.begin(), kids.end() );
-                scales.insert( scales.end(), kids.size(), s+1 );
+        //the searches of the source nodes are independent, they run in
+        //parallel on rounds of source nodes and are merged in order, so the
+        //arcs do not depend on the number of threads
+        long roundSize = 4096;
+        for(long begin = 0; begin < sourceNodes.size() &&
+            rcArcs.size() <= nExpansionAdd; begin += roundSize){
+          long end = std::min( (long) sourceNodes.size(), begin + roundSize );
+          std::vector<RCList> arcs( end - begin );
+          std::vector<int> counts( end - begin, 0 );
+          Parallel::forBlocks(end - begin, 16, [&](int t, long b, long e){
+              for(long i=b; i<e; i++){
+                counts[i] = searchTarget(source, sourceNodes[begin+i],
+                    targetLevels, costCaches, rootT, p, arcs[i]);
               }
+          } );
 
-            }
-          }
-          if(rcArcs.size() > nExpansionAdd){
-            break;
+          for(long i=0; i<arcs.size() && rcArcs.size() <= nExpansionAdd; i++){
+            rcArcs.insert( rcArcs.end(), arcs[i].begin(), arcs[i].end() );
+            nComparisons += counts[i];
           }
         }
 
 #ifdef VERBOSE
         std::cout << "#Comparisons: " << nComparisons << std::endl;
 #endif
-        //int cutoff = rcArcs.size(); //nExpansionAdd;
-
-        //if(sortReducedCost){
-        //  rcArcs.sort();
-        //}
+        if(sortReducedCost){
+          Parallel::sort( rcArcs.begin(), rcArcs.end(),
+              std::less< ReducedCostPath<TPrecision> >() );
+        }
 
         TransportPlan<TPrecision> *newSol = new
           TransportPlan<TPrecision>(source, target);
@@ -292,6 +276,85 @@ class PotentialNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
   private:
 
 
+      //Descends the target hierarchy from the roots and collects the arcs from
+      //nFrom with small reduced cost, returns the number of comparisons
+      int searchTarget(MultiscaleTransportLevel<TPrecision> *source,
+          TransportNode<TPrecision> *nFrom,
+          std::vector< MultiscaleTransportLevel<TPrecision> * > &targetLevels,
+          std::vector< TransportCostCache<TPrecision> * > &costCaches,
+          MultiscaleTransportLevel<TPrecision> *rootT, TPrecision p, RCList &rcArcs){
+
+        int tScale = targetLevels.size() - 1;
+        TransportNodeVector &targetRootNodes = rootT->getNodes();
+
+        int nComparisons = 0;
+        std::list< TransportNode<TPrecision>* > queue;
+        queue.insert( queue.end(), targetRootNodes.begin(), targetRootNodes.end() );
+        std::list<int> scales;
+        scales.insert( scales.end(), targetRootNodes.size(), rootT->getScale() );
+
+        while( !queue.empty() ){
+          nComparisons++;
+
+          TransportNode<TPrecision> *nTo = queue.front();
+          queue.pop_front();
+          int s = scales.front();
+          scales.pop_front();
+
+          TPrecision delta = nFrom->getPiMax() - nTo->getPiMin();
+          //TPrecision delta = nFrom->getPiMax() + nTo->getPiMax();
+
+          //the reduced cost bound is monotone in the cost, with a non
+          //positive threshold a lower bound of the cost can rule out the
+          //node
+          if(reducedCostThresholdFactor <= 0){
+            TPrecision bound = source->getTransportCostLowerBound(nFrom,
+                targetLevels[s], nTo, 1, costCaches[s]);
+            if( reducedCost(bound, nTo, s < tScale, delta, p) >
+                reducedCostThresholdFactor * pow(bound, p) ){
+              continue;
+            }
+          }
+
+          TPrecision cost = -1;
+          cost = source->getTransportCost(nFrom, targetLevels[s], nTo, 1, costCaches[s]);
+
+          TPrecision rc = reducedCost(cost, nTo, s < tScale, delta, p);
+
+          if( rc <= reducedCostThresholdFactor * pow(cost,p) ){
+            if(s == tScale){
+              Path path(nFrom, nTo);
+              path.cost = pow(cost, p);
+              rcArcs.push_back( ReducedCostPath<TPrecision>(path, rc) );
+            }
+            else{
+              const TransportNodeVector &kids = nTo->getChildren();
+              queue.insert( queue.end(), kids.begin(), kids.end() );
+              scales.insert( scales.end(), kids.size(), s+1 );
+            }
+
+          }
+        }
+        return nComparisons;
+      };
+
+
+
+      //Reduced cost bound of the arcs to nTo or, for a coarser node, to its
+      //descendants
+      TPrecision reducedCost(TPrecision cost, TransportNode<TPrecision> *nTo,
+          bool coarse, TPrecision delta, TPrecision p){
+        TPrecision d = cost;
+        if(coarse){
+          d = d - nTo->getNodeRadius();
+        }
+        if(d > 0 ){
+          d = pow(d, p);
+        }
+        return d - delta;
+      };
+
+
       void potentialBounds(TransportNode<TPrecision> *node, int currentScale, int stopScale){
         if(currentScale == stopScale){
           return;
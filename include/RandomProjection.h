@@ -0,0 +1,385 @@
+#ifndef RANDOMPROJECTION_H
+#define RANDOMPROJECTION_H
+
+#include "GMRATree.h"
+#include "GMRADataObject.h"
+#include "NodeDistance.h"
+#include "EigenMetric.h"
+#include "EigenStreamingRandomRange.h"
+#include "Parallel.h"
+
+#include <Eigen/QR>
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+
+
+//Projection of one or two point sets (source and target) to a common lower
+//dimensional subspace for building the trees and the coarse scale costs.
+//The subspace is a randomized range of the centered union of the point
+//sets, with power iterations it approximates the leading principal
+//components. The basis is orthonormal, distances in the reduced space are
+//lower bounds of the full space distances.
+template <typename TPrecision>
+class RandomProjection{
+
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+
+    //Relative error 1 - |P(x-y)| / |x-y| of sampled pairwise distances
+    struct Distortion{
+      TPrecision mean;
+      TPrecision max;
+      Distortion() : mean(0), max(0){};
+    };
+
+
+  private:
+
+    int dimension;
+    int nPowerIt;
+    MatrixXp Q;
+    VectorXp mean;
+    TPrecision captured;
+
+
+    //Calls f(thread, x) for all points of the data objects, each point once
+    template <typename F>
+    static void forPoints(std::vector< GMRADataObject<TPrecision> * > &data,
+        long blockSize, F f){
+      for(int j=0; j<data.size(); j++){
+        GMRADataObject<TPrecision> *D = data[j];
+        Parallel::forBlocks(D->numberOfPoints(), blockSize, [&](int t, long begin, long end){
+            for(long i=begin; i<end; i++){
+              f(t, j, i, D->getPoint(i) );
+            }
+        } );
+      }
+    };
+
+
+
+  public:
+
+    RandomProjection(int d, int nPowerIterations = 1) : dimension(d),
+      nPowerIt(nPowerIterations), captured(1){
+    };
+
+
+
+    //Computes the basis from the points of D1 and, if not NULL, D2
+    void compute(GMRADataObject<TPrecision> *D1, GMRADataObject<TPrecision> *D2 = NULL){
+      using namespace Eigen;
+
+      std::vector< GMRADataObject<TPrecision> * > data(1, D1);
+      if(D2 != NULL){
+        data.push_back(D2);
+      }
+
+      int d = D1->dimension();
+      int k = std::min(dimension, d);
+      long blockSize = 4096;
+      long n = 0;
+      long nBlocks = 0;
+      for(int j=0; j<data.size(); j++){
+        n += data[j]->numberOfPoints();
+        nBlocks = std::max(nBlocks, (long) data[j]->numberOfPoints() );
+      }
+      nBlocks = (nBlocks + blockSize - 1) / blockSize;
+      int nThreads = Parallel::getNumberOfThreads();
+
+      //mean and range sketch, each block has its own seed
+      std::vector<VectorXp> sums( nThreads, VectorXp::Zero(d) );
+      std::vector< EigenLinalg::ColumnStreamingRandomRange<TPrecision> > ranges( nThreads,
+          EigenLinalg::ColumnStreamingRandomRange<TPrecision>(d, k) );
+      std::vector<long> seeded( nThreads, -1 );
+      forPoints(data, blockSize, [&](int t, int j, long i, const VectorXp &x){
+          long block = j*nBlocks + i / blockSize;
+          if(seeded[t] != block){
+            ranges[t].Seed(block);
+            seeded[t] = block;
+          }
+          sums[t] += x;
+          ranges[t].Add(x);
+      } );
+      for(int t=1; t<nThreads; t++){
+        sums[0] += sums[t];
+        ranges[0].Merge( ranges[t] );
+      }
+      mean = sums[0] / n;
+      Q = ranges[0].GetRange(mean);
+
+      for(int it=0; it<nPowerIt; it++){
+        std::vector<MatrixXp> Ys( nThreads, MatrixXp::Zero(d, k) );
+        forPoints(data, blockSize, [&](int t, int j, long i, const VectorXp &x){
+            VectorXp xc = x - mean;
+            Ys[t].noalias() += xc * (xc.transpose() * Q);
+        } );
+        for(int t=1; t<nThreads; t++){
+          Ys[0] += Ys[t];
+        }
+        HouseholderQR<MatrixXp> qr(Ys[0]);
+        Q = qr.householderQ() * MatrixXp::Identity(d, k);
+      }
+
+      //fraction of the variance in the subspace
+      std::vector<TPrecision> vars(nThreads, 0);
+      std::vector<TPrecision> pvars(nThreads, 0);
+      forPoints(data, blockSize, [&](int t, int j, long i, const VectorXp &x){
+          VectorXp xc = x - mean;
+          vars[t] += xc.squaredNorm();
+          pvars[t] += (Q.transpose() * xc).squaredNorm();
+      } );
+      TPrecision var = 0;
+      TPrecision pvar = 0;
+      for(int t=0; t<nThreads; t++){
+        var += vars[t];
+        pvar += pvars[t];
+      }
+      captured = var > 0 ? pvar / var : 1;
+    };
+
+
+
+    VectorXp project(const VectorXp &x) const{
+      return Q.transpose() * (x - mean);
+    };
+
+
+    //d x k orthonormal basis
+    MatrixXp &getBasis(){
+      return Q;
+    };
+
+
+    VectorXp &getMean(){
+      return mean;
+    };
+
+
+    int getDimension() const{
+      return Q.cols();
+    };
+
+
+    //Fraction of the variance of the point sets kept by the projection
+    TPrecision getCapturedVariance() const{
+      return captured;
+    };
+
+
+
+    //Estimates the distortion of the distances from nPairs random pairs of
+    //points within and, if D2 is not NULL, between the point sets
+    Distortion estimateDistortion(GMRADataObject<TPrecision> *D1,
+        GMRADataObject<TPrecision> *D2 = NULL, int nPairs = 1000,
+        unsigned long seed = 0) const{
+
+      std::mt19937_64 generator(seed);
+      GMRADataObject<TPrecision> *other = D2 == NULL ? D1 : D2;
+      std::uniform_int_distribution<int> u1(0, D1->numberOfPoints()-1);
+      std::uniform_int_distribution<int> u2(0, other->numberOfPoints()-1);
+
+      Distortion distortion;
+      int nUsed = 0;
+      for(int i=0; i<nPairs; i++){
+        VectorXp x = D1->getPoint( u1(generator) );
+        VectorXp y = i % 2 == 0 ? other->getPoint( u2(generator) ) :
+          D1->getPoint( u1(generator) );
+        VectorXp delta = x - y;
+        TPrecision d = delta.norm();
+        if(d <= 0){
+          continue;
+        }
+        TPrecision err = 1 - (Q.transpose() * delta).norm() / d;
+        distortion.mean += err;
+        distortion.max = std::max(distortion.max, err);
+        nUsed++;
+      }
+      if(nUsed > 0){
+        distortion.mean /= nUsed;
+      }
+      return distortion;
+    };
+
+};
+
+
+
+
+//Data object with the projected points of another data object, point
+//indices and masses are the same
+template <typename TPrecision>
+class ProjectedGMRADataObject : public GMRADataObject<TPrecision>{
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+  private:
+    GMRADataObject<TPrecision> *full;
+    MatrixXp Y;
+
+  public:
+
+    ProjectedGMRADataObject(GMRADataObject<TPrecision> *D,
+        const RandomProjection<TPrecision> &projection) : full(D){
+      Y.resize( projection.getDimension(), D->numberOfPoints() );
+      Parallel::forBlocks(Y.cols(), 4096, [&](int t, long begin, long end){
+          for(long i=begin; i<end; i++){
+            Y.col(i) = projection.project( full->getPoint(i) );
+          }
+      } );
+    };
+
+    virtual VectorXp getPoint(int i){
+      return Y.col(i);
+    };
+
+    virtual int numberOfPoints(){
+      return Y.cols();
+    };
+
+    virtual int dimension(){
+      return Y.rows();
+    };
+
+    virtual TPrecision getMass(int i){
+      return full->getMass(i);
+    };
+
+    GMRADataObject<TPrecision> *getFullDataObject(){
+      return full;
+    };
+
+};
+
+
+
+
+//Distance for trees built on projected points. Nodes of the finest scales
+//of the added trees get centers in the full space, the mean of their
+//original points. Pairs of such nodes are compared exactly with the metric,
+//all others with the reduced distance.
+//
+//The centers are keyed by the undecorated tree nodes, the nodes transport
+//costs are computed for. Neighborhood searches on a decorated tree pass the
+//decorators and stay in the reduced space, in which the node radii are
+//valid. After addTree the distance is safe to call concurrently.
+template <typename TPrecision>
+class ProjectedNodeDistance : public NodeDistance<TPrecision>{
+  public:
+    typedef typename GMRADataObject<TPrecision>::MatrixXp MatrixXp;
+    typedef typename GMRADataObject<TPrecision>::VectorXp VectorXp;
+
+  private:
+    NodeDistance<TPrecision> *reduced;
+    Metric<TPrecision> *metric;
+    std::unordered_map< GMRANode<TPrecision> *, VectorXp > centers;
+
+
+    static GMRANode<TPrecision> *undecorate(GMRANode<TPrecision> *node){
+      GMRANodeDecorator<TPrecision> *dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+      while(dec != NULL){
+        node = dec->getDecoratedNode();
+        dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+      }
+      return node;
+    };
+
+
+  public:
+
+    ProjectedNodeDistance(NodeDistance<TPrecision> *r, Metric<TPrecision> *m) :
+      reduced(r), metric(m){
+    };
+
+    ~ProjectedNodeDistance(){
+    };
+
+
+
+    void addSubtree(GMRANode<TPrecision> *top){
+      reduced->addSubtree(top);
+    };
+
+
+
+    //Computes full space centers from the original points in full for the
+    //leaves and the nodes of the nScales finest scales of the tree
+    void addTree(GMRATree<TPrecision> *tree, GMRADataObject<TPrecision> *full, int nScales){
+      class Collect : public Visitor<TPrecision>{
+        public:
+          std::vector< GMRANode<TPrecision> * > nodes;
+          int maxScale;
+          Collect() : maxScale(0){};
+          void visit(GMRANode<TPrecision> *node){
+            nodes.push_back(node);
+            maxScale = std::max(maxScale, node->getScale() );
+          };
+      };
+      if(tree->getRoot() == NULL){
+        return;
+      }
+      Collect collect;
+      tree->depthFirstVisitor(&collect);
+
+      std::vector< GMRANode<TPrecision> * > fine;
+      for(int i=0; i<collect.nodes.size(); i++){
+        GMRANode<TPrecision> *node = collect.nodes[i];
+        if( node->getChildren().empty() || node->getScale() > collect.maxScale - nScales ){
+          fine.push_back( node );
+        }
+      }
+
+      std::vector<VectorXp> means( fine.size() );
+      Parallel::forBlocks(fine.size(), 16, [&](int t, long begin, long end){
+          for(long i=begin; i<end; i++){
+            std::vector<int> &pts = fine[i]->getPoints();
+            means[i] = VectorXp::Zero( full->dimension() );
+            for(int j=0; j<pts.size(); j++){
+              means[i] += full->getPoint( pts[j] );
+            }
+            if( !pts.empty() ){
+              means[i] /= pts.size();
+            }
+          }
+      } );
+      for(int i=0; i<fine.size(); i++){
+        centers[ undecorate(fine[i]) ].swap( means[i] );
+      }
+    };
+
+
+
+    TPrecision distance(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2){
+      typename std::unordered_map< GMRANode<TPrecision> *, VectorXp >::const_iterator it1 =
+        centers.find(n1);
+      if( it1 != centers.end() ){
+        typename std::unordered_map< GMRANode<TPrecision> *, VectorXp >::const_iterator it2 =
+          centers.find(n2);
+        if( it2 != centers.end() ){
+          return metric->distance(it1->second, it2->second);
+        }
+      }
+      return reduced->distance(n1, n2);
+    };
+
+
+    //The reduced distance, the projection is orthonormal
+    bool hasLowerBound(){
+      return true;
+    };
+
+    TPrecision lowerBound(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2){
+      return reduced->distance(n1, n2);
+    };
+
+};
+
+
+#endif
@@ -2,8 +2,8 @@
 #define RANDOMIZEDPROPAGATIONSTRATEGY_H
 
 #include "NeighborhoodPropagationStrategy.h"
-#include "Random.h"
-#include <ctime>
+
+#include <random>
 
 
 template <typename TPrecision>
@@ -37,36 +37,32 @@ class RandomizedPropagationStrategy : public NeighborhoodPropagationStrategy<TPr
 
   protected:
 
-    virtual void computeAlternateSolutions(LPSolver *solver,
-                    TransportPlanSolutions<TPrecision> *pSol, double p, bool lastScale ){
+    //Each alternate solution perturbs the path costs by normal noise scaled
+    //to the cost range of the node radii
+    virtual void computeAlternateSolutions(TransportLPSolver<TPrecision> *solver,
+                      TransportPlanSolutions<TPrecision> *pSol, double p, bool lastScale ){
+
+      this->solveAlternateSolutions(solver, pSol, p, nRandom, 1,
+          [p](TransportLPSolver<TPrecision> *s, TransportPlan<TPrecision> *res,
+            std::mt19937_64 &generator){
+
+        std::normal_distribution<TPrecision> normal;
+        for( res->pathIteratorBegin(); !res->pathIteratorIsAtEnd();
+             res->pathIteratorNext() ){
+          Path &path = res->pathIteratorCurrent();
 
-      TransportPlan<TPrecision> *sol = pSol->getPrimarySolution();
-      for(int i=0; i<nRandom; i++){
-         
-        for( sol->pathIteratorBegin(); !sol->pathIteratorIsAtEnd();
-             sol->pathIteratorNext() ){
-          Path &path = sol->pathIteratorCurrent();            
-          
           TransportNode<TPrecision> *from = path.from;
           TransportNode<TPrecision> *to = path.to;
           TPrecision r = from->getNodeRadius() + to->getNodeRadius();
           TPrecision dist = pow(path.cost, 1.0/p);
           TPrecision delta = pow(dist+r, p) - pow(dist-r, p);
 
-          //TPrecision change = (random.Uniform()-0.5) * delta;
-          //TPrecision change = (random.Uniform()-0.5) * delta/2.0;
-          static Random<TPrecision> random;
-          TPrecision change = random.Normal() * delta/5.0;
-          //solver->setCoefficent(path.index, path.cost + change );
+          TPrecision change = normal(generator) * delta/5.0;
+          s->setColumnObjective(path.index, path.cost + change );
         }
 
-        solver->solveLP();
-
-        TransportPlan<TPrecision> *res = sol->createCopy();
-        TransportLPSolver<TPrecision>::storeLP(res, solver, p);
-        pSol->addAlternativeSolution(res);
-
-      }
+        s->solveLP();
+      } );
 
     };
 
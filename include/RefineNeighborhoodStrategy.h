@@ -130,6 +130,9 @@ class RefineNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
 
 
 
+      TransportNodeVector from;
+      TransportNodeVector to;
+      std::vector<TPrecision> radii;
       for( sol->pathIteratorBegin(); !sol->pathIteratorIsAtEnd();
           sol->pathIteratorNext() ){
 
@@ -151,30 +154,47 @@ class RefineNeighborhoodStrategy : public NeighborhoodStrategy<TPrecision> {
           TPrecision r = (rTo + rFrom) * rFactor;
           //r = powf(r, p);
 
-          TransportNodeVector f1N = sol->source->getNeighborhood(f1, r);
-          TransportNodeVector t1N = sol->target->getNeighborhood(t1, r);
-
-          for(TransportNodeVectorCIterator fIt = f1N.begin(); fIt !=
-              f1N.end(); ++fIt){
-
-            for(TransportNodeVectorCIterator tIt = t1N.begin(); tIt !=
-                t1N.end(); ++tIt){
-
-
-              TransportNode<TPrecision> *f2 = *fIt;
-              TransportNode<TPrecision> *t2 = *tIt;
-              Path p2(f2, t2);
+          from.push_back(f1);
+          to.push_back(t1);
+          radii.push_back(r);
+        }
+      }
 
-              if( !newSol->hasPath(p2) ){
-                //PathMapIterator find = allPaths.find(p2);
-                //if( find == allPaths.end() )
-                p2.cost = f2->getTransportCost(t2, p);
-                TPrecision rc = p2.cost - f2->getPotential() + t2->getPotential();
-                if( rc <= 0 ){
-                  newSol->addPath(p2);
-                }
-              } 
-            }
+      //neighborhoods of the endpoints, one batch per level
+      std::vector<TransportNodeVector> fN = sol->source->getNeighborhoods(from, radii);
+      std::vector<TransportNodeVector> tN = sol->target->getNeighborhoods(to, radii);
+      TransportCostCache<TPrecision> *cache =
+        newSol->source->getTransportCostCache(newSol->target, p);
+      for(int i=0; i<from.size(); i++){
+        TransportNodeVector &f1N = fN[i];
+        TransportNodeVector &t1N = tN[i];
+
+        for(TransportNodeVectorCIterator fIt = f1N.begin(); fIt !=
+            f1N.end(); ++fIt){
+
+          for(TransportNodeVectorCIterator tIt = t1N.begin(); tIt !=
+              t1N.end(); ++tIt){
+
+
+            TransportNode<TPrecision> *f2 = *fIt;
+            TransportNode<TPrecision> *t2 = *tIt;
+            Path p2(f2, t2);
+
+            if( !newSol->hasPath(p2) ){
+              //PathMapIterator find = allPaths.find(p2);
+              //if( find == allPaths.end() )
+              //exact costs only for arcs the lower bound does not rule out
+              TPrecision delta = f2->getPotential() - t2->getPotential();
+              if( newSol->source->getTransportCostLowerBound(f2, newSol->target, t2, p, cache)
+                  - delta > 0 ){
+                continue;
+              }
+              p2.cost = newSol->source->getTransportCost(f2, newSol->target, t2, p, cache);
+              TPrecision rc = p2.cost - delta;
+              if( rc <= 0 ){
+                newSol->addPath(p2);
+              }
+            } 
           }
         }
       }
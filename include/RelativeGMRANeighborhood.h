@@ -41,7 +41,7 @@ class RelativeGMRANeighborhood : public GMRANeighborhood<TPrecision>{
         
         Neighbor &n = nodes.front();
 
-        NodeVector kids = n.second->getChildren();
+        NodeVector &kids = n.second->getChildren();
         
         if( n.second->isStop() || kids.size() == 0 || n.second->getScale() == stopScale ){
           if(n.first <= eps + n.second->getRadius() + xr){
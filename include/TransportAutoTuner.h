@@ -0,0 +1,305 @@
+#ifndef TRANSPORTAUTOTUNER_H
+#define TRANSPORTAUTOTUNER_H
+
+#include "ExpandNeighborhoodStrategy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+
+//Adapts the settings of a MultiscaleTransportLP from scale to scale. After
+//each scale the tuner gets the size of the LP, the time it took and what the
+//refinement by an ExpandNeighborhoodStrategy gained:
+//
+// - Refinement iterations: the number needed if the refinement converged or
+//   became too slow, one more if the limit cut it off while still improving.
+// - Expansion factor: shrinks if the added paths did not decrease the
+//   objective, grows if the limit cut off the refinement.
+// - Paths added per batch: bounded so a batch grows the LP of the next
+//   scale by at most maxGrowth times its number of paths.
+// - Cutoff for the second propagation strategy: with a time budget per
+//   scale, the scales after the first one whose extrapolated time exceeds
+//   the budget use the second strategy.
+//
+//Setting a minimum improvement rate on the strategy stops the refinement as
+//soon as its batches decrease the objective too slowly. Times are wall clock
+//times. The settings that do not depend on the size of the scale can be
+//saved after a run and loaded for the next one. A file holds the settings
+//of several dataset profiles, see makeProfile, save and load only touch the
+//settings of the profile of the tuner.
+template <typename TPrecision>
+class TransportAutoTuner{
+
+  public:
+
+    struct Scale{
+      long nNodes;
+      long nPaths;
+      double seconds;
+      TPrecision cost;
+      bool refined;
+      int nIterations;
+      long nAdded;
+      TPrecision improvement;
+    };
+
+
+  private:
+
+    ExpandNeighborhoodStrategy<TPrecision> *expand;
+    double maxScaleSeconds;
+
+    int maxIterations;
+    TPrecision minFactor;
+    TPrecision maxFactor;
+    TPrecision maxGrowth;
+    long maxNeighborhoodSize;
+
+    std::string profile;
+
+    std::vector<Scale> scales;
+
+
+    typedef std::map< std::string, std::vector<std::string> > ProfileMap;
+
+    //Settings lines by profile, false if filename is not a tuner file
+    static bool readProfiles(const std::string &filename, ProfileMap &profiles){
+      std::ifstream file;
+      file.open( filename.c_str() );
+      if( !file.is_open() ){
+        return false;
+      }
+      std::string line;
+      getline(file, line);
+      if( line.compare("TransportAutoTuner") != 0 ){
+        return false;
+      }
+      std::string current;
+      while( getline(file, line) ){
+        if( line.compare(0, 9, "Profile: ") == 0 ){
+          current = line.substr(9);
+          profiles[current];
+        }
+        else if( !line.empty() ){
+          profiles[current].push_back(line);
+        }
+      }
+      return true;
+    };
+
+
+
+  public:
+
+    //Tunes expand, if not NULL, and the cutoff of the second propagation
+    //strategy if maxSeconds > 0
+    TransportAutoTuner(ExpandNeighborhoodStrategy<TPrecision> *e, double maxSeconds = 0) :
+      expand(e), maxScaleSeconds(maxSeconds), maxIterations(8), minFactor(1),
+      maxFactor(4), maxGrowth(2), maxNeighborhoodSize(-1){
+    };
+
+
+
+    void setIterationLimit(int n){
+      maxIterations = n;
+    };
+
+    void setExpansionFactorRange(TPrecision minF, TPrecision maxF){
+      minFactor = minF;
+      maxFactor = maxF;
+    };
+
+    void setMaxGrowth(TPrecision g){
+      maxGrowth = g;
+    };
+
+
+    //Cutoff tuned or loaded, -1 if none
+    long getMaxNeighborhoodSize(){
+      return maxNeighborhoodSize;
+    };
+
+
+    std::vector<Scale> &getScales(){
+      return scales;
+    };
+
+
+    //Profile of the settings saved and loaded, empty (default) for a single
+    //unnamed profile
+    void setProfile(const std::string &p){
+      profile = p;
+    };
+
+    const std::string &getProfile(){
+      return profile;
+    };
+
+
+    //Profile key for datasets with about nSource and nTarget points of the
+    //given dimension and tree type, sizes are rounded to powers of two
+    static std::string makeProfile(long nSource, long nTarget, int dimension,
+        const std::string &treeType){
+      std::ostringstream key;
+      key << "n" << (int) round( log2( std::max(1L, nSource) ) ) << "-"
+          << (int) round( log2( std::max(1L, nTarget) ) ) << "_d" << dimension
+          << "_" << treeType;
+      return key.str();
+    };
+
+
+
+    //Records a scale with nNodes source and target nodes solved in seconds
+    //into sol. refined is set if the neighborhood strategies ran, the
+    //statistics of expand are then those of the scale. Adapts the settings
+    //for the next scale.
+    void addScale(long nNodes, TransportPlan<TPrecision> *sol, double seconds,
+        bool refined){
+      Scale scale;
+      scale.nNodes = nNodes;
+      scale.nPaths = sol->getNumberOfPaths();
+      scale.seconds = seconds;
+      scale.cost = sol->cost;
+      scale.refined = refined && expand != NULL;
+      scale.nIterations = 0;
+      scale.nAdded = 0;
+      scale.improvement = 0;
+
+      if(scale.refined){
+        typename ExpandNeighborhoodStrategy<TPrecision>::Statistics &stats =
+          expand->getStatistics();
+        scale.nIterations = stats.nIterations;
+        scale.nAdded = stats.nAdded;
+        if( stats.initialObjective > 0 ){
+          scale.improvement = (stats.initialObjective - stats.objective) /
+            stats.initialObjective;
+        }
+
+        int nIters = expand->getNumberOfRefinementIterations();
+        TPrecision factor = expand->getExpansionFactor();
+        if( stats.converged || stats.slow ){
+          nIters = std::max(1, stats.nIterations);
+        }
+        else if( stats.nIterations >= nIters ){
+          nIters = std::min(maxIterations, nIters + 1);
+          factor *= 1.1;
+        }
+        if( stats.nAdded > 0 && scale.improvement <= 0 ){
+          factor *= 0.9;
+        }
+        expand->setNumberOfRefinementIterations(nIters);
+        expand->setExpansionFactor( std::max(minFactor, std::min(maxFactor, factor) ) );
+      }
+
+      //next scale, nodes and paths grow as from the previous scale
+      TPrecision nodeGrowth = 4;
+      if( !scales.empty() && scales.back().nNodes > 0 ){
+        nodeGrowth = std::max( (TPrecision) 1, (TPrecision) nNodes / scales.back().nNodes );
+      }
+      if(expand != NULL){
+        double nAdd = maxGrowth * nodeGrowth * scale.nPaths;
+        expand->setNumberOfExpansionAdd( (int) std::max(1000.0, std::min(nAdd, 1e9) ) );
+      }
+      if( maxScaleSeconds > 0 && maxNeighborhoodSize < 0 &&
+          seconds * pow(nodeGrowth, 1.5) > maxScaleSeconds ){
+        maxNeighborhoodSize = nNodes;
+      }
+
+      scales.push_back(scale);
+
+#ifdef VERBOSE
+      std::cout << "Tuner scale: " << scales.size() << " nodes: " << nNodes <<
+        " paths: " << scale.nPaths << " seconds: " << seconds <<
+        " improvement: " << scale.improvement << std::endl;
+#endif
+    };
+
+
+
+    //Clears the recorded scales, keeps the settings
+    void reset(){
+      scales.clear();
+    };
+
+
+
+    //Saves the settings of the profile to filename, the settings of other
+    //profiles in the file are kept
+    bool save(const std::string &filename){
+      ProfileMap profiles;
+      readProfiles(filename, profiles);
+      std::vector<std::string> &lines = profiles[profile];
+      lines.clear();
+      std::ostringstream line;
+      if(expand != NULL){
+        line << "ExpansionFactor: " << expand->getExpansionFactor();
+        lines.push_back( line.str() );
+        line.str("");
+        line << "RefinementIterations: " << expand->getNumberOfRefinementIterations();
+        lines.push_back( line.str() );
+        line.str("");
+      }
+      line << "MaxNeighborhoodSize: " << maxNeighborhoodSize;
+      lines.push_back( line.str() );
+
+      std::ofstream file;
+      file.open( filename.c_str() );
+      if( !file.is_open() ){
+        return false;
+      }
+      file << "TransportAutoTuner" << std::endl;
+      for(typename ProfileMap::iterator it = profiles.begin(); it != profiles.end(); ++it){
+        file << "Profile: " << it->first << std::endl;
+        for(int i=0; i<it->second.size(); i++){
+          file << it->second[i] << std::endl;
+        }
+      }
+      file.close();
+      return !file.fail();
+    };
+
+
+
+    //Settings of the profile saved by a previous run, false if there are
+    //none
+    bool load(const std::string &filename){
+      ProfileMap profiles;
+      if( !readProfiles(filename, profiles) ){
+        return false;
+      }
+      typename ProfileMap::iterator it = profiles.find(profile);
+      if( it == profiles.end() ){
+        return false;
+      }
+      std::vector<std::string> &lines = it->second;
+      for(int i=0; i<lines.size(); i++){
+        std::istringstream line( lines[i] );
+        std::string token;
+        double value;
+        if( !(line >> token >> value) ){
+          continue;
+        }
+        if( token == "ExpansionFactor:" && expand != NULL ){
+          expand->setExpansionFactor(value);
+        }
+        else if( token == "RefinementIterations:" && expand != NULL ){
+          expand->setNumberOfRefinementIterations( (int) value );
+        }
+        else if( token == "MaxNeighborhoodSize:" ){
+          maxNeighborhoodSize = (long) value;
+        }
+      }
+      return true;
+    };
+
+};
+
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef TRANSPORTCOSTCACHE_H
+#define TRANSPORTCOSTCACHE_H
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+
+
+//Transport costs between the nodes of two levels keyed by the packed node
+//ids. The table is split into shards by hash, each an open addressing table
+//with linear probing and its own lock, so lookups and inserts are safe to
+//call concurrently and rarely contend.
+template <typename TPrecision>
+class TransportCostCache{
+
+  private:
+
+    enum{ N_SHARDS = 64 };
+
+    struct Shard{
+      std::mutex mutex;
+      std::vector<uint64_t> keys;
+      std::vector<TPrecision> costs;
+      long size;
+      Shard() : size(0){};
+    };
+
+    std::vector<Shard> shards;
+
+
+
+    static uint64_t emptyKey(){
+      return ~(uint64_t) 0;
+    };
+
+
+    static uint64_t pack(int from, int to){
+      return ( (uint64_t) (uint32_t) from << 32 ) | (uint32_t) to;
+    };
+
+
+    static uint64_t hash(uint64_t key){
+      key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+      return key ^ (key >> 31);
+    };
+
+
+
+    //Resizes to a power of two at least twice the size, the shard has to be
+    //locked
+    static void rehash(Shard &shard, long capacity){
+      long n = 16;
+      while(n < 2 * capacity){
+        n *= 2;
+      }
+      std::vector<uint64_t> keys(n, emptyKey());
+      std::vector<TPrecision> costs(n);
+      for(long i=0; i<shard.keys.size(); i++){
+        if(shard.keys[i] == emptyKey()){
+          continue;
+        }
+        long j = (hash(shard.keys[i]) / N_SHARDS) & (n-1);
+        while(keys[j] != emptyKey()){
+          j = (j+1) & (n-1);
+        }
+        keys[j] = shard.keys[i];
+        costs[j] = shard.costs[i];
+      }
+      shard.keys.swap(keys);
+      shard.costs.swap(costs);
+    };
+
+
+
+  public:
+
+    TransportCostCache() : shards(N_SHARDS){
+    };
+
+
+
+    //Sizes the table for n costs
+    void reserve(long n){
+      for(int i=0; i<N_SHARDS; i++){
+        Shard &shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        long capacity = n / N_SHARDS + 1;
+        if( shard.keys.size() < 2 * capacity ){
+          rehash(shard, capacity);
+        }
+      }
+    };
+
+
+
+    bool find(int from, int to, TPrecision &cost){
+      uint64_t key = pack(from, to);
+      uint64_t h = hash(key);
+      Shard &shard = shards[h % N_SHARDS];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      long n = shard.keys.size();
+      if(n == 0){
+        return false;
+      }
+      long j = (h / N_SHARDS) & (n-1);
+      while(shard.keys[j] != emptyKey()){
+        if(shard.keys[j] == key){
+          cost = shard.costs[j];
+          return true;
+        }
+        j = (j+1) & (n-1);
+      }
+      return false;
+    };
+
+
+
+    void insert(int from, int to, TPrecision cost){
+      uint64_t key = pack(from, to);
+      uint64_t h = hash(key);
+      Shard &shard = shards[h % N_SHARDS];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if( 2 * (shard.size + 1) > shard.keys.size() ){
+        rehash(shard, 2 * (shard.size + 1) );
+      }
+      long n = shard.keys.size();
+      long j = (h / N_SHARDS) & (n-1);
+      while(shard.keys[j] != emptyKey()){
+        if(shard.keys[j] == key){
+          shard.costs[j] = cost;
+          return;
+        }
+        j = (j+1) & (n-1);
+      }
+      shard.keys[j] = key;
+      shard.costs[j] = cost;
+      shard.size++;
+    };
+
+
+
+    long size(){
+      long n = 0;
+      for(int i=0; i<N_SHARDS; i++){
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        n += shards[i].size;
+      }
+      return n;
+    };
+
+
+
+    void clear(){
+      for(int i=0; i<N_SHARDS; i++){
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        shards[i].keys.clear();
+        shards[i].costs.clear();
+        shards[i].size = 0;
+      }
+    };
+
+};
+
+
+#endif
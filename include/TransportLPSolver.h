@@ -4,6 +4,7 @@
 
 #include "MultiscaleTransport.h"
 #include "LPSolver.h"
+#include "DenseTransportSolver.h"
 
 
 template <typename TPrecision>
@@ -60,6 +61,7 @@ class TransportLPSolver {
 
     LPSolver *solver;
     bool lastScale;
+    long denseSize;
 
   public:
 
@@ -68,7 +70,8 @@ class TransportLPSolver {
       transportType(type),
       massDeltaCost( massCost ),
       lambda(l),
-      lastScale(false)
+      lastScale(false),
+      denseSize(250000)
    {
 
    };
@@ -79,6 +82,83 @@ class TransportLPSolver {
      lastScale=last;
    };
 
+   //Solver with the same settings on lpSolver, which the caller owns
+   TransportLPSolver<TPrecision> *createSolver(LPSolver *lpSolver){
+     TransportLPSolver<TPrecision> *res = new TransportLPSolver<TPrecision>(
+         lpSolver, transportType, massDeltaCost, lambda);
+     res->lastScale = lastScale;
+     res->denseSize = denseSize;
+     return res;
+   };
+
+   LPSolver *getLPSolver(){
+     return solver;
+   };
+
+   //Largest number of source times target nodes solveDense accepts
+   void setDenseSize(long n){
+     denseSize = n;
+   };
+
+
+
+   //Solves balanced transport with paths between all source and target
+   //nodes with the dense transport solver, without setting up the LP. Stores
+   //the solution as storeLP, the potentials scaled as the duals of the LP
+   //solver. Returns false if the problem is not such or too large, or the
+   //solver did not finish.
+   bool solveDense(TransportPlan<TPrecision> *sol, TPrecision p){
+     typedef DenseTransportSolver<TPrecision> Dense;
+
+     long ns = sol->source->getNodes().size();
+     long nt = sol->target->getNodes().size();
+     if( transportType != BALANCED || ns * nt > denseSize ||
+         sol->getNumberOfPaths() != ns * nt ){
+       return false;
+     }
+
+     typename Dense::VectorXp a(ns);
+     typename Dense::VectorXp b(nt);
+     for(TransportNodeVectorCIterator it = sol->source->getNodes().begin(); it !=
+         sol->source->getNodes().end(); ++it){
+       a( (*it)->getID() ) = (*it)->getMass();
+     }
+     for(TransportNodeVectorCIterator it = sol->target->getNodes().begin(); it !=
+         sol->target->getNodes().end(); ++it){
+       b( (*it)->getID() ) = (*it)->getMass();
+     }
+     typename Dense::MatrixXp C(ns, nt);
+     for(sol->pathIteratorBegin(); !sol->pathIteratorIsAtEnd();
+         sol->pathIteratorNext() ){
+       Path &path = sol->pathIteratorCurrent();
+       C( path.from->getID(), path.to->getID() ) = path.cost;
+     }
+
+     Dense dense;
+     if( !dense.solve(a, b, C, 100 * (ns + nt) ) ){
+       return false;
+     }
+
+     typename Dense::MatrixXp &X = dense.getPlan();
+     for(sol->pathIteratorBegin(); !sol->pathIteratorIsAtEnd();
+         sol->pathIteratorNext() ){
+       Path &path = sol->pathIteratorCurrent();
+       path.w = X( path.from->getID(), path.to->getID() );
+     }
+     sol->cost = pow( dense.getCost(), 1.0/p );
+
+     double f = solver->getDualScaling( std::max( (double) C.maxCoeff(), massDeltaCost ) );
+     for(TransportNodeVectorCIterator it = sol->source->getNodes().begin(); it !=
+         sol->source->getNodes().end(); ++it){
+       (*it)->setPotential( f * dense.getSourcePotentials()( (*it)->getID() ) );
+     }
+     for(TransportNodeVectorCIterator it = sol->target->getNodes().begin(); it !=
+         sol->target->getNodes().end(); ++it){
+       (*it)->setPotential( -f * dense.getTargetPotentials()( (*it)->getID() ) );
+     }
+     return true;
+   };
+
    void createLP( TransportPlan<TPrecision> *sol ){
 
 #ifdef VERBOSE
@@ -377,7 +457,8 @@ class TransportLPSolver {
 
 
 
-   void storeLP(TransportPlan<TPrecision> *sol, TPrecision p){
+   //Stores cost and path weights of the solution
+   void storePaths(TransportPlan<TPrecision> *sol, TPrecision p){
      sol->cost = pow( this->getObjectiveValue(), 1.0/p );
 
      //Store solution
@@ -396,6 +477,12 @@ class TransportLPSolver {
      std::cout << "nonzeros: "      << nNonZero << std::endl;
      std::cout << "solution sumw: " << sumw     << std::endl << std::endl;
 #endif
+   };
+
+
+
+   void storeLP(TransportPlan<TPrecision> *sol, TPrecision p){
+     storePaths(sol, p);
 
      //Potential of from nodes
      for(TransportNodeVectorCIterator it = sol->source->getNodes().begin(); it !=
@@ -546,6 +633,19 @@ class TransportLPSolver {
       return solver->isOptimal();
     };
 
+    //Checks whether the LP is feasible, if not adds the path indices with
+    //upper bounds blocking a feasible solution to blocking
+    bool isFeasible(std::vector<long> &blocking){
+      std::vector<long> cols;
+      if( solver->isFeasible(cols, pathOffset) ){
+        return true;
+      }
+      for(int i=0; i<cols.size(); i++){
+        blocking.push_back( cols[i] - pathOffset );
+      }
+      return false;
+    };
+
     long getNumberOfRows(){
       return solver->getNumberOfRows();
     };
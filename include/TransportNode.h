@@ -1,6 +1,8 @@
 #ifndef TRANSPORTNODE_H 
 #define TRANSPORTNODE_H 
 
+#include <cstddef>
+#include <limits>
 #include <vector>
 
 
@@ -56,6 +58,18 @@ class TransportNode{
 
     void addChild(TransportNode *node){
       kids.push_back(node);
+      radius = -1;
+    };
+
+
+    void removeChild(TransportNode *node){
+      for(int i=0; i<kids.size(); i++){
+        if(kids[i] == node){
+          kids.erase( kids.begin() + i );
+          radius = -1;
+          return;
+        }
+      }
     };
 
 
@@ -80,7 +94,7 @@ class TransportNode{
 
     virtual TPrecision getTransportCostRadius(double p){
 
-      //NOTE: will *not* update if children are added after calling getRadius
+      //recomputed after the children change, not if the transport costs do
       if(radius < 0){
         radius = 0;
         for(TransportNodeVectorIterator it = kids.begin(); it != kids.end(); ++it){
@@ -108,6 +122,15 @@ class TransportNode{
     };
 
     virtual TPrecision getTransportCost(const TransportNode<TPrecision> *other, double p) const= 0;
+
+    //Cheaper lower bound of getTransportCost if hasTransportCostLowerBound
+    virtual bool hasTransportCostLowerBound() const{
+      return false;
+    };
+
+    virtual TPrecision getTransportCostLowerBound(const TransportNode<TPrecision> *other, double p) const{
+      return getTransportCost(other, p);
+    };
     //virtual TPrecision getDeltaTransportCost(TransportNode<TPrecision> *other, double p) const= 0;
 
     /*
@@ -157,6 +180,11 @@ class TransportNode{
       return id;
     };
 
+    //The id is the index of the node in its level
+    void setID(int nodeID){
+      id = nodeID;
+    };
+
     int getScale() const{
       return scale;
     };
@@ -4,6 +4,7 @@
 #include "TransportNode.h"
 #include "MultiscaleTransportLevel.h"
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <list>
@@ -266,6 +267,24 @@ class TransportPlan{
     std::vector<TPrecision> getMultiscaleTransportCost(int p){
       std::vector<TPrecision> costs( std::max(source->getScale(), target->getScale())+1, 0 );
 
+      //levels by scale, for the cost caches
+      std::vector< MultiscaleTransportLevel<TPrecision> * > sLevels( source->getScale()+1 );
+      for(MultiscaleTransportLevel<TPrecision> *l = source; l != NULL; l = l->getParent() ){
+        sLevels[ l->getScale() ] = l;
+      }
+      std::vector< MultiscaleTransportLevel<TPrecision> * > tLevels( target->getScale()+1 );
+      for(MultiscaleTransportLevel<TPrecision> *l = target; l != NULL; l = l->getParent() ){
+        tLevels[ l->getScale() ] = l;
+      }
+
+      //the term index of a path is between the ancestors of its nodes at
+      //scales min(index, source scale) and min(index, target scale)
+      std::vector< TransportCostCache<TPrecision> * > caches( costs.size() );
+      for(int i=0; i<caches.size(); i++){
+        caches[i] = sLevels[ std::min( i, source->getScale() ) ]->getTransportCostCache(
+            tLevels[ std::min( i, target->getScale() ) ], p );
+      }
+
       for( this->pathIteratorBegin(); !this->pathIteratorIsAtEnd();
            this->pathIteratorNext() ){
         Path &path = this->pathIteratorCurrent();
@@ -292,7 +311,8 @@ class TransportPlan{
 
           int index = 0;
           while(tIt != tNodes.rend() || fIt != fNodes.rend()){
-            costs[index] = costs[index] + from->getTransportCost(to, p) * path.w ;
+            costs[index] = costs[index] + sLevels[ from->getScale() ]->getTransportCost(
+                from, tLevels[ to->getScale() ], to, p, caches[index] ) * path.w ;
             ++index;
 
             if(tIt != tNodes.rend()){
@@ -4,60 +4,287 @@
 
 #include "NodeDistance.h"
 #include "GWT.h"
-#include "EigenWasserstein.h"
+#include "GMRATree.h"
+#include "Parallel.h"
 
+#include <Eigen/Eigenvalues>
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 
 
+
+//Wasserstein distance between the Gaussians of two GWT nodes, i.e.
+//W^2 = |m1 - m2|^2 + tr(S1) + tr(S2) - 2 tr( (S1^1/2 S2 S1^1/2)^1/2 ).
+//With S = B B^T, B = Phi diag(sigma), the last trace is the sum of the
+//singular values of B1^T B2, computed from the eigenvalues of the smaller
+//of its Gram matrices.
+//
+//Nodes that are not GWT decorated are treated as point masses at their
+//center, B is empty and tr(S) = 0.
+//
+//addSubtree precomputes B and tr(S) for all nodes below a node, keyed by the
+//nodes and their decorators. It is called by GMRATree::computeStatistics, so
+//the factors of a tree are computed when its statistics are, decorators
+//added later find the factor of the node they decorate. Other nodes are
+//factored on each call. Adding a tree root drops the factors of earlier
+//trees, a rebuilt tree may reuse the addresses of deleted nodes and their
+//decorators. Between calls of addSubtree the distance is safe to call
+//concurrently.
 template < typename TPrecision >
 class WassersteinNodeDistance : public NodeDistance<TPrecision> {
-  
-  public:  
+
+  public:
     typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
     typedef typename Eigen::Matrix<TPrecision, Eigen::Dynamic, 1> VectorXp;
 
   private:
-    Wasserstein<TPrecision> wstein;
+
+    struct Factor{
+      GMRANode<TPrecision> *node;
+      MatrixXp B;
+      TPrecision trace;
+    };
+
+    std::vector<Factor> factors;
+    std::unordered_map< GMRANode<TPrecision> *, int > index;
+
+
+
+    static GWTNode<TPrecision> *getGWTNode(GMRANode<TPrecision> *node){
+      GWTNode<TPrecision> *gwt = dynamic_cast<GWTNode<TPrecision> *>( node );
+      GMRANodeDecorator<TPrecision> *dec =
+        dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+      while(dec != NULL && gwt == NULL){
+        node = dec->getDecoratedNode();
+        gwt = dynamic_cast<GWTNode<TPrecision> *>( node );
+        dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+      }
+      return gwt;
+    };
+
+
+
+    static void factor(GMRANode<TPrecision> *node, Factor &f){
+      GWTNode<TPrecision> *gwt = getGWTNode(node);
+      if(gwt == NULL){
+        f.node = node;
+        f.B = MatrixXp( node->getCenter().size(), 0 );
+        f.trace = 0;
+        return;
+      }
+      MatrixXp &phi = gwt->getPhi();
+      VectorXp &sigma = gwt->getSigma();
+      int k = std::min( phi.cols(), sigma.size() );
+      f.node = gwt;
+      f.B = phi.leftCols(k) * sigma.head(k).cwiseAbs().asDiagonal();
+      f.trace = sigma.head(k).squaredNorm();
+    };
+
+
+
+    //Precomputed factor of node or of a node it decorates, NULL if there is
+    //none
+    const Factor *findFactor(GMRANode<TPrecision> *node) const{
+      while(node != NULL){
+        typename std::unordered_map< GMRANode<TPrecision> *, int >::const_iterator it =
+          index.find(node);
+        if( it != index.end() ){
+          return &factors[it->second];
+        }
+        GMRANodeDecorator<TPrecision> *dec =
+          dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+        node = dec == NULL ? NULL : dec->getDecoratedNode();
+      }
+      return NULL;
+    };
+
+
+
+    //Factor of node, computed into tmp if it is not precomputed
+    const Factor &getFactor(GMRANode<TPrecision> *node, Factor &tmp) const{
+      const Factor *f = findFactor(node);
+      if(f != NULL){
+        return *f;
+      }
+      factor(node, tmp);
+      return tmp;
+    };
+
+
+
+    VectorXp &getGWTCenter(GMRANode<TPrecision> *node) const{
+      const Factor *f = findFactor(node);
+      if(f != NULL){
+        return f->node->getCenter();
+      }
+      GWTNode<TPrecision> *gwt = getGWTNode(node);
+      return gwt == NULL ? node->getCenter() : gwt->getCenter();
+    };
+
+
+
+    //Sum of the singular values of M
+    static TPrecision nuclearNorm(const MatrixXp &M){
+      if(M.size() == 0){
+        return 0;
+      }
+      MatrixXp G;
+      if(M.rows() <= M.cols()){
+        G.noalias() = M * M.transpose();
+      }
+      else{
+        G.noalias() = M.transpose() * M;
+      }
+      Eigen::SelfAdjointEigenSolver<MatrixXp> eig(G, Eigen::EigenvaluesOnly);
+      TPrecision sum = 0;
+      for(int i=0; i<eig.eigenvalues().size(); i++){
+        sum += sqrt( std::max( (TPrecision) 0, eig.eigenvalues()(i) ) );
+      }
+      return sum;
+    };
+
+
+
+    static TPrecision distance(const Factor &f1, const Factor &f2, const MatrixXp &M){
+      TPrecision d = (f1.node->getCenter() - f2.node->getCenter()).squaredNorm() +
+        f1.trace + f2.trace - 2 * nuclearNorm(M);
+      return sqrt( std::max( (TPrecision) 0, d ) );
+    };
+
+
 
   public:
 
     WassersteinNodeDistance(){};
     ~WassersteinNodeDistance(){};
 
-    TPrecision distance(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2){
-      GWTNode<TPrecision> *gwt1 = dynamic_cast<GWTNode<TPrecision> *>( n1 );
-      if(gwt1 == NULL){
-        GMRANodeDecorator<TPrecision> *dec =
-          dynamic_cast< GMRANodeDecorator<TPrecision> *>( n1 );
-        while(dec != NULL && gwt1==NULL){
-           n1 = dec->getDecoratedNode();
-           gwt1 = dynamic_cast<GWTNode<TPrecision> *>( n1 ); 
-           dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( n1 );
 
-        }
+
+    //Precomputes the factors of all nodes of the tree
+    void addTree(GMRATree<TPrecision> *tree){
+      addSubtree( tree->getRoot() );
+    };
+
+
+
+    //Precomputes the factors of top and all nodes below it. Nodes that
+    //already have a factor are factored again into the same slot. If top is
+    //a root all earlier factors are dropped first.
+    void addSubtree(GMRANode<TPrecision> *top){
+      if(top == NULL){
+        return;
+      }
+      if(top->getParent() == NULL){
+        index.clear();
+        factors.clear();
+      }
+      std::vector< GMRANode<TPrecision> * > nodes(1, top);
+      for(long i=0; i<nodes.size(); i++){
+        std::vector< GMRANode<TPrecision> * > &kids = nodes[i]->getChildren();
+        nodes.insert( nodes.end(), kids.begin(), kids.end() );
       }
 
-      GWTNode<TPrecision> *gwt2 = dynamic_cast<GWTNode<TPrecision> *>( n2 );
-      if(gwt2 == NULL){
-        GMRANodeDecorator<TPrecision> *dec =
-          dynamic_cast< GMRANodeDecorator<TPrecision> *>( n2 );
-        while(dec != NULL && gwt2==NULL){
-          n2 = dec->getDecoratedNode();
-          gwt2 = dynamic_cast<GWTNode<TPrecision> *>( n2 ); 
-          dec = dynamic_cast< GMRANodeDecorator<TPrecision> *>( n2 );
+      std::vector<int> slots( nodes.size() );
+      for(int i=0; i<nodes.size(); i++){
+        typename std::unordered_map< GMRANode<TPrecision> *, int >::iterator it =
+          index.find( nodes[i] );
+        if( it != index.end() ){
+          slots[i] = it->second;
+        }
+        else{
+          slots[i] = factors.size();
+          factors.push_back( Factor() );
+        }
+      }
+      Parallel::forBlocks(nodes.size(), 64, [&](int t, long begin, long end){
+          for(long i=begin; i<end; i++){
+            factor( nodes[i], factors[ slots[i] ] );
+          }
+      } );
 
+      //the node, its decorators and the GWT node share the factor
+      for(int i=0; i<nodes.size(); i++){
+        GMRANode<TPrecision> *node = nodes[i];
+        while(node != NULL){
+          index[node] = slots[i];
+          if(node == factors[ slots[i] ].node){
+            break;
+          }
+          GMRANodeDecorator<TPrecision> *dec =
+            dynamic_cast< GMRANodeDecorator<TPrecision> *>( node );
+          node = dec == NULL ? NULL : dec->getDecoratedNode();
         }
       }
+    };
+
+
+
+    TPrecision distance(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2){
+      Factor tmp1;
+      Factor tmp2;
+      const Factor &f1 = getFactor(n1, tmp1);
+      const Factor &f2 = getFactor(n2, tmp2);
+      MatrixXp M;
+      if(f1.B.rows() == f2.B.rows() ){
+        M.noalias() = f1.B.transpose() * f2.B;
+      }
+      return distance(f1, f2, M);
+    };
 
 
-      VectorXp sigma12 = gwt1->getSigma().array().square();
-      VectorXp sigma22 = gwt2->getSigma().array().square();
 
+    //Distance of the means
+    bool hasLowerBound(){
+      return true;
+    };
 
-      TPrecision d = wstein.distance( gwt1->getPhi(), sigma12,
-          gwt1->getCenter(), gwt2->getPhi(), sigma22, gwt2->getCenter() );
-      return d;
+    TPrecision lowerBound(GMRANode<TPrecision> *n1, GMRANode<TPrecision> *n2){
+      return (getGWTCenter(n1) - getGWTCenter(n2)).norm();
+    };
+
+
+
+    //Stacks the factors of the nodes and multiplies them with the factor of
+    //x in a single product
+    void distances(GMRANode<TPrecision> *x, const std::vector< GMRANode<TPrecision> * > &nodes,
+        std::vector<TPrecision> &result){
+
+      Factor tmp;
+      const Factor &fx = getFactor(x, tmp);
+      std::vector<Factor> tmps( nodes.size() );
+      std::vector<const Factor *> fs( nodes.size() );
+      long nCols = 0;
+      for(int i=0; i<nodes.size(); i++){
+        fs[i] = &getFactor(nodes[i], tmps[i]);
+        if( fs[i]->B.rows() == fx.B.rows() ){
+          nCols += fs[i]->B.cols();
+        }
+      }
+
+      MatrixXp B( fx.B.rows(), nCols );
+      long col = 0;
+      for(int i=0; i<nodes.size(); i++){
+        if( fs[i]->B.rows() == fx.B.rows() ){
+          B.middleCols( col, fs[i]->B.cols() ) = fs[i]->B;
+          col += fs[i]->B.cols();
+        }
+      }
+      MatrixXp M = fx.B.transpose() * B;
+
+      result.resize( nodes.size() );
+      col = 0;
+      for(int i=0; i<nodes.size(); i++){
+        if( fs[i]->B.rows() == fx.B.rows() ){
+          result[i] = distance( fx, *fs[i], M.middleCols( col, fs[i]->B.cols() ) );
+          col += fs[i]->B.cols();
+        }
+        else{
+          result[i] = distance( fx, *fs[i], MatrixXp() );
+        }
+      }
     };
 
 };
@@ -66,4 +293,3 @@ class WassersteinNodeDistance : public NodeDistance<TPrecision> {
 
 
 #endif
-
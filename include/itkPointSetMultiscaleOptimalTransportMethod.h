@@ -94,6 +94,105 @@ public:
 
   itkSetMacro(NumberOfScalesSource, int);
   itkGetMacro(NumberOfScalesSource, int);
+
+  /** Multiscale point set representation. K-means trees adapt to the data,
+   * ball trees split at coordinate medians and are built in O(n log n)
+   * independent of the data. Morton trees are linear octrees (quadtrees in
+   * 2D) built by sorting Morton codes, the fastest option for 2D and 3D
+   * point sets. Morton trees support at most 7 dimensions, the filter throws
+   * for higher dimensional point sets unless projected to at most 7. Ball
+   * trees use the number of kids, minimum points and epsilon (relative
+   * radius) settings, Morton trees the latter two. */
+  enum TreeType {KMEANS_TREE, BALL_TREE, MORTON_TREE};
+  itkSetMacro(TreeType, TreeType);
+  itkGetMacro(TreeType, TreeType);
+
+  /** Split GMRA nodes by bisecting offending clusters instead of rerunning
+   * k-means on all points of the node. */
+  itkSetMacro(BisectingSplit, bool);
+  itkGetMacro(BisectingSplit, bool);
+  itkBooleanMacro(BisectingSplit);
+
+  /** Cached GMRA tree files. If set and the file holds a tree built on the
+   * same points (compared by a checksum of the coordinates) the tree is
+   * memory mapped instead of built, otherwise the tree is built and written
+   * to the file. The file is not checked against the GMRA settings. */
+  itkSetStringMacro(SourceTreeFileName);
+  itkGetStringMacro(SourceTreeFileName);
+
+  itkSetStringMacro(TargetTreeFileName);
+  itkGetStringMacro(TargetTreeFileName);
+
+  /** Find neighborhoods with locality sensitive hashing instead of tree
+   * searches. Faster for high dimensional point sets, in which the node radii
+   * prune little, at the cost of missing a small fraction of neighbors. */
+  itkSetMacro(ApproximateNeighborhoods, bool);
+  itkGetMacro(ApproximateNeighborhoods, bool);
+  itkBooleanMacro(ApproximateNeighborhoods);
+
+  /** Recall of the approximate neighborhoods. Each of the hash tables buckets
+   * the node centers by a number of random projections with a bucket width
+   * relative to the local radii of the scale. More tables or a wider bucket
+   * find more neighbors at a higher query cost, more hashes per table fewer
+   * candidates. Scales with fewer nodes than the minimum level size are
+   * searched exactly. Defaults 16 tables, 6 hashes, width 4, 256 nodes. */
+  itkSetMacro(NeighborhoodNumberOfTables, int);
+  itkGetMacro(NeighborhoodNumberOfTables, int);
+  itkSetMacro(NeighborhoodNumberOfHashes, int);
+  itkGetMacro(NeighborhoodNumberOfHashes, int);
+  itkSetMacro(NeighborhoodBucketWidth, double);
+  itkGetMacro(NeighborhoodBucketWidth, double);
+  itkSetMacro(NeighborhoodMinimumLevelSize, int);
+  itkGetMacro(NeighborhoodMinimumLevelSize, int);
+
+  /** Number the nodes of each scale along a Hilbert curve through their
+   * centers before solving, for better memory locality of the transport
+   * problems. Off by default. */
+  itkSetMacro(SpatialNodeOrder, bool);
+  itkGetMacro(SpatialNodeOrder, bool);
+  itkBooleanMacro(SpatialNodeOrder);
+
+  /** Solve the connected components of the transport problems separately
+   * and concurrently. Exact, at fine scales the candidate paths often split
+   * the problem into many independent parts. Off by default. */
+  itkSetMacro(DecomposeComponents, bool);
+  itkGetMacro(DecomposeComponents, bool);
+  itkBooleanMacro(DecomposeComponents);
+
+  /** Solve the transport problems again after paths were added starting
+   * from their previous solution, after the given number of sweeps over
+   * blocks of the problem solved concurrently. The final solve is exact.
+   * Blocks work best with SpatialNodeOrder on. -1 (default) solves each
+   * problem from scratch. */
+  itkSetMacro(NumberOfBlockSweeps, int);
+  itkGetMacro(NumberOfBlockSweeps, int);
+
+  /** Random projection of both point sets to a common subspace of the given
+   * dimension before building the trees, 0 (default) to disable. The trees,
+   * neighborhoods and coarse scale costs use the reduced points, leaves and
+   * the nodes of the NumberOfExactScales finest scales use exact costs in the
+   * full space. The captured variance and the distortion of sampled pairwise
+   * distances are reported. */
+  itkSetMacro(ProjectionDimension, int);
+  itkGetMacro(ProjectionDimension, int);
+  itkSetMacro(NumberOfExactScales, int);
+  itkGetMacro(NumberOfExactScales, int);
+
+  /** Adapt the expansion factor, refinement iterations and paths added per
+   * batch of the first ExpandNeighborhoodStrategy from scale to scale. With
+   * a positive AutoTuneScaleSeconds the scales after the first one expected
+   * to exceed this wall clock time use the second propagation strategy. If
+   * AutoTuneFileName is set, the settings learned for the profile of the
+   * point sets (sizes rounded to powers of two, dimension and tree type) are
+   * loaded from it before solving and saved to it afterwards. Off by
+   * default. */
+  itkSetMacro(AutoTune, bool);
+  itkGetMacro(AutoTune, bool);
+  itkBooleanMacro(AutoTune);
+  itkSetStringMacro(AutoTuneFileName);
+  itkGetStringMacro(AutoTuneFileName);
+  itkSetMacro(AutoTuneScaleSeconds, double);
+  itkGetMacro(AutoTuneScaleSeconds, double);
   
   void AddNeighborhoodPropagationStrategy(NeighborhoodStrategyType *strategy)
     {
@@ -143,6 +242,25 @@ private:
   /**
    * GMRA (mutliscale point set representation settings)
    */
+  TreeType m_TreeType;
+  bool m_BisectingSplit;
+
+  std::string m_SourceTreeFileName;
+  std::string m_TargetTreeFileName;
+  bool m_ApproximateNeighborhoods;
+  int m_NeighborhoodNumberOfTables;
+  int m_NeighborhoodNumberOfHashes;
+  double m_NeighborhoodBucketWidth;
+  int m_NeighborhoodMinimumLevelSize;
+  bool m_SpatialNodeOrder;
+  bool m_DecomposeComponents;
+  int m_NumberOfBlockSweeps;
+  int m_ProjectionDimension;
+  int m_NumberOfExactScales;
+  bool m_AutoTune;
+  std::string m_AutoTuneFileName;
+  double m_AutoTuneScaleSeconds;
+
   SplitCriterium    m_SourceSplitCriterium;
   StoppingCriterium m_SourceStoppingCriterium;
   
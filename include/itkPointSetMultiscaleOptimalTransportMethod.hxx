@@ -21,13 +21,19 @@
 #include "itkPointSetMultiscaleOptimalTransportMethod.h"
 #include "PointSetGMRADataObject.h"
 #include "IKMTree.h"
+#include "MappedGMRATree.h"
+#include "BallTree.h"
+#include "MortonTree.h"
 #include "LemonSolver.h"
 #include "IteratedCapacityPropagationStrategy.h"
 #include "EigenEuclideanMetric.h"
 #include "GMRANeighborhood.h"
+#include "LSHGMRANeighborhood.h"
 #include "GMRAMultiscaleTransport.h"
 #include "MultiscaleTransportLP.h"
 #include "ExpandNeighborhoodStrategy.h"
+#include "RandomProjection.h"
+#include "TransportAutoTuner.h"
 
 namespace itk
 {
@@ -49,6 +55,21 @@ PointSetMultiscaleOptimalTransportMethod< TSourcePointSet, TTargetPointSet, TVal
   m_NumberOfScalesTarget= -1;
   m_TransportType = TransportLPSolver<double>::BALANCED;
 
+  m_TreeType = KMEANS_TREE;
+  m_BisectingSplit = false;
+  m_ApproximateNeighborhoods = false;
+  m_NeighborhoodNumberOfTables = 16;
+  m_NeighborhoodNumberOfHashes = 6;
+  m_NeighborhoodBucketWidth = 4;
+  m_NeighborhoodMinimumLevelSize = 256;
+  m_SpatialNodeOrder = false;
+  m_DecomposeComponents = false;
+  m_NumberOfBlockSweeps = -1;
+  m_ProjectionDimension = 0;
+  m_NumberOfExactScales = 1;
+  m_AutoTune = false;
+  m_AutoTuneScaleSeconds = 0;
+
   m_SourceSplitCriterium = IKMTree<TValue>::ADAPTIVE_FIXED;
   m_SourceStoppingCriterium = IKMTree<TValue>::RELATIVE_RADIUS;
   m_SourceEpsilon = 0.0;
@@ -86,8 +107,40 @@ PointSetMultiscaleOptimalTransportMethod< TSourcePointSet, TTargetPointSet, TVal
 ::GenerateData()
 {
 
-  //Create Source GMRA object
+  //Create Source and Target GMRA objects
   PointSetGMRADataObject<TSourcePointSet> source( this->GetSourcePointSet() );
+  PointSetGMRADataObject<TTargetPointSet> target( this->GetTargetPointSet() );
+  GMRADataObject<double> *sourceData = &source;
+  GMRADataObject<double> *targetData = &target;
+
+  //Optionally build the trees on randomly projected points
+  RandomProjection<double> projection( m_ProjectionDimension );
+  ProjectedGMRADataObject<double> *sourceProjected = NULL;
+  ProjectedGMRADataObject<double> *targetProjected = NULL;
+  if( m_ProjectionDimension > 0 && m_ProjectionDimension < source.dimension() )
+    {
+    projection.compute( &source, &target );
+    RandomProjection<double>::Distortion distortion =
+      projection.estimateDistortion( &source, &target );
+    std::cout << "Projected to " << projection.getDimension() << " dimensions, captured variance: "
+      << projection.getCapturedVariance() << ", distance distortion mean: " << distortion.mean
+      << " max: " << distortion.max << std::endl;
+    sourceProjected = new ProjectedGMRADataObject<double>( &source, projection );
+    targetProjected = new ProjectedGMRADataObject<double>( &target, projection );
+    sourceData = sourceProjected;
+    targetData = targetProjected;
+    }
+
+  if( m_TreeType == MORTON_TREE &&
+      sourceData->dimension() > MortonTree<double>::getMaximumDimension() )
+    {
+    delete sourceProjected;
+    delete targetProjected;
+    itkExceptionMacro( "Morton trees support at most " << MortonTree<double>::getMaximumDimension()
+        << " dimensions, the point sets have " << sourceData->dimension()
+        << ". Use another tree type or a projection dimension." );
+    }
+
   std::vector<int> sourcePts( source.numberOfPoints() );
   std::vector<double> sourceWeights( source.numberOfPoints() );
   for(unsigned int i=0; i<sourcePts.size(); i++){
@@ -95,72 +148,221 @@ PointSetMultiscaleOptimalTransportMethod< TSourcePointSet, TTargetPointSet, TVal
     sourceWeights[i] = 1.0;
   };
 
-  std::cout << "Building Source GMRA" << std::endl;
-  IKMTree<double> *gmraSource = new IKMTree<double>(  &source );
-  gmraSource->setStoppingCriterium( m_SourceStoppingCriterium );
-  gmraSource->setSplitCriterium( m_SourceSplitCriterium );
-  gmraSource->dataFactory = new L2GMRAKmeansDataFactory<double>();
-  gmraSource->epsilon = m_SourceEpsilon;
-  gmraSource->nKids = m_SourceNumberOfKids;
-  gmraSource->threshold = m_SourceThreshold;
-  gmraSource->maxIter = m_SourceMaxIterations;
-  gmraSource->minPoints = m_SourceMinimumPoints;
-  gmraSource->addPoints( sourcePts );
-
-  std::cout << "Source GMRA built" << std::endl;
-
-  //Create Target GMRA object
-  PointSetGMRADataObject<TTargetPointSet> target( this->GetTargetPointSet() );
+  GMRATree<double> *gmraSource = NULL;
+  if( !m_SourceTreeFileName.empty() )
+    {
+    MappedGMRATree<double> *mapped = new MappedGMRATree<double>( sourceData );
+    if( mapped->load( m_SourceTreeFileName ) )
+      {
+      std::cout << "Source GMRA loaded" << std::endl;
+      gmraSource = mapped;
+      }
+    else
+      {
+      delete mapped;
+      }
+    }
+
+  NodeDistance<double> *distS = new CenterNodeDistance<double>( new EuclideanMetric<double>() );
+  if( gmraSource == NULL )
+    {
+    std::cout << "Building Source GMRA" << std::endl;
+    if( m_TreeType == MORTON_TREE )
+      {
+      MortonTree<double> *mortonSource = new MortonTree<double>( sourceData );
+      mortonSource->minPoints = m_SourceMinimumPoints;
+      mortonSource->epsilon = m_SourceEpsilon;
+      mortonSource->addPoints( sourcePts );
+      gmraSource = mortonSource;
+      }
+    else if( m_TreeType == BALL_TREE )
+      {
+      BallTree<double> *ballSource = new BallTree<double>( sourceData );
+      ballSource->nKids = m_SourceNumberOfKids;
+      ballSource->minPoints = m_SourceMinimumPoints;
+      ballSource->epsilon = m_SourceEpsilon;
+      ballSource->addPoints( sourcePts );
+      gmraSource = ballSource;
+      }
+    else
+      {
+      IKMTree<double> *ikmSource = new IKMTree<double>(  sourceData );
+      ikmSource->setStoppingCriterium( m_SourceStoppingCriterium );
+      ikmSource->setSplitCriterium( m_SourceSplitCriterium );
+      ikmSource->dataFactory = new L2GMRAKmeansDataFactory<double>();
+      ikmSource->epsilon = m_SourceEpsilon;
+      ikmSource->nKids = m_SourceNumberOfKids;
+      ikmSource->threshold = m_SourceThreshold;
+      ikmSource->maxIter = m_SourceMaxIterations;
+      ikmSource->minPoints = m_SourceMinimumPoints;
+      ikmSource->bisect = m_BisectingSplit;
+      ikmSource->addPoints( sourcePts );
+      ikmSource->computeStatistics(distS, sourceWeights);
+      gmraSource = ikmSource;
+      }
+
+    std::cout << "Source GMRA built" << std::endl;
+    if( !m_SourceTreeFileName.empty() )
+      {
+      MappedGMRATree<double>::write( gmraSource, m_SourceTreeFileName );
+      }
+    }
+
+  //Build Target GMRA
   std::vector<int> targetPts( target.numberOfPoints() );
   std::vector<double> targetWeights( target.numberOfPoints() );
   for(unsigned int i=0; i<targetPts.size(); i++){
     targetPts[i] = i;
     targetWeights[i] = 1.0;
   };
-  IKMTree<double> *gmraTarget = new IKMTree<double>( &target );
-  gmraTarget->setStoppingCriterium( m_TargetStoppingCriterium );
-  gmraTarget->setSplitCriterium( m_TargetSplitCriterium );
-  gmraTarget->dataFactory = new L2GMRAKmeansDataFactory<double>();
-  gmraTarget->epsilon = m_TargetEpsilon;
-  gmraTarget->nKids = m_TargetNumberOfKids;
-  gmraTarget->threshold = m_TargetThreshold;
-  gmraTarget->maxIter = m_TargetMaxIterations;
-  gmraTarget->minPoints = m_TargetMinimumPoints;
-  gmraTarget->addPoints( targetPts );
-
-  std::cout << "Target GMRA built" << std::endl;
-
-  NodeDistance<double> *distS = new CenterNodeDistance<double>( new EuclideanMetric<double>() );
-  gmraSource->computeRadii(distS);
-  gmraSource->computeLocalRadii(distS);
+  GMRATree<double> *gmraTarget = NULL;
+  if( !m_TargetTreeFileName.empty() )
+    {
+    MappedGMRATree<double> *mapped = new MappedGMRATree<double>( targetData );
+    if( mapped->load( m_TargetTreeFileName ) )
+      {
+      std::cout << "Target GMRA loaded" << std::endl;
+      gmraTarget = mapped;
+      }
+    else
+      {
+      delete mapped;
+      }
+    }
 
   NodeDistance<double> *distT = new CenterNodeDistance<double>( new EuclideanMetric<double>() );
-  gmraTarget->computeRadii(distT);
-  gmraTarget->computeLocalRadii(distT);
+  if( gmraTarget == NULL )
+    {
+    std::cout << "Building Target GMRA" << std::endl;
+    if( m_TreeType == MORTON_TREE )
+      {
+      MortonTree<double> *mortonTarget = new MortonTree<double>( targetData );
+      mortonTarget->minPoints = m_TargetMinimumPoints;
+      mortonTarget->epsilon = m_TargetEpsilon;
+      mortonTarget->addPoints( targetPts );
+      gmraTarget = mortonTarget;
+      }
+    else if( m_TreeType == BALL_TREE )
+      {
+      BallTree<double> *ballTarget = new BallTree<double>( targetData );
+      ballTarget->nKids = m_TargetNumberOfKids;
+      ballTarget->minPoints = m_TargetMinimumPoints;
+      ballTarget->epsilon = m_TargetEpsilon;
+      ballTarget->addPoints( targetPts );
+      gmraTarget = ballTarget;
+      }
+    else
+      {
+      IKMTree<double> *ikmTarget = new IKMTree<double>( targetData );
+      ikmTarget->setStoppingCriterium( m_TargetStoppingCriterium );
+      ikmTarget->setSplitCriterium( m_TargetSplitCriterium );
+      ikmTarget->dataFactory = new L2GMRAKmeansDataFactory<double>();
+      ikmTarget->epsilon = m_TargetEpsilon;
+      ikmTarget->nKids = m_TargetNumberOfKids;
+      ikmTarget->threshold = m_TargetThreshold;
+      ikmTarget->maxIter = m_TargetMaxIterations;
+      ikmTarget->minPoints = m_TargetMinimumPoints;
+      ikmTarget->bisect = m_BisectingSplit;
+      ikmTarget->addPoints( targetPts );
+      ikmTarget->computeStatistics(distT, targetWeights);
+      gmraTarget = ikmTarget;
+      }
+
+    std::cout << "Target GMRA built" << std::endl;
+    if( !m_TargetTreeFileName.empty() )
+      {
+      MappedGMRATree<double>::write( gmraTarget, m_TargetTreeFileName );
+      }
+    }
 
-  GenericGMRANeighborhood<double> sourceNeighborhood(gmraSource, distS);
-  GenericGMRANeighborhood<double> targetNeighborhood(gmraTarget, distT);
+  //exact costs at the finest scales of projected trees
+  NodeDistance<double> *costS = distS;
+  NodeDistance<double> *costT = distT;
+  EuclideanMetric<double> fullMetric;
+  if( sourceProjected != NULL )
+    {
+    ProjectedNodeDistance<double> *projectedDist =
+      new ProjectedNodeDistance<double>( distS, &fullMetric );
+    projectedDist->addTree( gmraSource, &source, m_NumberOfExactScales );
+    projectedDist->addTree( gmraTarget, &target, m_NumberOfExactScales );
+    costS = projectedDist;
+    costT = projectedDist;
+    }
+
+  GMRANeighborhood<double> *sourceNeighborhood;
+  GMRANeighborhood<double> *targetNeighborhood;
+  if( m_ApproximateNeighborhoods )
+    {
+    LSHGMRANeighborhood<double> *lsh[2];
+    lsh[0] = new LSHGMRANeighborhood<double>(gmraSource, costS);
+    lsh[1] = new LSHGMRANeighborhood<double>(gmraTarget, costT);
+    for(int i=0; i<2; i++)
+      {
+      lsh[i]->nTables = m_NeighborhoodNumberOfTables;
+      lsh[i]->nHashes = m_NeighborhoodNumberOfHashes;
+      lsh[i]->bucketWidth = m_NeighborhoodBucketWidth;
+      lsh[i]->minLevelSize = m_NeighborhoodMinimumLevelSize;
+      }
+    sourceNeighborhood = lsh[0];
+    targetNeighborhood = lsh[1];
+    }
+  else
+    {
+    sourceNeighborhood = new GenericGMRANeighborhood<double>(gmraSource, costS);
+    targetNeighborhood = new GenericGMRANeighborhood<double>(gmraTarget, costT);
+    }
 
   std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
-      GMRAMultiscaleTransportLevel<double>::buildTransportLevels(sourceNeighborhood, sourceWeights, false);
+      GMRAMultiscaleTransportLevel<double>::buildTransportLevels(*sourceNeighborhood, false);
 
   std::vector< MultiscaleTransportLevel<double> * > targetLevels =
-      GMRAMultiscaleTransportLevel<double>::buildTransportLevels(targetNeighborhood, targetWeights, false);
+      GMRAMultiscaleTransportLevel<double>::buildTransportLevels(*targetNeighborhood, false);
+
+  if( m_SpatialNodeOrder )
+    {
+    GMRAMultiscaleTransportLevel<double>::sortTransportLevels(sourceLevels);
+    GMRAMultiscaleTransportLevel<double>::sortTransportLevels(targetLevels);
+    }
 
   std::cout << targetLevels.size() << std::endl;
   TransportLPSolver<double> *trpSolver =
           new TransportLPSolver<double>( m_Solver, m_TransportType, m_MassCost, m_Lambda );
   MultiscaleTransportLP<double> transport( trpSolver );
   transport.setPropagationStrategy1(m_PropagationStrategy1);
-  transport.setPropagationStrategy1(m_PropagationStrategy2);
+  transport.setPropagationStrategy2(m_PropagationStrategy2);
+  transport.setDecomposeComponents(m_DecomposeComponents);
+  transport.setBlockSweeps(m_NumberOfBlockSweeps);
+  ExpandNeighborhoodStrategy<double> *expand = NULL;
   for(int i=0; i< m_NeighborhoodStrategies.size(); i++)
     {
     transport.addNeighborhodStrategy( m_NeighborhoodStrategies[i] );
+    if( expand == NULL )
+      {
+      expand = dynamic_cast< ExpandNeighborhoodStrategy<double> * >( m_NeighborhoodStrategies[i] );
+      }
+    }
+
+  TransportAutoTuner<double> tuner( expand, m_AutoTuneScaleSeconds );
+  if( m_AutoTune )
+    {
+    const char *treeNames[] = {"kmeans", "ball", "morton"};
+    tuner.setProfile( TransportAutoTuner<double>::makeProfile( source.numberOfPoints(),
+          target.numberOfPoints(), sourceData->dimension(), treeNames[m_TreeType] ) );
+    if( !m_AutoTuneFileName.empty() && tuner.load( m_AutoTuneFileName ) )
+      {
+      std::cout << "Loaded tuned settings for " << tuner.getProfile() << std::endl;
+      }
+    transport.setAutoTuner( &tuner );
     }
 
   std::vector< TransportPlan<double> * > sols = transport.solve( sourceLevels, targetLevels,
       m_Exponent, m_NumberOfScalesSource, m_NumberOfScalesTarget, m_MatchScale, m_ScaleMass);
 
+  if( m_AutoTune && !m_AutoTuneFileName.empty() )
+    {
+    tuner.save( m_AutoTuneFileName );
+    }
+
   auto * transportOutput = static_cast< TransportCouplingType * >( this->ProcessObject::GetOutput(0) );
   transportOutput->AlloacteMap( source.numberOfPoints() );
 
@@ -186,10 +388,18 @@ PointSetMultiscaleOptimalTransportMethod< TSourcePointSet, TTargetPointSet, TVal
       }
     }
 
+  delete sourceNeighborhood;
+  delete targetNeighborhood;
   delete gmraSource;
   delete gmraTarget;
+  if( costS != distS )
+    {
+    delete costS;
+    }
   delete distS;
   delete distT;
+  delete sourceProjected;
+  delete targetProjected;
 
   for(int i = 0; i<sols.size(); i++)
     {
@@ -0,0 +1,95 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "DenseTransportSolver.h"
+#include "LemonSolver.h"
+#include "TransportLP.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+
+// DenseTransportSolver against the network simplex on random problems. The
+// uniform square problem goes through the Hungarian method, the others
+// through the transportation simplex.
+int DenseTransportSolverTest( int, char *[] )
+{
+  using DenseSolverType = DenseTransportSolver<double>;
+  std::srand( 2019 );
+  const int sizes[3][2] = { {40, 60}, {75, 50}, {64, 64} };
+  bool passed = true;
+  for( int k = 0; k < 3; k++ )
+    {
+    int ns = sizes[k][0];
+    int nt = sizes[k][1];
+    Eigen::MatrixXd P = Eigen::MatrixXd::Random( 2, ns );
+    Eigen::MatrixXd Q = Eigen::MatrixXd::Random( 2, nt );
+    Eigen::VectorXd a = Eigen::VectorXd::Ones( ns );
+    Eigen::VectorXd b = Eigen::VectorXd::Ones( nt );
+    if( ns != nt )
+      {
+      a += 0.5 * Eigen::VectorXd::Random( ns );
+      b += 0.5 * Eigen::VectorXd::Random( nt );
+      }
+    a /= a.sum();
+    b /= b.sum();
+    DenseSolverType::MatrixXp C( ns, nt );
+    for( int i = 0; i < ns; i++ )
+      {
+      for( int j = 0; j < nt; j++ )
+        {
+        C( i, j ) = ( P.col( i ) - Q.col( j ) ).squaredNorm();
+        }
+      }
+
+    DenseSolverType dense;
+    bool optimal = dense.solve( a, b, C );
+
+    LemonSolver lemon;
+    TransportLP<double> lp( &lemon );
+    std::map< std::pair<int, int>, double > plan = lp.solve( C, a, b );
+    double reference = 0;
+    for( std::map< std::pair<int, int>, double >::iterator it = plan.begin(); it != plan.end(); ++it )
+      {
+      reference += it->second * C( it->first.first, it->first.second );
+      }
+
+    DenseSolverType::MatrixXp &X = dense.getPlan();
+    double marginalError = std::max(
+      ( X.rowwise().sum() - a ).cwiseAbs().maxCoeff(),
+      ( X.colwise().sum().transpose() - b ).cwiseAbs().maxCoeff() );
+    double minReducedCost = 0;
+    for( int i = 0; i < ns; i++ )
+      {
+      double reduced = ( C.row( i ) - dense.getTargetPotentials() ).minCoeff() - dense.getSourcePotentials()( i );
+      minReducedCost = std::min( minReducedCost, reduced );
+      }
+
+    std::cout << "Dense " << ns << "x" << nt << " cost: " << dense.getCost() << " network simplex: "
+      << reference << std::endl;
+    if( !optimal || marginalError > 1e-9 || minReducedCost < -1e-9 ||
+        std::abs( dense.getCost() - reference ) > 1e-6 * reference )
+      {
+      std::cerr << "Dense solver differs from the network simplex, marginal error: " << marginalError
+        << " min reduced cost: " << minReducedCost << std::endl;
+      passed = false;
+      }
+    }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,216 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMTree.h"
+#include "GMRAMultiscaleTransport.h"
+#include "MultiscaleTransportLP.h"
+#include "EigenEuclideanMetric.h"
+#include "ExpandNeighborhoodStrategy.h"
+#include "GMRANeighborhood.h"
+#include "IteratedCapacityPropagationStrategy.h"
+#include "LemonSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+namespace
+{
+
+typedef TransportNode<double>::TransportNodeVector TransportNodeVector;
+
+// IKM tree on the columns of X with the statistics for uniform weights
+class Tree
+{
+public:
+  MatrixGMRADataObject<double> data;
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> dist;
+  IKMTree<double> tree;
+  GenericGMRANeighborhood<double> neighborhood;
+
+  Tree( const Eigen::MatrixXd & X ) :
+    data( X ), dist( &metric ), tree( &data ), neighborhood( &tree, &dist )
+    {
+    std::vector<int> pts( X.cols() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    tree.dataFactory = new L2GMRAKmeansDataFactory<double>();
+    tree.epsilon = 0;
+    tree.nKids = 4;
+    tree.minPoints = 1;
+    tree.addPoints( pts );
+    std::vector<double> weights( X.cols(), 1.0 );
+    tree.computeStatistics( &dist, weights );
+    }
+};
+
+
+Eigen::VectorXd & Center( TransportNode<double> *node )
+{
+  return dynamic_cast< GMRATransportNodeBase<double> * >( node )->getGMRANode()->getCenter();
+}
+
+
+// Mean distance between the centers of nodes with consecutive ids
+double MeanStep( const TransportNodeVector & nodes, const std::vector<int> & order )
+{
+  double sum = 0;
+  for( unsigned int i = 1; i < order.size(); i++ )
+    {
+    sum += ( Center( nodes[ order[i] ] ) - Center( nodes[ order[i - 1] ] ) ).norm();
+    }
+  return sum / ( order.size() - 1 );
+}
+
+
+// Optimal transport cost of the multiscale solve with the expand strategy,
+// optionally on levels sorted along the Hilbert curve
+double MultiscaleCost( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y, bool sort )
+{
+  std::srand( 2019 );
+  Tree source( X );
+  Tree target( Y );
+  std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( source.neighborhood, false );
+  std::vector< MultiscaleTransportLevel<double> * > targetLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( target.neighborhood, false );
+  if( sort )
+    {
+    GMRAMultiscaleTransportLevel<double>::sortTransportLevels( sourceLevels );
+    GMRAMultiscaleTransportLevel<double>::sortTransportLevels( targetLevels );
+    }
+
+  LemonSolver lemon;
+  TransportLPSolver<double> *lpSolver =
+    new TransportLPSolver<double>( &lemon, TransportLPSolver<double>::BALANCED, 0, 0 );
+  MultiscaleTransportLP<double> transport( lpSolver );
+  transport.setPropagationStrategy1( new IteratedCapacityPropagationStrategy<double>( 0, 0 ) );
+  transport.addNeighborhodStrategy( new ExpandNeighborhoodStrategy<double>( 1.5, 0, 1 ) );
+  std::vector< TransportPlan<double> * > plans = transport.solve( sourceLevels, targetLevels, 2, -1, -1, false, true );
+  double cost = plans.back()->cost;
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    delete plans[i];
+    }
+  return cost;
+}
+
+} // namespace
+
+// GMRAMultiscaleTransportLevel::sortNodes renumbers the nodes of each level
+// along a Hilbert curve. The ids have to be a permutation that keeps the
+// neighborhoods and the transport cost, with nearby nodes at nearby ids.
+int GMRAMultiscaleTransportTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 2, 3000 );
+  Tree tree( X );
+  std::vector< MultiscaleTransportLevel<double> * > levels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( tree.neighborhood, false );
+
+  // neighborhoods before the sort fill the cache by the old ids
+  std::vector< TransportNodeVector > old( levels.size() );
+  std::vector< std::vector< std::set< TransportNode<double> * > > > neighbors( levels.size() );
+  for( unsigned int s = 0; s < levels.size(); s++ )
+    {
+    old[s] = levels[s]->getNodes();
+    for( unsigned int i = 0; i < old[s].size(); i++ )
+      {
+      TransportNodeVector nh = levels[s]->getNeighborhood( old[s][i], 0.1 );
+      neighbors[s].push_back( std::set< TransportNode<double> * >( nh.begin(), nh.end() ) );
+      }
+    }
+
+  std::vector< std::vector<int> > orders =
+    GMRAMultiscaleTransportLevel<double>::sortTransportLevels( levels );
+
+  bool permuted = orders.size() == levels.size();
+  bool sameNeighbors = true;
+  for( unsigned int s = 0; permuted && s < levels.size(); s++ )
+    {
+    TransportNodeVector & nodes = levels[s]->getNodes();
+    std::vector<int> sorted = orders[s];
+    std::sort( sorted.begin(), sorted.end() );
+    permuted = nodes.size() == old[s].size() && sorted.size() == nodes.size();
+    for( unsigned int i = 0; permuted && i < nodes.size(); i++ )
+      {
+      permuted = sorted[i] == (int) i && nodes[i]->getID() == (int) i &&
+        nodes[i] == old[s][ orders[s][i] ];
+      }
+    for( unsigned int i = 0; permuted && i < nodes.size(); i++ )
+      {
+      TransportNodeVector nh = levels[s]->getNeighborhood( nodes[i], 0.1 );
+      std::set< TransportNode<double> * > after( nh.begin(), nh.end() );
+      sameNeighbors = sameNeighbors && after == neighbors[s][ orders[s][i] ];
+      }
+    }
+  if( !permuted )
+    {
+    std::cerr << "Sorted nodes are not a permutation of the level" << std::endl;
+    passed = false;
+    }
+  if( !sameNeighbors )
+    {
+    std::cerr << "Neighborhoods changed with the node order" << std::endl;
+    passed = false;
+    }
+
+  // nodes with consecutive ids are closer than in a random order
+  TransportNodeVector & finest = levels.back()->getNodes();
+  std::vector<int> identity( finest.size() );
+  for( unsigned int i = 0; i < identity.size(); i++ )
+    {
+    identity[i] = i;
+    }
+  std::vector<int> shuffled = identity;
+  std::random_shuffle( shuffled.begin(), shuffled.end() );
+  double sortedStep = MeanStep( finest, identity );
+  double shuffledStep = MeanStep( finest, shuffled );
+  std::cout << "Finest level nodes: " << finest.size() << " mean step sorted: " << sortedStep
+            << " shuffled: " << shuffledStep << std::endl;
+  if( sortedStep > 0.1 * shuffledStep )
+    {
+    std::cerr << "Sorted nodes are not spatially coherent" << std::endl;
+    passed = false;
+    }
+
+  // the transport problems are the same up to the numbering
+  Eigen::MatrixXd Y = Eigen::MatrixXd::Random( 2, 1000 );
+  Eigen::MatrixXd Z = Eigen::MatrixXd::Random( 2, 1000 );
+  double unsortedCost = MultiscaleCost( Y, Z, false );
+  double sortedCost = MultiscaleCost( Y, Z, true );
+  std::cout << "Cost unsorted: " << unsortedCost << " sorted: " << sortedCost << std::endl;
+  if( std::abs( unsortedCost - sortedCost ) > 1e-6 * unsortedCost )
+    {
+    std::cerr << "Sorted levels change the transport cost" << std::endl;
+    passed = false;
+    }
+
+  for( unsigned int s = 0; s < levels.size(); s++ )
+    {
+    delete levels[s];
+    }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
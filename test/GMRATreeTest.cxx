@@ -0,0 +1,141 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMKmeansData.h"
+#include "IKMTree.h"
+#include "EigenEuclideanMetric.h"
+#include "NodeDistance.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// Scale and summed weights of the points of the leaves below node, in
+// depth first order
+double Reference( GMRANode<double> *node, int scale, const std::vector<double> & weights,
+  std::vector<int> & scales, std::vector<double> & masses, std::vector< GMRANode<double> * > & order )
+{
+  int index = order.size();
+  order.push_back( node );
+  scales.push_back( scale );
+  masses.push_back( 0 );
+
+  double mass = 0;
+  std::vector< GMRANode<double> * > & kids = node->getChildren();
+  if( kids.empty() )
+    {
+    std::vector<int> & pts = node->getPoints();
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      mass += weights[ pts[i] ];
+      }
+    }
+  for( unsigned int i = 0; i < kids.size(); i++ )
+    {
+    mass += Reference( kids[i], scale + 1, weights, scales, masses, order );
+    }
+  masses[index] = mass;
+  return mass;
+}
+
+} // namespace
+
+// GMRATree::computeStatistics against the per node leaf recursion of
+// GMRANode::computeRadius and computeLocalRadius.
+int GMRATreeTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 3, 3000 );
+  MatrixGMRADataObject<double> data( X );
+  std::vector<int> pts( X.cols() );
+  std::vector<double> weights( X.cols() );
+  for( int i = 0; i < X.cols(); i++ )
+    {
+    pts[i] = i;
+    weights[i] = 1 + std::rand() % 3;
+    }
+
+  IKMTree<double> tree( &data );
+  tree.dataFactory = new L2GMRAKmeansDataFactory<double>();
+  tree.epsilon = 0.01;
+  tree.nKids = 4;
+  tree.addPoints( pts );
+
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> dist( &metric );
+
+  // the scales near the root are split over the leaves
+  Parallel::setNumberOfThreads( 4 );
+  tree.computeStatistics( &dist, weights );
+
+  std::vector<int> scales;
+  std::vector<double> masses;
+  std::vector< GMRANode<double> * > nodes;
+  Reference( tree.getRoot(), 0, weights, scales, masses, nodes );
+
+  std::vector<double> radii( nodes.size() );
+  std::vector<double> localRadii( nodes.size() );
+  double massError = 0;
+  bool sameScales = tree.getMaxScale() == *std::max_element( scales.begin(), scales.end() );
+  for( unsigned int i = 0; i < nodes.size(); i++ )
+    {
+    radii[i] = nodes[i]->getRadius();
+    localRadii[i] = nodes[i]->getLocalRadius();
+    massError = std::max( massError, std::abs( nodes[i]->getMass() - masses[i] ) );
+    sameScales = sameScales && nodes[i]->getScale() == scales[i];
+    }
+
+  double radiusError = 0;
+  for( unsigned int i = 0; i < nodes.size(); i++ )
+    {
+    nodes[i]->computeRadius( &dist );
+    nodes[i]->computeLocalRadius( &dist );
+    radiusError = std::max( radiusError, std::abs( nodes[i]->getRadius() - radii[i] ) );
+    radiusError = std::max( radiusError, std::abs( nodes[i]->getLocalRadius() - localRadii[i] ) );
+    }
+  std::cout << "Nodes: " << nodes.size() << " scales: " << tree.getMaxScale() + 1
+            << " radius error: " << radiusError << " mass error: " << massError << std::endl;
+  if( radiusError > 1e-12 || massError > 1e-9 || !sameScales )
+    {
+    std::cerr << "computeStatistics differs from the leaf recursion" << std::endl;
+    passed = false;
+    }
+
+  // the bounds from the kids are upper bounds of the exact radii
+  tree.computeStatistics( &dist, false );
+  bool bounded = true;
+  for( unsigned int i = 0; i < nodes.size(); i++ )
+    {
+    bounded = bounded && nodes[i]->getRadius() >= radii[i] - 1e-12;
+    }
+  Parallel::setNumberOfThreads( 0 );
+  if( !bounded )
+    {
+    std::cerr << "Bounded radii are below the exact radii" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,130 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMKmeansData.h"
+#include "IKMTree.h"
+#include "EigenEuclideanMetric.h"
+#include "NodeDistance.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// Summed weights of the points of the leaves below node, counts how often
+// each point is in a leaf
+double LeafMass( GMRANode<double> *node, const std::vector<double> & weights,
+  std::vector<int> & count, std::vector< GMRANode<double> * > & nodes, std::vector<double> & masses )
+{
+  int index = nodes.size();
+  nodes.push_back( node );
+  masses.push_back( 0 );
+
+  double mass = 0;
+  std::vector< GMRANode<double> * > & kids = node->getChildren();
+  if( kids.empty() )
+    {
+    std::vector<int> & pts = node->getPoints();
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      mass += weights[ pts[i] ];
+      count[ pts[i] ]++;
+      }
+    }
+  for( unsigned int i = 0; i < kids.size(); i++ )
+    {
+    mass += LeafMass( kids[i], weights, count, nodes, masses );
+    }
+  masses[index] = mass;
+  return mass;
+}
+
+} // namespace
+
+// IKMTree::insertPoints into a built tree: the points end up in exactly one
+// leaf, the masses are exact and the radii bound the exact radii.
+int IKMTreeTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 3, 4000 );
+  MatrixGMRADataObject<double> data( X );
+  std::vector<double> weights( X.cols() );
+  for( int i = 0; i < X.cols(); i++ )
+    {
+    weights[i] = 1 + std::rand() % 3;
+    }
+
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> dist( &metric );
+
+  IKMTree<double> tree( &data );
+  tree.dataFactory = new L2GMRAKmeansDataFactory<double>();
+  tree.epsilon = 0.01;
+  tree.nKids = 4;
+
+  // the first insert into an empty tree builds it, the others are routed
+  int n = 0;
+  const int sizes[3] = { 2000, 1500, 500 };
+  for( int k = 0; k < 3; k++ )
+    {
+    std::vector<int> pts;
+    for( int i = 0; i < sizes[k]; i++ )
+      {
+      pts.push_back( n++ );
+      }
+    tree.insertPoints( pts, &dist, weights );
+
+    std::vector<int> count( X.cols(), 0 );
+    std::vector< GMRANode<double> * > nodes;
+    std::vector<double> masses;
+    LeafMass( tree.getRoot(), weights, count, nodes, masses );
+
+    int nOnce = std::count( count.begin(), count.begin() + n, 1 );
+    int nOther = std::count( count.begin() + n, count.end(), 0 );
+    double massError = 0;
+    double radiusViolation = 0;
+    double localRadiusError = 0;
+    for( unsigned int i = 0; i < nodes.size(); i++ )
+      {
+      massError = std::max( massError, std::abs( nodes[i]->getMass() - masses[i] ) );
+      double radius = nodes[i]->getRadius();
+      double localRadius = nodes[i]->getLocalRadius();
+      nodes[i]->computeRadius( &dist );
+      nodes[i]->computeLocalRadius( &dist );
+      radiusViolation = std::max( radiusViolation, nodes[i]->getRadius() - radius );
+      localRadiusError = std::max( localRadiusError, std::abs( nodes[i]->getLocalRadius() - localRadius ) );
+      nodes[i]->setRadius( radius );
+      }
+    std::cout << "Points: " << n << " nodes: " << nodes.size() << " mass error: " << massError
+              << " radius violation: " << radiusViolation << " local radius error: "
+              << localRadiusError << std::endl;
+    if( nOnce != n || nOther != X.cols() - n || massError > 1e-9 ||
+        radiusViolation > 1e-12 || localRadiusError > 1e-12 )
+      {
+      std::cerr << "Tree statistics are wrong after inserting " << sizes[k] << " points" << std::endl;
+      passed = false;
+      }
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,102 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IPCANodeFactory.h"
+#include "GMRADataObject.h"
+#include "Parallel.h"
+#include <Eigen/SVD>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// Streamed node statistics against the thin SVD of the centered points.
+// Returns false and reports if they differ by more than the tolerances.
+bool CheckNode( const Eigen::MatrixXd & X, int maxDim, double sigmaTolerance,
+  double subspaceTolerance, const char * name )
+{
+  MatrixGMRADataObject<double> data( X );
+  FixedNodeFactory<double> factory( &data, maxDim );
+  std::vector<int> pts( X.cols() );
+  for( int i = 0; i < X.cols(); i++ )
+    {
+    pts[i] = i;
+    }
+  IPCANode<double> *node = dynamic_cast< IPCANode<double> * >( factory.createNode( pts ) );
+
+  Eigen::VectorXd mean = X.rowwise().mean();
+  Eigen::MatrixXd Xc = X.colwise() - mean;
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd( Xc, Eigen::ComputeThinU );
+  double n = X.cols();
+  Eigen::VectorXd sigma = svd.singularValues().head( maxDim ) / std::sqrt( n - 1 );
+  Eigen::MatrixXd U = svd.matrixU().leftCols( maxDim );
+  double totalVar = Xc.squaredNorm() / ( n - 1 );
+  double radius = Xc.colwise().norm().maxCoeff();
+
+  Eigen::MatrixXd & phi = node->getPhi();
+  double statError = ( node->getCenter() - mean ).norm();
+  statError = std::max( statError, std::abs( node->getTotalVariance() - totalVar ) / totalVar );
+  statError = std::max( statError, std::abs( node->getL2Radius() - radius ) / radius );
+  double sigmaError = ( node->getSigma() - sigma ).cwiseAbs().cwiseQuotient( sigma ).maxCoeff();
+  double subspaceError = ( phi * phi.transpose() - U * U.transpose() ).norm();
+  std::cout << name << ": statistics error " << statError << " sigma error " << sigmaError
+            << " subspace error " << subspaceError << std::endl;
+  delete node;
+
+  if( phi.cols() != maxDim || statError > 1e-10 || sigmaError > sigmaTolerance ||
+      subspaceError > subspaceTolerance )
+    {
+    std::cerr << name << " differs from the SVD of the centered points" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+} // namespace
+
+// IPCANodeFactory statistics streamed over parallel chunks against a dense
+// SVD, with the exact covariance in low dimensions and the randomized range
+// in high dimensions.
+int IPCANodeFactoryTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  // several chunks on several threads
+  Parallel::setNumberOfThreads( 4 );
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 5, 10000 );
+  X.row( 0 ) *= 4;
+  X.row( 1 ) *= 2;
+  X.colwise() += Eigen::VectorXd::Constant( 5, 3 );
+  passed &= CheckNode( X, 2, 1e-10, 1e-8, "Exact covariance" );
+
+  // three strong directions in 60 dimensions
+  Eigen::MatrixXd B = Eigen::MatrixXd::Random( 60, 3 );
+  Eigen::MatrixXd Y = B * ( Eigen::MatrixXd::Random( 3, 10000 ).array().colwise() *
+    Eigen::Array3d( 5, 3, 2 ) ).matrix() + 0.01 * Eigen::MatrixXd::Random( 60, 10000 );
+  passed &= CheckNode( Y, 3, 1e-3, 1e-2, "Randomized range" );
+
+  Parallel::setNumberOfThreads( 0 );
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
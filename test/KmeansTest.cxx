@@ -0,0 +1,285 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "Kmeans.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+using CentersType = std::vector< KmeansCenter<double> >;
+
+// Points as columns of a matrix. The bound based and the blocked assignment
+// are enabled through the flags, without them Kmeans searches all centers
+// for every point.
+class MatrixKmeansData : public KmeansData<double>
+{
+public:
+  MatrixKmeansData( const Eigen::MatrixXd & points, bool metric, bool euclidean ) :
+    X( points ), m_Metric( metric ), m_Euclidean( euclidean )
+    {
+    }
+
+  VectorXp getPoint( int index ) override
+    {
+    return X.col( index );
+    }
+
+  int getNumberOfPoints() override
+    {
+    return X.cols();
+    }
+
+  VectorXp getMean( std::vector<int> & pts ) override
+    {
+    VectorXp mean = VectorXp::Zero( X.rows() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      mean += X.col( pts[i] );
+      }
+    return mean / pts.size();
+    }
+
+  double getSquaredSimilarity( int index, const VectorXp & p ) override
+    {
+    return ( X.col( index ) - p ).squaredNorm();
+    }
+
+  bool isMetric() override
+    {
+    return m_Metric;
+    }
+
+  const MatrixXp * getEuclideanPoints() override
+    {
+    return m_Euclidean ? &X : nullptr;
+    }
+
+private:
+  Eigen::MatrixXd X;
+  bool m_Metric;
+  bool m_Euclidean;
+};
+
+
+// n points in d dimensions around nClusters random centers
+Eigen::MatrixXd ClusteredPoints( int d, int nClusters, int n )
+{
+  Eigen::MatrixXd C = 4 * Eigen::MatrixXd::Random( d, nClusters );
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( d, n );
+  for( int i = 0; i < n; i++ )
+    {
+    X.col( i ) += C.col( i % nClusters );
+    }
+  return X;
+}
+
+
+// Same partition of the points into centers at the same locations
+bool SameClustering( const CentersType & a, const CentersType & b, double tolerance,
+  const char * name )
+{
+  bool same = a.size() == b.size();
+  double maxError = 0;
+  for( unsigned int j = 0; same && j < a.size(); j++ )
+    {
+    std::vector<int> pa = a[j].points;
+    std::vector<int> pb = b[j].points;
+    std::sort( pa.begin(), pa.end() );
+    std::sort( pb.begin(), pb.end() );
+    same = pa == pb;
+    maxError = std::max( maxError, ( a[j].center - b[j].center ).norm() );
+    maxError = std::max( maxError, std::abs( a[j].radius - b[j].radius ) );
+    maxError = std::max( maxError, std::abs( a[j].mse - b[j].mse ) );
+    }
+  std::cout << name << ": centers " << a.size() << " and " << b.size()
+            << ", max error " << maxError << std::endl;
+  if( !same || maxError > tolerance )
+    {
+    std::cerr << name << " differs from the brute force assignment" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+
+// Sum of squared distances of the points to their centers
+double SumOfSquares( const CentersType & centers )
+{
+  double sum = 0;
+  for( unsigned int j = 0; j < centers.size(); j++ )
+    {
+    sum += centers[j].mse * centers[j].points.size();
+    }
+  return sum;
+}
+
+
+// Every point in exactly one center
+bool IsPartition( const CentersType & centers, int n )
+{
+  std::vector<int> count( n, 0 );
+  for( unsigned int j = 0; j < centers.size(); j++ )
+    {
+    for( unsigned int i = 0; i < centers[j].points.size(); i++ )
+      {
+      count[ centers[j].points[i] ]++;
+      }
+    }
+  return std::count( count.begin(), count.end(), 1 ) == n;
+}
+
+} // namespace
+
+// Kmeans with the accelerated assignments against the brute force search on
+// the same seeds.
+int KmeansTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  // the bounds only skip searches that cannot change the assignment
+  Eigen::MatrixXd X = ClusteredPoints( 3, 12, 3000 );
+  MatrixKmeansData bruteData( X, false, false );
+  MatrixKmeansData boundedData( X, true, false );
+  Kmeans<double> kmeans( 100, 0 );
+
+  std::srand( 1 );
+  CentersType brute = kmeans.run( 20, bruteData );
+  std::srand( 1 );
+  CentersType bounded = kmeans.run( 20, boundedData );
+  passed &= SameClustering( brute, bounded, 1e-10, "Bounds" );
+
+  std::srand( 2 );
+  brute = kmeans.run( 0.8, 200, bruteData );
+  std::srand( 2 );
+  bounded = kmeans.run( 0.8, 200, boundedData );
+  passed &= SameClustering( brute, bounded, 1e-10, "Bounds with added centers" );
+
+  std::srand( 3 );
+  brute = kmeans.run( 40, bruteData, 60 );
+  std::srand( 3 );
+  bounded = kmeans.run( 40, boundedData, 60 );
+  passed &= SameClustering( brute, bounded, 1e-10, "Bounds with removed centers" );
+
+  // the blocked assignment differs from the brute force one only by the
+  // rounding of the means, small blocks spread it over the threads
+  Eigen::MatrixXd Y = ClusteredPoints( 16, 12, 3000 );
+  MatrixKmeansData bruteHighData( Y, false, false );
+  MatrixKmeansData blockedData( Y, false, true );
+  kmeans.setBlockSize( 64 );
+  Parallel::setNumberOfThreads( 4 );
+
+  std::srand( 4 );
+  brute = kmeans.run( 20, bruteHighData );
+  std::srand( 4 );
+  CentersType blocked = kmeans.run( 20, blockedData );
+  passed &= SameClustering( brute, blocked, 1e-8, "Blocked" );
+
+  std::srand( 5 );
+  brute = kmeans.run( 2.0, 200, bruteHighData );
+  std::srand( 5 );
+  blocked = kmeans.run( 2.0, 200, blockedData );
+  passed &= SameClustering( brute, blocked, 1e-8, "Blocked with added centers" );
+  Parallel::setNumberOfThreads( 0 );
+
+  // mini-batch iterations end with a full assignment, the clustering is
+  // about as good as full k-means from the same seeds
+  Kmeans<double> miniBatch( 100, 0 );
+  miniBatch.setMiniBatchThreshold( 1000 );
+  miniBatch.setMiniBatchSize( 256 );
+  std::srand( 6 );
+  brute = kmeans.run( 12, bruteHighData );
+  std::srand( 6 );
+  CentersType batched = miniBatch.run( 12, blockedData );
+  long nAssigned = 0;
+  for( unsigned int j = 0; j < batched.size(); j++ )
+    {
+    nAssigned += batched[j].points.size();
+    }
+  std::cout << "Mini-batch: sum of squares " << SumOfSquares( batched )
+            << ", full k-means " << SumOfSquares( brute ) << std::endl;
+  if( nAssigned != Y.cols() || SumOfSquares( batched ) > 1.05 * SumOfSquares( brute ) )
+    {
+    std::cerr << "Mini-batch k-means is worse than full k-means" << std::endl;
+    passed = false;
+    }
+
+  // kmeans++ seeding stops at the number of distinct points
+  Eigen::MatrixXd Z( 3, 300 );
+  for( int i = 0; i < Z.cols(); i++ )
+    {
+    Z.col( i ) = X.col( i % 3 );
+    }
+  MatrixKmeansData duplicateData( Z, true, false );
+  CentersType seeded = kmeans.run( 5, duplicateData );
+  bool distinct = seeded.size() == 3;
+  for( unsigned int j = 0; distinct && j < seeded.size(); j++ )
+    {
+    distinct = seeded[j].points.size() == 100 && seeded[j].mse == 0;
+    }
+  if( !distinct )
+    {
+    std::cerr << "Seeding on 3 distinct points gave " << seeded.size() << " centers" << std::endl;
+    passed = false;
+    }
+
+  // bisecting splits only the centers that are too large, it needs about as
+  // many centers as adding seeds to all of them
+  Kmeans<double> bisecting( 100, 0 );
+  bisecting.setBisecting( true );
+  std::srand( 2 );
+  brute = kmeans.run( 0.8, 200, bruteData );
+  std::srand( 2 );
+  CentersType bisected = bisecting.run( 0.8, 200, boundedData );
+  double maxRadius = 0;
+  for( unsigned int j = 0; j < bisected.size(); j++ )
+    {
+    maxRadius = std::max( maxRadius, bisected[j].radius );
+    }
+  std::cout << "Bisecting: centers " << bisected.size() << ", full k-means " << brute.size()
+            << ", max radius " << maxRadius << std::endl;
+  if( !IsPartition( bisected, X.cols() ) || maxRadius > 0.8 ||
+      bisected.size() > 1.5 * brute.size() )
+    {
+    std::cerr << "Bisecting k-means does not split to the radius" << std::endl;
+    passed = false;
+    }
+
+  // small centers are merged into their neighbors instead of rerunning
+  std::srand( 3 );
+  bisected = bisecting.run( 40, boundedData, 60 );
+  unsigned int minSize = X.cols();
+  for( unsigned int j = 0; j < bisected.size(); j++ )
+    {
+    minSize = std::min( minSize, (unsigned int) bisected[j].points.size() );
+    }
+  std::cout << "Bisecting merge: centers " << bisected.size() << ", min points " << minSize << std::endl;
+  if( !IsPartition( bisected, X.cols() ) || minSize < 60 )
+    {
+    std::cerr << "Bisecting k-means leaves centers below the minimum size" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
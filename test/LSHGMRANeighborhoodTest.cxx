@@ -0,0 +1,166 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMKmeansData.h"
+#include "IKMTree.h"
+#include "EigenEuclideanMetric.h"
+#include "GMRANeighborhood.h"
+#include "LSHGMRANeighborhood.h"
+#include "NodeDistance.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+namespace
+{
+
+using NeighborList = GMRANeighborhood<double>::NeighborList;
+
+class CollectVisitor : public Visitor<double>
+{
+public:
+  std::vector< GMRANode<double> * > nodes;
+
+  void visit( GMRANode<double> *node )
+    {
+    nodes.push_back( node );
+    }
+};
+
+
+// Queries every fifth node with a radius of twice the local radius of its
+// parent, as the neighborhood strategies do. Counts the exact neighbors, the
+// ones found and the ones returned that are not exact neighbors.
+void Compare( const GMRANeighborhood<double> & exact, const GMRANeighborhood<double> & lsh,
+  const std::vector< GMRANode<double> * > & nodes, long & nExact, long & nFound, long & nFalse )
+{
+  nExact = 0;
+  nFound = 0;
+  nFalse = 0;
+  for( unsigned int i = 1; i < nodes.size(); i += 5 )
+    {
+    GMRANode<double> *node = nodes[i];
+    double eps = 2 * node->getParent()->getLocalRadius();
+    NeighborList e;
+    NeighborList a;
+    exact.neighbors( node, eps, e, node->getScale() );
+    lsh.neighbors( node, eps, a, node->getScale() );
+    std::set< GMRANode<double> * > reference;
+    for( NeighborList::iterator it = e.begin(); it != e.end(); ++it )
+      {
+      reference.insert( it->second );
+      }
+    for( NeighborList::iterator it = a.begin(); it != a.end(); ++it )
+      {
+      if( reference.count( it->second ) )
+        {
+        nFound++;
+        }
+      else
+        {
+        nFalse++;
+        }
+      }
+    nExact += reference.size();
+    }
+}
+
+} // namespace
+
+// LSHGMRANeighborhood against the tree search of GenericGMRANeighborhood: no
+// false positives, a reasonable recall with the default tables, all
+// neighbors with buckets wider than the data, and a fresh index after reset.
+int LSHGMRANeighborhoodTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 32, 3000 );
+  MatrixGMRADataObject<double> data( X );
+  std::vector<int> pts( 2000 );
+  for( int i = 0; i < 2000; i++ )
+    {
+    pts[i] = i;
+    }
+
+  IKMTree<double> tree( &data );
+  tree.dataFactory = new L2GMRAKmeansDataFactory<double>();
+  tree.epsilon = 0.05;
+  tree.nKids = 8;
+  tree.addPoints( pts );
+
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> dist( &metric );
+  tree.computeStatistics( &dist );
+
+  GenericGMRANeighborhood<double> exact( &tree, &dist );
+  LSHGMRANeighborhood<double> lsh( &tree, &dist );
+  lsh.minLevelSize = 16;
+  LSHGMRANeighborhood<double> wide( &tree, &dist );
+  wide.minLevelSize = 16;
+  wide.bucketWidth = 1e6;
+
+  CollectVisitor collect;
+  tree.breadthFirstVisitor( &collect );
+
+  long nExact;
+  long nFound;
+  long nFalse;
+  Compare( exact, lsh, collect.nodes, nExact, nFound, nFalse );
+  double recall = nFound / (double) nExact;
+  std::cout << "Default tables: neighbors " << nExact << " found " << nFound
+            << " false " << nFalse << " recall " << recall << std::endl;
+  if( nFalse > 0 || recall < 0.5 )
+    {
+    std::cerr << "LSH neighborhoods have false positives or a low recall" << std::endl;
+    passed = false;
+    }
+
+  Compare( exact, wide, collect.nodes, nExact, nFound, nFalse );
+  std::cout << "Wide buckets: neighbors " << nExact << " found " << nFound
+            << " false " << nFalse << std::endl;
+  if( nFalse > 0 || nFound != nExact )
+    {
+    std::cerr << "LSH neighborhoods with a single bucket are not exact" << std::endl;
+    passed = false;
+    }
+
+  // the index covers the inserted points after a reset
+  std::vector<int> rest;
+  for( int i = 2000; i < X.cols(); i++ )
+    {
+    rest.push_back( i );
+    }
+  std::vector<double> weights;
+  tree.insertPoints( rest, &dist, weights );
+  wide.reset();
+  CollectVisitor updated;
+  tree.breadthFirstVisitor( &updated );
+  Compare( exact, wide, updated.nodes, nExact, nFound, nFalse );
+  std::cout << "After insert: neighbors " << nExact << " found " << nFound
+            << " false " << nFalse << std::endl;
+  if( nFalse > 0 || nFound != nExact || updated.nodes.size() <= collect.nodes.size() )
+    {
+    std::cerr << "LSH neighborhoods miss inserted nodes after reset" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
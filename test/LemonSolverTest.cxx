@@ -0,0 +1,437 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMTree.h"
+#include "GMRAMultiscaleTransport.h"
+#include "MultiscaleTransportLP.h"
+#include "EigenEuclideanMetric.h"
+#include "ExpandNeighborhoodStrategy.h"
+#include "GMRANeighborhood.h"
+#include "IteratedCapacityPropagationStrategy.h"
+#include "LemonSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+typedef std::pair<int, int> Arc;
+
+// Transport problem of clusters of sources and targets, the clusters are
+// close enough that arcs between them are in the optimal plan. With uniform
+// masses the potentials are far from unique.
+struct ClusteredProblem
+{
+  int nClusters;
+  int nPerCluster;
+  Eigen::MatrixXd P;
+  Eigen::MatrixXd Q;
+  Eigen::VectorXd a;
+  Eigen::VectorXd b;
+
+  ClusteredProblem( int k, int n, bool uniform ) : nClusters( k ), nPerCluster( n )
+    {
+    P = Eigen::MatrixXd::Random( 2, k * n );
+    Q = Eigen::MatrixXd::Random( 2, k * n );
+    for( int i = 0; i < k * n; i++ )
+      {
+      P( 0, i ) += 1.2 * ( i / n );
+      Q( 0, i ) += 1.2 * ( i / n );
+      }
+    a = Eigen::VectorXd::Ones( k * n );
+    b = Eigen::VectorXd::Ones( k * n );
+    if( !uniform )
+      {
+      a += 0.5 * Eigen::VectorXd::Random( k * n );
+      b += 0.5 * Eigen::VectorXd::Random( k * n );
+      }
+    a /= a.sum();
+    b /= b.sum();
+    }
+
+  double Cost( const Arc & arc ) const
+    {
+    return ( P.col( arc.first ) - Q.col( arc.second ) ).squaredNorm();
+    }
+};
+
+// Sets up the balanced LP of TransportLPSolver on the arcs: the source and
+// target rows, the four mass rows without mass and the distribution and
+// exchange columns. Returns the first column of the arcs.
+long SetupLP( LemonSolver & lp, const ClusteredProblem & problem, const std::vector<Arc> & arcs )
+{
+  long ns = problem.a.size();
+  long nt = problem.b.size();
+  long sourceSupply = ns + nt;
+  long sourceSink = ns + nt + 1;
+  long targetSupply = ns + nt + 2;
+  long targetSink = ns + nt + 3;
+  lp.createLP( ns + 3, nt + 3 );
+  lp.addRows( ns + nt + 4 );
+  lp.addColumns( 2 * ns + 2 * nt + 3 + arcs.size() );
+
+  long col = 0;
+  for( long i = 0; i < ns; i++ )
+    {
+    lp.setRowBounds( i, problem.a( i ) );
+    lp.setColumnBounds( col, 0, 0.99999 * problem.a( i ) );
+    lp.setColumnCoefficients( col++, sourceSupply, i );
+    lp.setColumnBounds( col, 0, 0.99999 * problem.a( i ) );
+    lp.setColumnCoefficients( col++, i, sourceSink );
+    }
+  for( long j = 0; j < nt; j++ )
+    {
+    lp.setRowBounds( ns + j, -problem.b( j ) );
+    lp.setColumnBounds( col, 0, 0.99999 * problem.b( j ) );
+    lp.setColumnCoefficients( col++, ns + j, targetSink );
+    lp.setColumnBounds( col, 0, 0.99999 * problem.b( j ) );
+    lp.setColumnCoefficients( col++, targetSupply, ns + j );
+    }
+  lp.setColumnBounds( col, 0, 0 );
+  lp.setColumnCoefficients( col++, sourceSupply, targetSink );
+  lp.setColumnBounds( col, 0, 0 );
+  lp.setColumnCoefficients( col++, targetSupply, sourceSink );
+  lp.setColumnBounds( col, 0, 0 );
+  lp.setColumnCoefficients( col++, sourceSink, sourceSupply );
+
+  long first = col;
+  for( unsigned int k = 0; k < arcs.size(); k++ )
+    {
+    lp.setColumnBoundsLower( col, 0 );
+    lp.setColumnObjective( col, problem.Cost( arcs[k] ) );
+    lp.setColumnCoefficients( col++, arcs[k].first, ns + arcs[k].second );
+    }
+  return first;
+}
+
+// Reduced cost in units of the potentials of the network simplex
+double ReducedCost( LemonSolver & lp, double scaling, double cost, long s, long t )
+{
+  return scaling * cost + lp.getRowDual( s ) - lp.getRowDual( t );
+}
+
+// Solves the LP on arcs, the arcs between the clusters with negative
+// reduced cost are admitted into the LP as by the neighborhood strategies
+// until there are none. Returns the objective.
+double ColumnGeneration( const ClusteredProblem & problem, bool decompose, std::vector<Arc> & arcs,
+  long & nInfeasible, std::vector< std::set<Arc> > & admitted )
+{
+  long ns = problem.a.size();
+  double objective = 0;
+  for( int round = 0; round < 20; round++ )
+    {
+    LemonSolver lp;
+    lp.setDecomposeComponents( decompose );
+    long first = SetupLP( lp, problem, arcs );
+    lp.solveLP();
+    objective = lp.getObjectiveValue();
+
+    double maxCost = 0;
+    for( unsigned int k = 0; k < arcs.size(); k++ )
+      {
+      maxCost = std::max( maxCost, problem.Cost( arcs[k] ) );
+      }
+    double scaling = -lp.getDualScaling( maxCost );
+
+    // every column without flow, the distribution columns cost nothing
+    long ind[2];
+    double val[2];
+    for( long col = 0; col < lp.getNumberOfColumns(); col++ )
+      {
+      if( lp.getColumnPrimal( col ) > 0 )
+        {
+        continue;
+        }
+      lp.getColumn( col, ind, val );
+      double cost = col < first ? 0 : problem.Cost( arcs[col - first] );
+      if( col >= first - 3 && col < first )
+        {
+        // exchange columns without capacity
+        continue;
+        }
+      if( ReducedCost( lp, scaling, cost, ind[0], ind[1] ) < -1 )
+        {
+        nInfeasible++;
+        }
+      }
+
+    std::set<Arc> present( arcs.begin(), arcs.end() );
+    std::set<Arc> added;
+    for( int s = 0; s < ns; s++ )
+      {
+      for( int t = 0; t < problem.b.size(); t++ )
+        {
+        Arc arc( s, t );
+        if( present.count( arc ) == 0 && ReducedCost( lp, scaling, problem.Cost( arc ), s, ns + t ) < -1 )
+          {
+          added.insert( arc );
+          }
+        }
+      }
+    admitted.push_back( added );
+    if( added.empty() )
+      {
+      break;
+      }
+    arcs.insert( arcs.end(), added.begin(), added.end() );
+    }
+  return objective;
+}
+
+// Column generation from the arcs within the clusters on the whole network
+// and on the components. The potentials have to be optimal for the whole
+// LP and lead to the optimal cost. If compareAdmitted the admitted arcs have
+// to be those of the whole network.
+bool CheckProblem( const ClusteredProblem & problem, bool compareAdmitted )
+{
+  std::vector<Arc> clusterArcs;
+  for( int c = 0; c < problem.nClusters; c++ )
+    {
+    for( int i = 0; i < problem.nPerCluster; i++ )
+      {
+      for( int j = 0; j < problem.nPerCluster; j++ )
+        {
+        clusterArcs.push_back( Arc( c * problem.nPerCluster + i, c * problem.nPerCluster + j ) );
+        }
+      }
+    }
+
+  std::vector<Arc> wholeArcs = clusterArcs;
+  std::vector<Arc> decomposedArcs = clusterArcs;
+  std::vector< std::set<Arc> > wholeAdmitted;
+  std::vector< std::set<Arc> > decomposedAdmitted;
+  long wholeInfeasible = 0;
+  long decomposedInfeasible = 0;
+  double whole = ColumnGeneration( problem, false, wholeArcs, wholeInfeasible, wholeAdmitted );
+  double decomposed = ColumnGeneration( problem, true, decomposedArcs, decomposedInfeasible, decomposedAdmitted );
+
+  std::vector<Arc> allArcs;
+  for( int s = 0; s < problem.a.size(); s++ )
+    {
+    for( int t = 0; t < problem.b.size(); t++ )
+      {
+      allArcs.push_back( Arc( s, t ) );
+      }
+    }
+  LemonSolver full;
+  SetupLP( full, problem, allArcs );
+  full.solveLP();
+  double optimal = full.getObjectiveValue();
+
+  std::cout << "Admitted arcs whole network:";
+  for( unsigned int i = 0; i < wholeAdmitted.size(); i++ )
+    {
+    std::cout << " " << wholeAdmitted[i].size();
+    }
+  std::cout << std::endl << "Admitted arcs components:";
+  for( unsigned int i = 0; i < decomposedAdmitted.size(); i++ )
+    {
+    std::cout << " " << decomposedAdmitted[i].size();
+    }
+  std::cout << std::endl;
+  std::cout << "Cost whole network: " << whole << " components: " << decomposed << " all arcs: " << optimal
+    << std::endl;
+  std::cout << "Dual infeasible columns whole network: " << wholeInfeasible << " components: "
+    << decomposedInfeasible << std::endl;
+
+  bool passed = true;
+  if( decomposedAdmitted.size() < 2 || decomposedAdmitted[0].empty() )
+    {
+    std::cerr << "No arcs between the components admitted" << std::endl;
+    passed = false;
+    }
+  if( compareAdmitted && decomposedAdmitted != wholeAdmitted )
+    {
+    std::cerr << "Arcs admitted with the potentials of the components differ from the whole network" << std::endl;
+    passed = false;
+    }
+  if( decomposedInfeasible > 0 || wholeInfeasible > 0 )
+    {
+    std::cerr << "Potentials are not optimal for the whole network" << std::endl;
+    passed = false;
+    }
+  if( std::abs( whole - optimal ) > 1e-6 * optimal || std::abs( decomposed - optimal ) > 1e-6 * optimal )
+    {
+    std::cerr << "Admitted arcs do not lead to the optimal cost" << std::endl;
+    passed = false;
+    }
+  return passed;
+}
+
+// LP on all arcs of a cluster whose arcs into target 0 carry at most a
+// tenth of its mass. isFeasible has to report arcs into target 0, and the LP
+// has to be feasible after their bounds are removed.
+bool CheckFeasibility()
+{
+  ClusteredProblem problem( 1, 8, false );
+  long ns = problem.a.size();
+  long nt = problem.b.size();
+  std::vector<Arc> arcs;
+  for( int s = 0; s < ns; s++ )
+    {
+    for( int t = 0; t < nt; t++ )
+      {
+      arcs.push_back( Arc( s, t ) );
+      }
+    }
+
+  LemonSolver lp;
+  long first = SetupLP( lp, problem, arcs );
+  std::vector<long> blocking;
+  bool feasible = lp.isFeasible( blocking, first );
+  lp.solveLP();
+  bool passed = true;
+  if( !feasible || !blocking.empty() || !lp.isOptimal() )
+    {
+    std::cerr << "LP without arc bounds is reported infeasible" << std::endl;
+    passed = false;
+    }
+
+  for( unsigned int k = 0; k < arcs.size(); k++ )
+    {
+    if( arcs[k].second == 0 )
+      {
+      lp.setColumnBounds( first + k, 0, 0.1 * problem.b( 0 ) / ns );
+      }
+    }
+  feasible = lp.isFeasible( blocking, first );
+  lp.solveLP();
+  bool intoTarget = !blocking.empty();
+  for( unsigned int i = 0; i < blocking.size(); i++ )
+    {
+    intoTarget = intoTarget && blocking[i] >= first && arcs[ blocking[i] - first ].second == 0;
+    }
+  std::cout << "Blocking columns of the bounded LP: " << blocking.size() << std::endl;
+  if( feasible || lp.isOptimal() || !intoTarget )
+    {
+    std::cerr << "Infeasible arc bounds are not reported by isFeasible" << std::endl;
+    passed = false;
+    }
+
+  for( unsigned int i = 0; i < blocking.size(); i++ )
+    {
+    lp.setColumnBoundsLower( blocking[i], 0 );
+    }
+  blocking.clear();
+  feasible = lp.isFeasible( blocking, first );
+  lp.solveLP();
+  if( !feasible || !blocking.empty() || !lp.isOptimal() )
+    {
+    std::cerr << "LP with the blocking bounds removed is not feasible" << std::endl;
+    passed = false;
+    }
+  return passed;
+}
+
+// Optimal transport cost of the multiscale solve with the expand strategy
+double MultiscaleCost( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y, bool decompose )
+{
+  std::srand( 2019 );
+  MatrixGMRADataObject<double> sourceData( X );
+  MatrixGMRADataObject<double> targetData( Y );
+  std::vector<double> sourceWeights( X.cols(), 1.0 );
+  std::vector<double> targetWeights( Y.cols(), 1.0 );
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> sourceDist( &metric );
+  CenterNodeDistance<double> targetDist( &metric );
+
+  IKMTree<double> sourceTree( &sourceData );
+  IKMTree<double> targetTree( &targetData );
+  IKMTree<double> *trees[2] = { &sourceTree, &targetTree };
+  for( int k = 0; k < 2; k++ )
+    {
+    std::vector<int> pts( trees[k]->getDataObject()->numberOfPoints() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    trees[k]->dataFactory = new L2GMRAKmeansDataFactory<double>();
+    trees[k]->epsilon = 0;
+    trees[k]->nKids = 4;
+    trees[k]->minPoints = 1;
+    trees[k]->addPoints( pts );
+    }
+  sourceTree.computeStatistics( &sourceDist, sourceWeights );
+  targetTree.computeStatistics( &targetDist, targetWeights );
+
+  GenericGMRANeighborhood<double> sourceNeighborhood( &sourceTree, &sourceDist );
+  GenericGMRANeighborhood<double> targetNeighborhood( &targetTree, &targetDist );
+  std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( sourceNeighborhood, false );
+  std::vector< MultiscaleTransportLevel<double> * > targetLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( targetNeighborhood, false );
+
+  LemonSolver lemon;
+  TransportLPSolver<double> *lpSolver =
+    new TransportLPSolver<double>( &lemon, TransportLPSolver<double>::BALANCED, 0, 0 );
+  MultiscaleTransportLP<double> transport( lpSolver );
+  transport.setPropagationStrategy1( new IteratedCapacityPropagationStrategy<double>( 0, 0 ) );
+  transport.setDecomposeComponents( decompose );
+  transport.addNeighborhodStrategy( new ExpandNeighborhoodStrategy<double>( 1.5, 0, 1 ) );
+  std::vector< TransportPlan<double> * > plans = transport.solve( sourceLevels, targetLevels, 2, -1, -1, false, true );
+  double cost = plans.back()->cost;
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    delete plans[i];
+    }
+  return cost;
+}
+
+} // namespace
+
+// LemonSolver with the decomposition into connected components against the
+// solve of the whole network. The potentials of the components are aligned
+// through the shared mass rows, they are optimal for the whole LP and the
+// arcs between components admitted with them lead to the same optimum.
+int LemonSolverTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  ClusteredProblem generic( 4, 30, false );
+  passed &= CheckProblem( generic, true );
+  ClusteredProblem uniform( 4, 30, true );
+  passed &= CheckProblem( uniform, false );
+  passed &= CheckFeasibility();
+
+  // the expand strategy over the levels of a multiscale solve, the fine
+  // scales decompose into several components
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 2, 300 );
+  Eigen::MatrixXd Y = Eigen::MatrixXd::Random( 2, 300 );
+  for( int i = 0; i < 300; i++ )
+    {
+    X( 0, i ) += 4 * ( i % 3 );
+    Y( 0, i ) += 4 * ( i % 3 );
+    }
+  double multiscaleWhole = MultiscaleCost( X, Y, false );
+  double multiscaleDecomposed = MultiscaleCost( X, Y, true );
+  std::cout << "Multiscale cost whole network: " << multiscaleWhole << " components: " << multiscaleDecomposed
+    << std::endl;
+  if( std::abs( multiscaleWhole - multiscaleDecomposed ) > 1e-6 * multiscaleWhole )
+    {
+    std::cerr << "Multiscale solve with components differs from the whole network" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
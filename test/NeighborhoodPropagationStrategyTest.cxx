@@ -0,0 +1,172 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMTree.h"
+#include "GMRAMultiscaleTransport.h"
+#include "MultiscaleTransportLP.h"
+#include "EigenEuclideanMetric.h"
+#include "ExpandNeighborhoodStrategy.h"
+#include "GMRANeighborhood.h"
+#include "IteratedCapacityPropagationStrategy.h"
+#include "LemonSolver.h"
+#include "Parallel.h"
+#include "RandomizedNeighborhoodPropagationStrategy.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// Costs of the plans at all scales and the paths of the finest plan
+struct Solution
+{
+  std::vector<double> costs;
+  std::vector<int> from;
+  std::vector<int> to;
+  std::vector<double> weights;
+
+  bool operator==( const Solution & other ) const
+    {
+    return costs == other.costs && from == other.from && to == other.to && weights == other.weights;
+    }
+};
+
+
+// Multiscale solve with the expand strategy on IKM trees, the propagation
+// strategy is seeded with seed and solves on nThreads threads
+Solution MultiscaleSolve( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y,
+  NeighborhoodPropagationStrategy<double> *propagation, unsigned long seed, int nThreads )
+{
+  std::srand( 2019 );
+  MatrixGMRADataObject<double> sourceData( X );
+  MatrixGMRADataObject<double> targetData( Y );
+  std::vector<double> sourceWeights( X.cols(), 1.0 );
+  std::vector<double> targetWeights( Y.cols(), 1.0 );
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> sourceDist( &metric );
+  CenterNodeDistance<double> targetDist( &metric );
+
+  IKMTree<double> sourceTree( &sourceData );
+  IKMTree<double> targetTree( &targetData );
+  IKMTree<double> *trees[2] = { &sourceTree, &targetTree };
+  for( int k = 0; k < 2; k++ )
+    {
+    std::vector<int> pts( trees[k]->getDataObject()->numberOfPoints() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    trees[k]->dataFactory = new L2GMRAKmeansDataFactory<double>();
+    trees[k]->epsilon = 0;
+    trees[k]->nKids = 4;
+    trees[k]->minPoints = 1;
+    trees[k]->addPoints( pts );
+    }
+  sourceTree.computeStatistics( &sourceDist, sourceWeights );
+  targetTree.computeStatistics( &targetDist, targetWeights );
+
+  GenericGMRANeighborhood<double> sourceNeighborhood( &sourceTree, &sourceDist );
+  GenericGMRANeighborhood<double> targetNeighborhood( &targetTree, &targetDist );
+  std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( sourceNeighborhood, false );
+  std::vector< MultiscaleTransportLevel<double> * > targetLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( targetNeighborhood, false );
+
+  LemonSolver lemon;
+  TransportLPSolver<double> *lpSolver =
+    new TransportLPSolver<double>( &lemon, TransportLPSolver<double>::BALANCED, 0, 0 );
+  MultiscaleTransportLP<double> transport( lpSolver );
+  propagation->setSeed( seed );
+  transport.setPropagationStrategy1( propagation );
+  transport.addNeighborhodStrategy( new ExpandNeighborhoodStrategy<double>( 1.5, 0, 1 ) );
+
+  Parallel::setNumberOfThreads( nThreads );
+  std::vector< TransportPlan<double> * > plans = transport.solve( sourceLevels, targetLevels, 2, -1, -1, false, true );
+  Parallel::setNumberOfThreads( 0 );
+
+  Solution solution;
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    solution.costs.push_back( plans[i]->cost );
+    }
+  TransportPlan<double> *finest = plans.back();
+  for( finest->pathIteratorBegin(); !finest->pathIteratorIsAtEnd(); finest->pathIteratorNext() )
+    {
+    TransportPlan<double>::Path & path = finest->pathIteratorCurrent();
+    solution.from.push_back( path.from->getID() );
+    solution.to.push_back( path.to->getID() );
+    solution.weights.push_back( path.w );
+    }
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    delete plans[i];
+    }
+  return solution;
+}
+
+
+// Same solutions with the same seed on one and on four threads, and on a
+// repeated run
+bool CheckDeterminism( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y,
+  NeighborhoodPropagationStrategy<double> *strategies[3], const char *name )
+{
+  Solution serial = MultiscaleSolve( X, Y, strategies[0], 7, 1 );
+  Solution threaded = MultiscaleSolve( X, Y, strategies[1], 7, 4 );
+  Solution repeated = MultiscaleSolve( X, Y, strategies[2], 7, 4 );
+  std::cout << name << ": cost serial " << serial.costs.back() << " threaded " << threaded.costs.back()
+            << " repeated " << repeated.costs.back() << ", paths " << serial.weights.size() << std::endl;
+  if( !( serial == threaded ) || !( threaded == repeated ) )
+    {
+    std::cerr << name << " alternate solutions depend on the threads or the run" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+} // namespace
+
+// The alternate solutions of the propagation strategies are solved on a pool
+// of LP solvers with one generator per chain. With a fixed seed the plans
+// have to be the same for any number of threads.
+int NeighborhoodPropagationStrategyTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 2, 500 );
+  Eigen::MatrixXd Y = Eigen::MatrixXd::Random( 2, 500 );
+
+  NeighborhoodPropagationStrategy<double> *randomized[3];
+  NeighborhoodPropagationStrategy<double> *iterated[3];
+  for( int k = 0; k < 3; k++ )
+    {
+    randomized[k] = new RandomizedNeighborhoodPropagationStrategy<double>( 6, 0 );
+    iterated[k] = new IteratedCapacityPropagationStrategy<double>( 2, 0, 3 );
+    }
+  passed &= CheckDeterminism( X, Y, randomized, "Randomized" );
+  passed &= CheckDeterminism( X, Y, iterated, "Iterated capacity" );
+  for( int k = 0; k < 3; k++ )
+    {
+    delete randomized[k];
+    delete iterated[k];
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,183 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMTree.h"
+#include "GMRAMultiscaleTransport.h"
+#include "MultiscaleTransportLP.h"
+#include "EigenEuclideanMetric.h"
+#include "GMRANeighborhood.h"
+#include "IteratedCapacityPropagationStrategy.h"
+#include "LemonSolver.h"
+#include "Parallel.h"
+#include "PotentialNeighborhoodStrategy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// Costs and paths of the plans at all scales
+struct Solution
+{
+  std::vector<double> costs;
+  std::vector<int> from;
+  std::vector<int> to;
+  std::vector<double> weights;
+
+  bool operator==( const Solution & other ) const
+    {
+    return costs == other.costs && from == other.from && to == other.to && weights == other.weights;
+    }
+};
+
+
+// Multiscale solve with the potential strategy on IKM trees on nThreads
+// threads
+Solution MultiscaleSolve( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y,
+  PotentialNeighborhoodStrategy<double> *strategy, int nThreads )
+{
+  std::srand( 2019 );
+  MatrixGMRADataObject<double> sourceData( X );
+  MatrixGMRADataObject<double> targetData( Y );
+  std::vector<double> sourceWeights( X.cols(), 1.0 );
+  std::vector<double> targetWeights( Y.cols(), 1.0 );
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> sourceDist( &metric );
+  CenterNodeDistance<double> targetDist( &metric );
+
+  IKMTree<double> sourceTree( &sourceData );
+  IKMTree<double> targetTree( &targetData );
+  IKMTree<double> *trees[2] = { &sourceTree, &targetTree };
+  for( int k = 0; k < 2; k++ )
+    {
+    std::vector<int> pts( trees[k]->getDataObject()->numberOfPoints() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    trees[k]->dataFactory = new L2GMRAKmeansDataFactory<double>();
+    trees[k]->epsilon = 0;
+    trees[k]->nKids = 4;
+    trees[k]->minPoints = 1;
+    trees[k]->addPoints( pts );
+    }
+  sourceTree.computeStatistics( &sourceDist, sourceWeights );
+  targetTree.computeStatistics( &targetDist, targetWeights );
+
+  GenericGMRANeighborhood<double> sourceNeighborhood( &sourceTree, &sourceDist );
+  GenericGMRANeighborhood<double> targetNeighborhood( &targetTree, &targetDist );
+  std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( sourceNeighborhood, false );
+  std::vector< MultiscaleTransportLevel<double> * > targetLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( targetNeighborhood, false );
+
+  LemonSolver lemon;
+  TransportLPSolver<double> *lpSolver =
+    new TransportLPSolver<double>( &lemon, TransportLPSolver<double>::BALANCED, 0, 0 );
+  MultiscaleTransportLP<double> transport( lpSolver );
+  IteratedCapacityPropagationStrategy<double> propagation( 0, 0 );
+  transport.setPropagationStrategy1( &propagation );
+  transport.addNeighborhodStrategy( strategy );
+
+  Parallel::setNumberOfThreads( nThreads );
+  std::vector< TransportPlan<double> * > plans = transport.solve( sourceLevels, targetLevels, 2, -1, -1, false, true );
+  Parallel::setNumberOfThreads( 0 );
+
+  Solution solution;
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    solution.costs.push_back( plans[i]->cost );
+    for( plans[i]->pathIteratorBegin(); !plans[i]->pathIteratorIsAtEnd(); plans[i]->pathIteratorNext() )
+      {
+      TransportPlan<double>::Path & path = plans[i]->pathIteratorCurrent();
+      solution.from.push_back( path.from->getID() );
+      solution.to.push_back( path.to->getID() );
+      solution.weights.push_back( path.w );
+      }
+    }
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    delete plans[i];
+    }
+  return solution;
+}
+
+
+// Same solution on one and on four threads
+bool CheckThreads( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y,
+  double threshold, bool sort, int nAdd, const char *name )
+{
+  PotentialNeighborhoodStrategy<double> serialStrategy( threshold, 0, sort, false, 1, nAdd );
+  PotentialNeighborhoodStrategy<double> threadedStrategy( threshold, 0, sort, false, 1, nAdd );
+  Solution serial = MultiscaleSolve( X, Y, &serialStrategy, 1 );
+  Solution threaded = MultiscaleSolve( X, Y, &threadedStrategy, 4 );
+  std::cout << name << ": cost serial " << serial.costs.back() << " threaded " << threaded.costs.back()
+            << ", paths " << serial.weights.size() << " and " << threaded.weights.size() << std::endl;
+  if( !( serial == threaded ) )
+    {
+    std::cerr << name << ": the potential strategy depends on the number of threads" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+} // namespace
+
+// PotentialNeighborhoodStrategy searches the source nodes in parallel rounds
+// and merges their arcs in source order, the plans have to be those of the
+// serial search.
+int PotentialNeighborhoodStrategyTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  // more source nodes than a round of the search
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 2, 5000 );
+  Eigen::MatrixXd Y = Eigen::MatrixXd::Random( 2, 5000 );
+  passed &= CheckThreads( X, Y, 0, false, 1000000, "Exact" );
+  passed &= CheckThreads( X, Y, 0.1, true, 1000000, "Sorted with threshold" );
+  passed &= CheckThreads( X, Y, 0, true, 2000, "Sorted with cutoff" );
+
+  // Parallel::sort is stable, ties keep their order
+  std::vector< std::pair<int, int> > values( 50000 );
+  for( unsigned int i = 0; i < values.size(); i++ )
+    {
+    values[i] = std::make_pair( std::rand() % 100, (int) i );
+    }
+  std::vector< std::pair<int, int> > sorted = values;
+  std::vector< std::pair<int, int> > reference = values;
+  auto byFirst = []( const std::pair<int, int> & a, const std::pair<int, int> & b )
+    {
+    return a.first < b.first;
+    };
+  Parallel::setNumberOfThreads( 4 );
+  Parallel::sort( sorted.begin(), sorted.end(), byFirst );
+  Parallel::setNumberOfThreads( 0 );
+  std::stable_sort( reference.begin(), reference.end(), byFirst );
+  if( sorted != reference )
+    {
+    std::cerr << "Parallel::sort differs from std::stable_sort" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
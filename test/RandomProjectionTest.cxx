@@ -0,0 +1,193 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMKmeansData.h"
+#include "IKMTree.h"
+#include "EigenEuclideanMetric.h"
+#include "NodeDistance.h"
+#include "Parallel.h"
+#include "RandomProjection.h"
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+class CollectVisitor : public Visitor<double>
+{
+public:
+  std::vector< GMRANode<double> * > nodes;
+
+  void visit( GMRANode<double> *node )
+    {
+    nodes.push_back( node );
+    }
+};
+
+
+// n points in d dimensions close to a random subspace of dimension k
+Eigen::MatrixXd LowRankPoints( const Eigen::MatrixXd & B, int n )
+{
+  Eigen::ArrayXd scales = Eigen::ArrayXd::LinSpaced( B.cols(), 5, 2 );
+  Eigen::MatrixXd Z = Eigen::MatrixXd::Random( B.cols(), n ).array().colwise() * scales;
+  return B * Z + 0.05 * Eigen::MatrixXd::Random( B.rows(), n );
+}
+
+
+// Mean of the points of a node in the full space
+Eigen::VectorXd FullMean( GMRANode<double> *node, const Eigen::MatrixXd & X )
+{
+  std::vector<int> & pts = node->getPoints();
+  Eigen::VectorXd mean = Eigen::VectorXd::Zero( X.rows() );
+  for( unsigned int i = 0; i < pts.size(); i++ )
+    {
+    mean += X.col( pts[i] );
+    }
+  return mean / pts.size();
+}
+
+} // namespace
+
+// RandomProjection of two point sets near a common subspace: orthonormal
+// basis, captured variance close to the leading principal components,
+// reduced distances as lower bounds and exact distances between the finest
+// nodes of trees built in the reduced space.
+int RandomProjectionTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd B = Eigen::MatrixXd::Random( 40, 4 );
+  Eigen::MatrixXd X = LowRankPoints( B, 6000 );
+  Eigen::MatrixXd Y = LowRankPoints( B, 5000 );
+  MatrixGMRADataObject<double> D1( X );
+  MatrixGMRADataObject<double> D2( Y );
+
+  // the blocks are seeded by index, the basis does not depend on the threads
+  Parallel::setNumberOfThreads( 1 );
+  RandomProjection<double> serial( 4 );
+  serial.compute( &D1, &D2 );
+  Parallel::setNumberOfThreads( 4 );
+  RandomProjection<double> projection( 4 );
+  projection.compute( &D1, &D2 );
+
+  Eigen::MatrixXd & Q = projection.getBasis();
+  Eigen::MatrixXd & Qs = serial.getBasis();
+  double orthoError = ( Q.transpose() * Q - Eigen::MatrixXd::Identity( 4, 4 ) ).norm();
+  double threadError = ( Q * Q.transpose() - Qs * Qs.transpose() ).norm();
+
+  Eigen::MatrixXd All( 40, X.cols() + Y.cols() );
+  All << X, Y;
+  Eigen::MatrixXd C = All.colwise() - All.rowwise().mean();
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig( C * C.transpose() );
+  double pca = eig.eigenvalues().tail( 4 ).sum() / eig.eigenvalues().sum();
+  std::cout << "Orthogonality error: " << orthoError << " thread error: " << threadError
+            << " captured variance: " << projection.getCapturedVariance() << " PCA: " << pca << std::endl;
+  if( orthoError > 1e-10 || threadError > 1e-8 ||
+      projection.getCapturedVariance() < pca - 1e-3 || projection.getCapturedVariance() > pca + 1e-10 )
+    {
+    std::cerr << "The projection basis is not close to the leading principal components" << std::endl;
+    passed = false;
+    }
+
+  RandomProjection<double>::Distortion distortion = projection.estimateDistortion( &D1, &D2 );
+  std::cout << "Distortion mean: " << distortion.mean << " max: " << distortion.max << std::endl;
+  if( distortion.mean < 0 || distortion.max < distortion.mean || distortion.max > 0.5 )
+    {
+    std::cerr << "Reduced distances are not lower bounds close to the full distances" << std::endl;
+    passed = false;
+    }
+
+  // trees in the reduced space, the leaves get full space centers
+  ProjectedGMRADataObject<double> P1( &D1, projection );
+  ProjectedGMRADataObject<double> P2( &D2, projection );
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> reduced( &metric );
+  ProjectedNodeDistance<double> dist( &reduced, &metric );
+  IKMTree<double> tree1( &P1 );
+  IKMTree<double> tree2( &P2 );
+  IKMTree<double> *trees[2] = { &tree1, &tree2 };
+  std::vector< GMRANode<double> * > leaves[2];
+  std::vector< GMRANode<double> * > inner[2];
+  for( int k = 0; k < 2; k++ )
+    {
+    IKMTree<double> & tree = *trees[k];
+    tree.dataFactory = new L2GMRAKmeansDataFactory<double>();
+    tree.epsilon = 0.1;
+    std::vector<int> pts( k == 0 ? X.cols() : Y.cols() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    tree.addPoints( pts );
+    tree.computeStatistics( &reduced );
+    dist.addTree( &tree, k == 0 ? (GMRADataObject<double> *) &D1 : &D2, 1 );
+    CollectVisitor collect;
+    tree.depthFirstVisitor( &collect );
+    for( unsigned int i = 0; i < collect.nodes.size(); i++ )
+      {
+      GMRANode<double> *node = collect.nodes[i];
+      if( node->getChildren().empty() )
+        {
+        leaves[k].push_back( node );
+        }
+      else if( node->getScale() < tree.getMaxScale() - 1 )
+        {
+        inner[k].push_back( node );
+        }
+      }
+    }
+  Parallel::setNumberOfThreads( 0 );
+
+  double exactError = 0;
+  double boundViolation = 0;
+  for( unsigned int i = 0; i < leaves[0].size(); i += 5 )
+    {
+    for( unsigned int j = 0; j < leaves[1].size(); j += 5 )
+      {
+      double d = dist.distance( leaves[0][i], leaves[1][j] );
+      double full = ( FullMean( leaves[0][i], X ) - FullMean( leaves[1][j], Y ) ).norm();
+      exactError = std::max( exactError, std::abs( d - full ) );
+      boundViolation = std::max( boundViolation, dist.lowerBound( leaves[0][i], leaves[1][j] ) - d );
+      }
+    }
+  double reducedError = 0;
+  for( unsigned int i = 0; i < inner[0].size(); i++ )
+    {
+    for( unsigned int j = 0; j < inner[1].size(); j++ )
+      {
+      reducedError = std::max( reducedError, std::abs( dist.distance( inner[0][i], inner[1][j] ) -
+        ( inner[0][i]->getCenter() - inner[1][j]->getCenter() ).norm() ) );
+      }
+    }
+  std::cout << "Leaves: " << leaves[0].size() << " and " << leaves[1].size() << " exact error: "
+            << exactError << " bound violation: " << boundViolation << " reduced error: "
+            << reducedError << std::endl;
+  if( exactError > 1e-10 || boundViolation > 1e-10 || reducedError > 1e-12 ||
+      inner[0].empty() || inner[1].empty() )
+    {
+    std::cerr << "ProjectedNodeDistance is not exact on the leaves and reduced above" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "MultiscaleTransportLP.h"
+#include "TransportAutoTuner.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+// Level without nodes for the plans of the recorded scales
+class EmptyLevel : public MultiscaleTransportLevel<double>
+{
+public:
+  EmptyLevel() : MultiscaleTransportLevel<double>( 0, nullptr )
+    {
+    }
+
+  TransportNodeVector getNeighborhood( TransportNode<double> *, double ) const override
+    {
+    return TransportNodeVector();
+    }
+};
+
+
+// Settings of a tuner loaded from filename under profile
+struct Loaded
+{
+  ExpandNeighborhoodStrategy<double> expand;
+  TransportAutoTuner<double> tuner;
+  bool found;
+
+  Loaded( const std::string & filename, const std::string & profile ) :
+    expand( 1, 0, 1 ), tuner( &expand )
+    {
+    tuner.setProfile( profile );
+    found = tuner.load( filename );
+    }
+
+  bool Matches( double factor, int nIterations, long maxSize )
+    {
+    return found && expand.getExpansionFactor() == factor &&
+      expand.getNumberOfRefinementIterations() == nIterations &&
+      tuner.getMaxNeighborhoodSize() == maxSize;
+    }
+};
+
+} // namespace
+
+// TransportAutoTuner::save and load keep the settings of several dataset
+// profiles in one file. Takes the output directory as optional argument.
+int TransportAutoTunerTest( int argc, char *argv[] )
+{
+  bool passed = true;
+  std::string directory = argc > 1 ? argv[1] : ".";
+  std::string filename = directory + "/TransportAutoTunerTest.txt";
+  std::remove( filename.c_str() );
+
+  // sizes are rounded to powers of two
+  std::string small = TransportAutoTuner<double>::makeProfile( 1000, 1030, 2, "IKM" );
+  std::string large = TransportAutoTuner<double>::makeProfile( 100000, 100000, 3, "IKM" );
+  std::cout << "Profiles: " << small << " " << large << std::endl;
+  if( small != TransportAutoTuner<double>::makeProfile( 1024, 1024, 2, "IKM" ) || small == large ||
+      small == TransportAutoTuner<double>::makeProfile( 1000, 1000, 2, "IPCA" ) )
+    {
+    std::cerr << "Profile keys do not round the sizes or ignore the dataset" << std::endl;
+    passed = false;
+    }
+
+  if( Loaded( filename, small ).found )
+    {
+    std::cerr << "Settings loaded from a missing file" << std::endl;
+    passed = false;
+    }
+
+  // a scale over the time budget sets the cutoff of the small profile
+  ExpandNeighborhoodStrategy<double> smallExpand( 2.5, 0, 3 );
+  TransportAutoTuner<double> smallTuner( &smallExpand, 1 );
+  smallTuner.setProfile( small );
+  EmptyLevel level;
+  TransportPlan<double> plan( &level, &level );
+  smallTuner.addScale( 1000, &plan, 10, false );
+  ExpandNeighborhoodStrategy<double> largeExpand( 1.5, 0, 5 );
+  TransportAutoTuner<double> largeTuner( &largeExpand );
+  largeTuner.setProfile( large );
+  ExpandNeighborhoodStrategy<double> unnamedExpand( 2, 0, 2 );
+  TransportAutoTuner<double> unnamedTuner( &unnamedExpand );
+  if( !smallTuner.save( filename ) || !largeTuner.save( filename ) || !unnamedTuner.save( filename ) )
+    {
+    std::cerr << "Tuner settings could not be saved to " << filename << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if( !Loaded( filename, small ).Matches( 2.5, 3, 1000 ) ||
+      !Loaded( filename, large ).Matches( 1.5, 5, -1 ) ||
+      !Loaded( filename, "" ).Matches( 2, 2, -1 ) )
+    {
+    std::cerr << "Loaded settings differ from the saved ones of the profile" << std::endl;
+    passed = false;
+    }
+
+  // saving a profile again replaces only its settings
+  smallExpand.setExpansionFactor( 3 );
+  smallExpand.setNumberOfRefinementIterations( 4 );
+  smallTuner.save( filename );
+  if( !Loaded( filename, small ).Matches( 3, 4, 1000 ) ||
+      !Loaded( filename, large ).Matches( 1.5, 5, -1 ) ||
+      !Loaded( filename, "" ).Matches( 2, 2, -1 ) )
+    {
+    std::cerr << "Saving a profile changed the settings of the other profiles" << std::endl;
+    passed = false;
+    }
+
+  if( Loaded( filename, TransportAutoTuner<double>::makeProfile( 10, 10, 2, "IKM" ) ).found )
+    {
+    std::cerr << "Settings loaded for a profile that was not saved" << std::endl;
+    passed = false;
+    }
+
+  std::ofstream other( filename.c_str() );
+  other << "Profile: " << small << std::endl << "ExpansionFactor: 9" << std::endl;
+  other.close();
+  if( Loaded( filename, small ).found )
+    {
+    std::cerr << "Settings loaded from a file that is not a tuner file" << std::endl;
+    passed = false;
+    }
+  std::remove( filename.c_str() );
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMTree.h"
+#include "GMRAMultiscaleTransport.h"
+#include "EigenEuclideanMetric.h"
+#include "GMRANeighborhood.h"
+#include "Parallel.h"
+#include "TransportCostCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+typedef TransportNode<double>::TransportNodeVector TransportNodeVector;
+
+// IKM tree on the columns of X with the statistics for uniform weights
+class Tree
+{
+public:
+  MatrixGMRADataObject<double> data;
+  EuclideanMetric<double> metric;
+  CenterNodeDistance<double> dist;
+  IKMTree<double> tree;
+  GenericGMRANeighborhood<double> neighborhood;
+
+  Tree( const Eigen::MatrixXd & X ) :
+    data( X ), dist( &metric ), tree( &data ), neighborhood( &tree, &dist )
+    {
+    std::vector<int> pts( X.cols() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    tree.dataFactory = new L2GMRAKmeansDataFactory<double>();
+    tree.epsilon = 0;
+    tree.nKids = 4;
+    tree.minPoints = 1;
+    tree.addPoints( pts );
+    std::vector<double> weights( X.cols(), 1.0 );
+    tree.computeStatistics( &dist, weights );
+    }
+};
+
+
+// Largest difference of the costs through the level to the node costs, all
+// pairs of a block of source nodes and all target nodes
+double CostError( MultiscaleTransportLevel<double> *source, MultiscaleTransportLevel<double> *target,
+  TransportCostCache<double> *cache, int nSources )
+{
+  TransportNodeVector & from = source->getNodes();
+  TransportNodeVector & to = target->getNodes();
+  double error = 0;
+  for( int i = 0; i < nSources; i++ )
+    {
+    for( unsigned int j = 0; j < to.size(); j++ )
+      {
+      double cost = source->getTransportCost( from[i], target, to[j], 1, cache );
+      error = std::max( error, std::abs( cost - from[i]->getTransportCost( to[j], 1 ) ) );
+      }
+    }
+  return error;
+}
+
+} // namespace
+
+// TransportCostCache under concurrent inserts, and the cost caches of
+// MultiscaleTransportLevel: hits return the node costs, misses insert them
+// and renumbering a level retires the cache in use.
+int TransportCostCacheTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  // concurrent inserts rehash the shards, every key is found afterwards
+  TransportCostCache<double> table;
+  const int n = 300;
+  Parallel::setNumberOfThreads( 4 );
+  Parallel::forBlocks( n, 8, [&]( int, long begin, long end )
+    {
+    for( long i = begin; i < end; i++ )
+      {
+      for( int j = 0; j < n; j++ )
+        {
+        table.insert( i, j, i * n + j );
+        }
+      }
+    } );
+  Parallel::setNumberOfThreads( 0 );
+  long nFound = 0;
+  long nWrong = 0;
+  double cost;
+  for( int i = 0; i < n; i++ )
+    {
+    for( int j = 0; j < n; j++ )
+      {
+      if( table.find( i, j, cost ) )
+        {
+        nFound++;
+        nWrong += cost != i * n + j;
+        }
+      }
+    }
+  bool missing = table.find( n, 0, cost ) || table.find( 0, n, cost ) || table.find( -1, -1, cost );
+  table.insert( 1, 2, -1 );
+  bool replaced = table.find( 1, 2, cost ) && cost == -1 && table.size() == n * n;
+  std::cout << "Table: " << table.size() << " costs, found " << nFound << ", wrong " << nWrong << std::endl;
+  if( nFound != n * n || nWrong > 0 || missing || !replaced )
+    {
+    std::cerr << "TransportCostCache lost or mixed up costs" << std::endl;
+    passed = false;
+    }
+  table.clear();
+  if( table.size() != 0 || table.find( 0, 0, cost ) )
+    {
+    std::cerr << "Cleared TransportCostCache is not empty" << std::endl;
+    passed = false;
+    }
+
+  Tree source( Eigen::MatrixXd::Random( 2, 500 ) );
+  Tree target( Eigen::MatrixXd::Random( 2, 500 ) );
+  std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( source.neighborhood, false );
+  std::vector< MultiscaleTransportLevel<double> * > targetLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( target.neighborhood, false );
+  MultiscaleTransportLevel<double> *from = sourceLevels.back();
+  MultiscaleTransportLevel<double> *to = targetLevels.back();
+  int nSources = 20;
+  long nPairs = nSources * to->getNodes().size();
+
+  // misses fill the cache, hits return the same costs without inserting
+  TransportCostCache<double> *cache = from->getTransportCostCache( to, 1 );
+  double missError = CostError( from, to, cache, nSources );
+  long missSize = cache->size();
+  double hitError = CostError( from, to, cache, nSources );
+  bool sameCache = from->getTransportCostCache( to, 1 ) == cache &&
+    from->getTransportCostCache( to, 2 ) != cache &&
+    from->getTransportCostCache( targetLevels[0], 1 ) != cache;
+  std::cout << "Level costs: " << nPairs << " pairs, cached " << missSize << " then " << cache->size()
+            << ", errors " << missError << " " << hitError << std::endl;
+  if( missError > 0 || hitError > 0 || missSize != nPairs || cache->size() != nPairs || !sameCache )
+    {
+    std::cerr << "Cached level costs differ from the node costs" << std::endl;
+    passed = false;
+    }
+
+  // renumbering the target retires the cache, a holder can still use it and
+  // the new cache has the costs by the new ids
+  std::vector<int> reversed( to->getNodes().size() );
+  for( unsigned int i = 0; i < reversed.size(); i++ )
+    {
+    reversed[i] = reversed.size() - 1 - i;
+    }
+  to->reorderNodes( reversed );
+  TransportCostCache<double> *renumbered = from->getTransportCostCache( to, 1 );
+  bool retired = renumbered != cache && renumbered->size() == 0 &&
+    cache->size() == nPairs && cache->find( 0, 0, cost );
+  double renumberedError = CostError( from, to, renumbered, nSources );
+  std::cout << "Renumbered: cached " << renumbered->size() << ", error " << renumberedError << std::endl;
+  if( !retired || renumberedError > 0 || renumbered->size() != nPairs )
+    {
+    std::cerr << "Renumbering does not retire the cost cache" << std::endl;
+    passed = false;
+    }
+
+  // nodes that are not at their id are not cached
+  TransportNode<double> *moved = from->getNodes()[0];
+  moved->setID( 1 );
+  double movedCost = from->getTransportCost( moved, to, to->getNodes()[0], 1, renumbered );
+  moved->setID( 0 );
+  if( movedCost != moved->getTransportCost( to->getNodes()[0], 1 ) || renumbered->size() != nPairs )
+    {
+    std::cerr << "Cost of a node not at its id went through the cache" << std::endl;
+    passed = false;
+    }
+
+  from->setCacheTransportCosts( false );
+  if( from->getTransportCostCache( to, 1 ) != nullptr )
+    {
+    std::cerr << "Disabled cost cache is still returned" << std::endl;
+    passed = false;
+    }
+
+  for( unsigned int s = 0; s < sourceLevels.size(); s++ )
+    {
+    delete sourceLevels[s];
+    }
+  for( unsigned int s = 0; s < targetLevels.size(); s++ )
+    {
+    delete targetLevels[s];
+    }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,256 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IKMTree.h"
+#include "IPCAGWT.h"
+#include "IPCATree.h"
+#include "GMRAMultiscaleTransport.h"
+#include "MultiscaleTransportLP.h"
+#include "EigenEuclideanMetric.h"
+#include "ExpandNeighborhoodStrategy.h"
+#include "GMRANeighborhood.h"
+#include "IteratedCapacityPropagationStrategy.h"
+#include "LemonSolver.h"
+#include "PotentialNeighborhoodStrategy.h"
+#include "WassersteinNodeDistance.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+typedef TransportNode<double>::TransportNodeVector TransportNodeVector;
+
+// Center distance that counts its evaluations, optionally with a lower bound
+// of 0.9 times the distance
+class CountingDistance : public NodeDistance<double>
+{
+public:
+  std::atomic<long> nEvaluations;
+
+  CountingDistance( bool bound ) : nEvaluations( 0 ), m_Bound( bound )
+    {
+    }
+
+  double distance( GMRANode<double> *n1, GMRANode<double> *n2 ) override
+    {
+    nEvaluations++;
+    return ( n1->getCenter() - n2->getCenter() ).norm();
+    }
+
+  bool hasLowerBound() override
+    {
+    return m_Bound;
+    }
+
+  double lowerBound( GMRANode<double> *n1, GMRANode<double> *n2 ) override
+    {
+    return 0.9 * ( n1->getCenter() - n2->getCenter() ).norm();
+    }
+
+private:
+  bool m_Bound;
+};
+
+
+typedef std::vector< NeighborhoodStrategy<double> * > StrategyList;
+
+// Cost of the multiscale solve with the strategies on IKM trees with the
+// distance, the number of paths of the plan and of exact distances it took
+double MultiscaleCost( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y,
+  const StrategyList & strategies, bool bound, long & nPaths, long & nEvaluations )
+{
+  std::srand( 2019 );
+  MatrixGMRADataObject<double> sourceData( X );
+  MatrixGMRADataObject<double> targetData( Y );
+  std::vector<double> sourceWeights( X.cols(), 1.0 );
+  std::vector<double> targetWeights( Y.cols(), 1.0 );
+  CountingDistance dist( bound );
+
+  IKMTree<double> sourceTree( &sourceData );
+  IKMTree<double> targetTree( &targetData );
+  IKMTree<double> *trees[2] = { &sourceTree, &targetTree };
+  for( int k = 0; k < 2; k++ )
+    {
+    std::vector<int> pts( trees[k]->getDataObject()->numberOfPoints() );
+    for( unsigned int i = 0; i < pts.size(); i++ )
+      {
+      pts[i] = i;
+      }
+    trees[k]->dataFactory = new L2GMRAKmeansDataFactory<double>();
+    trees[k]->epsilon = 0;
+    trees[k]->nKids = 4;
+    trees[k]->minPoints = 1;
+    trees[k]->addPoints( pts );
+    }
+  sourceTree.computeStatistics( &dist, sourceWeights );
+  targetTree.computeStatistics( &dist, targetWeights );
+
+  GenericGMRANeighborhood<double> sourceNeighborhood( &sourceTree, &dist );
+  GenericGMRANeighborhood<double> targetNeighborhood( &targetTree, &dist );
+  std::vector< MultiscaleTransportLevel<double> * > sourceLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( sourceNeighborhood, false );
+  std::vector< MultiscaleTransportLevel<double> * > targetLevels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( targetNeighborhood, false );
+
+  LemonSolver lemon;
+  TransportLPSolver<double> *lpSolver =
+    new TransportLPSolver<double>( &lemon, TransportLPSolver<double>::BALANCED, 0, 0 );
+  MultiscaleTransportLP<double> transport( lpSolver );
+  transport.setPropagationStrategy1( new IteratedCapacityPropagationStrategy<double>( 0, 0 ) );
+  for( unsigned int i = 0; i < strategies.size(); i++ )
+    {
+    transport.addNeighborhodStrategy( strategies[i] );
+    }
+  dist.nEvaluations = 0;
+  std::vector< TransportPlan<double> * > plans = transport.solve( sourceLevels, targetLevels, 2, -1, -1, false, true );
+  nEvaluations = dist.nEvaluations;
+  nPaths = plans.back()->getNumberOfPaths();
+  double cost = plans.back()->cost;
+  for( unsigned int i = 0; i < plans.size(); i++ )
+    {
+    delete plans[i];
+    }
+  return cost;
+}
+
+
+// Same plan with and without the bound, optionally with fewer exact
+// distances
+bool CheckScreening( const Eigen::MatrixXd & X, const Eigen::MatrixXd & Y,
+  const StrategyList & exact, const StrategyList & screened, bool fewer, const char *name )
+{
+  long nExactPaths = 0;
+  long nScreenedPaths = 0;
+  long nExact = 0;
+  long nScreened = 0;
+  double exactCost = MultiscaleCost( X, Y, exact, false, nExactPaths, nExact );
+  double screenedCost = MultiscaleCost( X, Y, screened, true, nScreenedPaths, nScreened );
+  std::cout << name << ": cost " << exactCost << " screened " << screenedCost
+            << ", paths " << nExactPaths << " screened " << nScreenedPaths
+            << ", exact distances " << nExact << " screened " << nScreened << std::endl;
+  bool passed = true;
+  if( std::abs( exactCost - screenedCost ) > 1e-9 * exactCost || nExactPaths != nScreenedPaths )
+    {
+    std::cerr << name << " strategy admits other arcs with the bound" << std::endl;
+    passed = false;
+    }
+  if( fewer && nScreened >= nExact )
+    {
+    std::cerr << name << " strategy computes all costs with the bound" << std::endl;
+    passed = false;
+    }
+  return passed;
+}
+
+} // namespace
+
+// The transport cost lower bounds are below the costs, and screening arcs
+// with them leaves the solutions of the neighborhood strategies unchanged.
+int TransportCostLowerBoundTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  // Wasserstein distance of the GWT nodes, bounded by the center distance
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 5, 1000 );
+  MatrixGMRADataObject<double> data( X );
+  std::vector<int> pts( X.cols() );
+  for( int i = 0; i < X.cols(); i++ )
+    {
+    pts[i] = i;
+    }
+  FixedNodeFactory<double> *factory = new FixedNodeFactory<double>( &data, 2 );
+  factory->stop = FixedNodeFactory<double>::NODE_RADIUS;
+  factory->epsilon = 0.3;
+  IPCATree<double> tree( &data, factory );
+  tree.addPoints( pts );
+  IPCAGWT<double> gwt;
+  gwt.setTree( &tree );
+  WassersteinNodeDistance<double> wasserstein;
+  tree.computeStatistics( &wasserstein );
+  GenericGMRANeighborhood<double> neighborhood( &tree, &wasserstein );
+  std::vector< MultiscaleTransportLevel<double> * > levels =
+    GMRAMultiscaleTransportLevel<double>::buildTransportLevels( neighborhood, false );
+
+  bool hasBound = true;
+  long nPairs = 0;
+  double maxExcess = -1;
+  double cachedError = 0;
+  for( unsigned int s = 0; s < levels.size(); s++ )
+    {
+    TransportNodeVector & nodes = levels[s]->getNodes();
+    for( int p = 1; p <= 2; p++ )
+      {
+      TransportCostCache<double> *cache = levels[s]->getTransportCostCache( levels[s], p );
+      for( unsigned int i = 0; i < nodes.size(); i++ )
+        {
+        hasBound = hasBound && nodes[i]->hasTransportCostLowerBound();
+        for( unsigned int j = 0; j < nodes.size(); j++ )
+          {
+          double bound = levels[s]->getTransportCostLowerBound( nodes[i], levels[s], nodes[j], p, cache );
+          double cost = levels[s]->getTransportCost( nodes[i], levels[s], nodes[j], p, cache );
+          maxExcess = std::max( maxExcess, bound - cost );
+          nPairs++;
+          }
+        }
+      // with the costs cached the bound is the cost
+      for( unsigned int i = 0; i < nodes.size(); i++ )
+        {
+        for( unsigned int j = 0; j < nodes.size(); j++ )
+          {
+          cachedError = std::max( cachedError, std::abs(
+            levels[s]->getTransportCostLowerBound( nodes[i], levels[s], nodes[j], p, cache ) -
+            levels[s]->getTransportCost( nodes[i], levels[s], nodes[j], p, cache ) ) );
+          }
+        }
+      }
+    }
+  std::cout << "Wasserstein level pairs: " << nPairs << " max bound excess: " << maxExcess
+            << " cached error: " << cachedError << std::endl;
+  if( !hasBound || maxExcess > 1e-12 || cachedError > 0 )
+    {
+    std::cerr << "Transport cost lower bound exceeds the cost" << std::endl;
+    passed = false;
+    }
+  for( unsigned int s = 0; s < levels.size(); s++ )
+    {
+    delete levels[s];
+    }
+
+  // the strategies reject arcs by the bound only if the exact cost would.
+  // The potentials of the expand strategy are rarely tight enough for the
+  // bound to reject arcs, the potential strategy has to save costs.
+  Eigen::MatrixXd Y = Eigen::MatrixXd::Random( 2, 1000 );
+  Eigen::MatrixXd Z = Eigen::MatrixXd::Random( 2, 1000 );
+  StrategyList expand[2];
+  StrategyList potential[2];
+  for( int k = 0; k < 2; k++ )
+    {
+    expand[k].push_back( new ExpandNeighborhoodStrategy<double>( 1.5, 0, 1 ) );
+    potential[k].push_back( new PotentialNeighborhoodStrategy<double>( 0, 0 ) );
+    }
+  passed &= CheckScreening( Y, Z, expand[0], expand[1], false, "Expand" );
+  passed &= CheckScreening( Y, Z, potential[0], potential[1], true, "Potential" );
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,142 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "EigenWasserstein.h"
+#include "IKMKmeansData.h"
+#include "IKMTree.h"
+#include "IPCAGWT.h"
+#include "IPCATree.h"
+#include "WassersteinNodeDistance.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+class CollectVisitor : public Visitor<double>
+{
+public:
+  std::vector< GMRANode<double> * > nodes;
+
+  void visit( GMRANode<double> *node )
+    {
+    nodes.push_back( node );
+    }
+};
+
+// Squared Wasserstein distance of the Gaussians of two GWT nodes through
+// Wasserstein::covarianceDistSquared
+double ReferenceDistSquared( GMRANode<double> *n1, GMRANode<double> *n2 )
+{
+  GWTNode<double> *g1 = dynamic_cast< GWTNode<double> * >( n1 );
+  GWTNode<double> *g2 = dynamic_cast< GWTNode<double> * >( n2 );
+  int k1 = std::min( g1->getPhi().cols(), g1->getSigma().size() );
+  int k2 = std::min( g2->getPhi().cols(), g2->getSigma().size() );
+  Eigen::MatrixXd U1 = g1->getPhi().leftCols( k1 );
+  Eigen::MatrixXd U2 = g2->getPhi().leftCols( k2 );
+  Eigen::VectorXd S1 = g1->getSigma().head( k1 ).cwiseAbs2();
+  Eigen::VectorXd S2 = g2->getSigma().head( k2 ).cwiseAbs2();
+  Wasserstein<double> wasserstein;
+  return ( g1->getCenter() - g2->getCenter() ).squaredNorm() +
+    wasserstein.covarianceDistSquared( U1, S1, U2, S2 );
+}
+
+} // namespace
+
+// WassersteinNodeDistance against Wasserstein::covarianceDistSquared on the
+// nodes of a GWT, and against the center distance on the nodes of a rebuilt
+// k-means tree.
+int WassersteinNodeDistanceTest( int, char *[] )
+{
+  std::srand( 2019 );
+  bool passed = true;
+
+  Eigen::MatrixXd X = Eigen::MatrixXd::Random( 5, 2000 );
+  MatrixGMRADataObject<double> data( X );
+  std::vector<int> pts( X.cols() );
+  for( int i = 0; i < X.cols(); i++ )
+    {
+    pts[i] = i;
+    }
+
+  FixedNodeFactory<double> *factory = new FixedNodeFactory<double>( &data, 2 );
+  factory->stop = FixedNodeFactory<double>::NODE_RADIUS;
+  factory->epsilon = 0.3;
+  IPCATree<double> tree( &data, factory );
+  tree.addPoints( pts );
+  IPCAGWT<double> gwt;
+  gwt.setTree( &tree );
+
+  WassersteinNodeDistance<double> dist;
+  tree.computeStatistics( &dist );
+  CollectVisitor collect;
+  tree.depthFirstVisitor( &collect );
+  std::vector< GMRANode<double> * > &nodes = collect.nodes;
+
+  double maxError = 0;
+  std::vector<double> batch;
+  for( unsigned int i = 0; i < nodes.size(); i += 7 )
+    {
+    dist.distances( nodes[i], nodes, batch );
+    for( unsigned int j = 0; j < nodes.size(); j++ )
+      {
+      double reference = std::max( 0.0, ReferenceDistSquared( nodes[i], nodes[j] ) );
+      double d = dist.distance( nodes[i], nodes[j] );
+      maxError = std::max( maxError, std::abs( d * d - reference ) );
+      maxError = std::max( maxError, std::abs( batch[j] * batch[j] - reference ) );
+      }
+    }
+  std::cout << "GWT nodes: " << nodes.size() << " max error: " << maxError << std::endl;
+  if( maxError > 1e-6 )
+    {
+    std::cerr << "WassersteinNodeDistance differs from Wasserstein::covarianceDistSquared" << std::endl;
+    passed = false;
+    }
+
+  // nodes that are not GWT decorated are point masses, the factors of the
+  // deleted nodes are dropped when the tree is rebuilt
+  IKMTree<double> ikm( &data );
+  ikm.dataFactory = new L2GMRAKmeansDataFactory<double>();
+  ikm.epsilon = 0.2;
+  std::vector<int> half( pts.begin(), pts.begin() + pts.size() / 2 );
+  ikm.addPoints( half );
+  ikm.computeStatistics( &dist );
+  std::vector<int> rest( pts.begin() + pts.size() / 2, pts.end() );
+  ikm.addPoints( rest );
+  ikm.computeStatistics( &dist );
+  CollectVisitor ikmCollect;
+  ikm.depthFirstVisitor( &ikmCollect );
+  std::vector< GMRANode<double> * > &ikmNodes = ikmCollect.nodes;
+  double ikmError = 0;
+  for( unsigned int i = 0; i + 1 < ikmNodes.size(); i++ )
+    {
+    double reference = ( ikmNodes[i]->getCenter() - ikmNodes[i + 1]->getCenter() ).norm();
+    ikmError = std::max( ikmError, std::abs( dist.distance( ikmNodes[i], ikmNodes[i + 1] ) - reference ) );
+    }
+  std::cout << "Rebuilt k-means nodes: " << ikmNodes.size() << " max error: " << ikmError << std::endl;
+  if( ikmError > 1e-9 )
+    {
+    std::cerr << "WassersteinNodeDistance of point masses differs from the center distance" << std::endl;
+    passed = false;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -25,8 +25,14 @@
 #include "itkMersenneTwisterRandomVariateGenerator.h"
 #include "itkImageRegistrationMethodv4.h"
 #include "itkAffineTransform.h"
+#include "MappedGMRATree.h"
+#include "PointSetGMRADataObject.h"
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <string>
 
 template<typename TFilter>
 class itkPointSetMetricRegistrationTestCommandIterationUpdate : public itk::Command
@@ -67,38 +73,23 @@ public:
 
 
 
-int itkPointSetMultiscaleOptimalTransportTest( int argc, char *argv[] )
+namespace
 {
-  constexpr unsigned int Dimension = 2;
-
-  unsigned int numberOfIterations = 100;
-  if( argc > 1 )
-    {
-    numberOfIterations = std::stoi( argv[1] );
-    }
+constexpr unsigned int Dimension = 2;
+using PointSetType = itk::PointSet<double, Dimension>;
+using OptimalTransportType = itk::PointSetMultiscaleOptimalTransportMethod<PointSetType, PointSetType, double>;
+using CouplingPointer = OptimalTransportType::TransportCouplingType::Pointer;
 
-  using PointSetType = itk::PointSet<double, Dimension>;
 
+// Two noisy ellipses, the moving one only covers half of the ellipse
+void
+GenerateEllipses( PointSetType *fixedPoints, PointSetType *movingPoints )
+{
   using PointType = PointSetType::PointType;
-
-  PointSetType::Pointer fixedPoints = PointSetType::New();
-  fixedPoints->Initialize();
-
-  PointSetType::Pointer movingPoints = PointSetType::New();
-  movingPoints->Initialize();
-
-  //itk::MultiThreaderBase::New()->SetMaximumNumberOfThreads( 8 );
-  //itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads( 8 );
-  std::cout << "MaxNumberOfThreads: ";
-  std::cout << itk::MultiThreaderBase::New()->GetMaximumNumberOfThreads() << std::endl;
-  std::cout << "NumberOfWorkUnits: ";
-  std::cout << itk::MultiThreaderBase::New()->GetNumberOfWorkUnits() << std::endl;
-
   using GeneratorType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
   GeneratorType::Pointer generator = GeneratorType::New();
   generator->Initialize(2019);
 
-  // Generate two noisy ellipses
   unsigned int nSourcePoints= 1000;
   for(int i=0; i< nSourcePoints; i++ )
     {
@@ -122,8 +113,248 @@ int itkPointSetMultiscaleOptimalTransportTest( int argc, char *argv[] )
     movingPoint[1] = 1.5 * radius * std::sin( theta ) + generator->GetNormalVariate();
     movingPoints->SetPoint( i, movingPoint );
     }
+}
+
+
+// Runs the filter with the settings applied by configure. The k-means trees
+// draw from rand(), it is seeded so all runs build the same trees.
+CouplingPointer
+RunTransport( PointSetType *fixedPoints, PointSetType *movingPoints,
+  const std::function< void( OptimalTransportType * ) > &configure )
+{
+  OptimalTransportType::Pointer ot = OptimalTransportType::New();
+  ot->SetSourcePointSet( fixedPoints );
+  ot->SetTargetPointSet( movingPoints );
+  configure( ot );
+  std::srand( 2019 );
+  ot->Update();
+  return ot->GetCoupling();
+}
+
+
+// Squared Euclidean cost of the coupling per unit mass, -1 if a marginal is
+// off the uniform masses by more than 1e-3 relative
+double
+CouplingCost( OptimalTransportType::TransportCouplingType *coupling,
+  PointSetType *fixedPoints, PointSetType *movingPoints )
+{
+  using MapType = OptimalTransportType::TransportCouplingType::TransportMap;
+  MapType &map = coupling->GetMap();
+  unsigned int nSource = fixedPoints->GetNumberOfPoints();
+  unsigned int nTarget = movingPoints->GetNumberOfPoints();
+  if( map.size() != nSource )
+    {
+    std::cerr << "Coupling has " << map.size() << " sources, expected " << nSource << std::endl;
+    return -1;
+    }
+
+  std::vector<double> sourceMass( nSource, 0 );
+  std::vector<double> targetMass( nTarget, 0 );
+  double total = 0;
+  double cost = 0;
+  for( unsigned int i = 0; i < nSource; i++ )
+    {
+    for( MapType::value_type::const_iterator it = map[i].begin(); it != map[i].end(); ++it )
+      {
+      sourceMass[i] += it->second;
+      targetMass[it->first] += it->second;
+      total += it->second;
+      cost += it->second * fixedPoints->GetPoint( i ).SquaredEuclideanDistanceTo(
+        movingPoints->GetPoint( it->first ) );
+      }
+    }
 
-  using OptimalTransportType = itk::PointSetMultiscaleOptimalTransportMethod<PointSetType, PointSetType, double>;
+  double error = 0;
+  for( unsigned int i = 0; i < nSource; i++ )
+    {
+    error = std::max( error, std::abs( sourceMass[i] * nSource / total - 1 ) );
+    }
+  for( unsigned int i = 0; i < nTarget; i++ )
+    {
+    error = std::max( error, std::abs( targetMass[i] * nTarget / total - 1 ) );
+    }
+  if( error > 1e-3 )
+    {
+    std::cerr << "Marginal error: " << error << std::endl;
+    return -1;
+    }
+  return cost / total;
+}
+
+
+bool
+CheckCost( const std::string &name, double cost, double reference, double tolerance )
+{
+  std::cout << name << " cost: " << cost << " default: " << reference << std::endl;
+  if( cost < 0 || std::abs( cost - reference ) > tolerance * reference )
+    {
+    std::cerr << name << " cost is off the default by more than " << tolerance << std::endl;
+    return false;
+    }
+  return true;
+}
+
+
+// Ball trees against the k-means trees of the default path
+int
+TestBallTree( PointSetType *fixedPoints, PointSetType *movingPoints )
+{
+  double reference = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType * ){} ),
+    fixedPoints, movingPoints );
+  double ball = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType *ot ){
+      ot->SetTreeType( OptimalTransportType::BALL_TREE ); } ),
+    fixedPoints, movingPoints );
+  if( reference <= 0 || !CheckCost( "Ball tree", ball, reference, 0.02 ) )
+    {
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+
+// Morton trees against the k-means trees of the default path
+int
+TestMortonTree( PointSetType *fixedPoints, PointSetType *movingPoints )
+{
+  double reference = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType * ){} ),
+    fixedPoints, movingPoints );
+  double morton = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType *ot ){
+      ot->SetTreeType( OptimalTransportType::MORTON_TREE ); } ),
+    fixedPoints, movingPoints );
+  if( reference <= 0 || !CheckCost( "Morton tree", morton, reference, 0.02 ) )
+    {
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+
+// Trees written by the first run and memory mapped by the second give the
+// same coupling as the default path
+int
+TestMappedTree( PointSetType *fixedPoints, PointSetType *movingPoints, const std::string &directory )
+{
+  std::string sourceFile = directory + "/itkPointSetMultiscaleOptimalTransportSource.gmra";
+  std::string targetFile = directory + "/itkPointSetMultiscaleOptimalTransportTarget.gmra";
+  std::remove( sourceFile.c_str() );
+  std::remove( targetFile.c_str() );
+  auto mapped = [&]( OptimalTransportType *ot ){
+    ot->SetSourceTreeFileName( sourceFile );
+    ot->SetTargetTreeFileName( targetFile );
+  };
+
+  CouplingPointer reference = RunTransport( fixedPoints, movingPoints, []( OptimalTransportType * ){} );
+  CouplingPointer written = RunTransport( fixedPoints, movingPoints, mapped );
+
+  // the second run has to load the files, not rebuild the trees
+  bool passed = true;
+  PointSetGMRADataObject<PointSetType> sourceData( fixedPoints );
+  PointSetGMRADataObject<PointSetType> targetData( movingPoints );
+  MappedGMRATree<double> sourceTree( &sourceData );
+  MappedGMRATree<double> targetTree( &targetData );
+  if( !sourceTree.load( sourceFile ) || !targetTree.load( targetFile ) )
+    {
+    std::cerr << "Tree files were not written" << std::endl;
+    passed = false;
+    }
+  CouplingPointer loaded = RunTransport( fixedPoints, movingPoints, mapped );
+
+  if( written->GetMap() != reference->GetMap() )
+    {
+    std::cerr << "Coupling with written trees differs from the default" << std::endl;
+    passed = false;
+    }
+  if( loaded->GetMap() != reference->GetMap() )
+    {
+    std::cerr << "Coupling with mapped trees differs from the default" << std::endl;
+    passed = false;
+    }
+  double cost = CouplingCost( loaded, fixedPoints, movingPoints );
+  double referenceCost = CouplingCost( reference, fixedPoints, movingPoints );
+  passed = CheckCost( "Mapped tree", cost, referenceCost, 0 ) && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Decomposition into connected components and block sweeps solve the same
+// LPs as the default path
+int
+TestDecomposed( PointSetType *fixedPoints, PointSetType *movingPoints )
+{
+  double reference = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType * ){} ),
+    fixedPoints, movingPoints );
+  if( reference <= 0 )
+    {
+    return EXIT_FAILURE;
+    }
+
+  double decomposed = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType *ot ){
+      ot->DecomposeComponentsOn(); } ),
+    fixedPoints, movingPoints );
+  double swept = CouplingCost(
+    RunTransport( fixedPoints, movingPoints, []( OptimalTransportType *ot ){
+      ot->DecomposeComponentsOn();
+      ot->SetNumberOfBlockSweeps( 1 ); } ),
+    fixedPoints, movingPoints );
+
+  bool passed = CheckCost( "Decomposed", decomposed, reference, 1e-6 );
+  passed = CheckCost( "Block sweeps", swept, reference, 1e-6 ) && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace
+
+
+int itkPointSetMultiscaleOptimalTransportTest( int argc, char *argv[] )
+{
+  // Checks against the default path: BallTree, MortonTree, MappedTree
+  // <output directory> and Decomposed. Otherwise the argument is the number
+  // of iterations of the registration.
+  std::string check = argc > 1 ? argv[1] : "";
+
+  PointSetType::Pointer fixedPoints = PointSetType::New();
+  fixedPoints->Initialize();
+
+  PointSetType::Pointer movingPoints = PointSetType::New();
+  movingPoints->Initialize();
+
+  GenerateEllipses( fixedPoints, movingPoints );
+
+  if( check == "BallTree" )
+    {
+    return TestBallTree( fixedPoints, movingPoints );
+    }
+  if( check == "MortonTree" )
+    {
+    return TestMortonTree( fixedPoints, movingPoints );
+    }
+  if( check == "MappedTree" )
+    {
+    return TestMappedTree( fixedPoints, movingPoints, argc > 2 ? argv[2] : "." );
+    }
+  if( check == "Decomposed" )
+    {
+    return TestDecomposed( fixedPoints, movingPoints );
+    }
+
+  unsigned int numberOfIterations = 100;
+  if( argc > 1 )
+    {
+    numberOfIterations = std::stoi( argv[1] );
+    }
+
+  //itk::MultiThreaderBase::New()->SetMaximumNumberOfThreads( 8 );
+  //itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads( 8 );
+  std::cout << "MaxNumberOfThreads: ";
+  std::cout << itk::MultiThreaderBase::New()->GetMaximumNumberOfThreads() << std::endl;
+  std::cout << "NumberOfWorkUnits: ";
+  std::cout << itk::MultiThreaderBase::New()->GetNumberOfWorkUnits() << std::endl;
 
   OptimalTransportType::Pointer ot = OptimalTransportType::New();
   ot->SetSourcePointSet( fixedPoints );